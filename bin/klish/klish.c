@@ -304,7 +304,7 @@ static bool_t send_next_command(ctx_t *ctx)
 				const char *fn = (const char *)faux_list_each(&ctx->files_iter);
 				if (!fn)
 					break; // No more files
-				ctx->files_fd = faux_file_open(fn, O_RDONLY, 0);
+				ctx->files_fd = faux_file_open(fn, O_RDONLY | O_CLOEXEC, 0);
 			}
 			if (!ctx->files_fd) // Can't open file. Try next file
 				continue;
@@ -17,6 +17,7 @@
 #include <sys/wait.h>
 #include <poll.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <faux/faux.h>
 #include <faux/str.h>
@@ -36,6 +37,7 @@
 #include <klish/ktp_session.h>
 
 #include <klish/kscheme.h>
+#include <klish/kplugin.h>
 #include <klish/ischeme.h>
 #include <klish/kcontext.h>
 #include <klish/ksession.h>
@@ -52,10 +54,53 @@ bool_t kentry_entrys_is_empty(const kentry_t *entry);
 static int create_listen_unix_sock(const char *path);
 static kscheme_t *load_all_dbs(const char *dbs,
 	faux_ini_t *global_config, faux_error_t *error);
+static bool_t deploy_db(const kscheme_t *scheme, const char *db_name,
+	faux_ini_t *global_config, faux_error_t *error);
 static bool_t clear_scheme(kscheme_t *scheme, faux_error_t *error);
 static void signal_handler_empty(int signo);
 
 
+// Scheme loading by helper thread. Listener's event loop is not blocked
+// while new scheme is loaded. Thread writes to notify pipe when it's done.
+typedef struct {
+	pthread_t tid;
+	bool_t active;
+	bool_t again; // SIGHUP while loading. Load once more.
+	int notify_fd[2];
+	char *dbs;
+	faux_ini_t *config; // Config for new scheme
+	kscheme_t *scheme; // Loaded scheme. NULL on error.
+	faux_error_t *error;
+} reload_t;
+
+
+// Listener's state. Scheme can be replaced on SIGHUP. Newly forked service
+// processes inherit current one.
+typedef struct {
+	struct options *opts;
+	kscheme_t *scheme;
+	faux_ini_t *config;
+	klishd_pool_t *pool;
+	klishd_threads_t *threads;
+	reload_t reload;
+} listener_t;
+
+
+// Scheme is loading by helper thread. Listener doesn't fork while loader
+// holds plugins' lock. See reload_atfork_*().
+static bool_t scheme_loading = BOOL_FALSE;
+
+
+// Pool worker's service process state
+typedef struct {
+	klishd_pool_t *pool;
+	kscheme_t *scheme;
+	const struct options *opts;
+	ktpd_session_t *ktpd_session;
+	int client_fd;
+} service_t;
+
+
 // Main loop events
 static bool_t stop_loop_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
@@ -65,6 +110,20 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
+static bool_t pool_status_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t pool_accept_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t pool_recycle_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t reload_done_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+
+// Scheme reloading
+static void reload_atfork_prepare(void);
+static void reload_atfork_parent(void);
+static void reload_atfork_child(void);
+static void reload_stop(reload_t *reload);
 
 
 /** @brief Main function
@@ -77,7 +136,10 @@ int main(int argc, char **argv)
 	int logoptions = 0;
 	faux_eloop_t *eloop = NULL;
 	int listen_unix_sock = -1;
-	ktpd_session_t *ktpd_session = NULL;
+	klishd_pool_t *pool = NULL;
+	klishd_threads_t *threads = NULL;
+	listener_t listener = {};
+	service_t service = {};
 	kscheme_t *scheme = NULL;
 	faux_error_t *error = faux_error_new();
 	faux_ini_t *config = NULL;
@@ -114,6 +176,17 @@ int main(int argc, char **argv)
 	// DEBUG: Show options
 	opts_show(opts);
 
+	// Deploy scheme by specified DB plugin and exit
+	if (opts->deploy_db) {
+		if (!(scheme = load_all_dbs(opts->dbs, config, error)) ||
+			!deploy_db(scheme, opts->deploy_db, config, error)) {
+			fprintf(stderr, "Scheme errors:\n");
+			goto err;
+		}
+		retval = 0;
+		goto err;
+	}
+
 	syslog(LOG_INFO, "Start daemon");
 
 	// Fork the daemon if needed
@@ -139,17 +212,47 @@ int main(int argc, char **argv)
 	faux_eloop_add_signal(eloop, SIGINT, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGTERM, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGQUIT, stop_loop_ev, NULL);
-	faux_eloop_add_signal(eloop, SIGHUP, refresh_config_ev, opts);
-	faux_eloop_add_signal(eloop, SIGCHLD, wait_for_child_ev, NULL);
-	// Listen socket. Waiting for new connections
-	faux_eloop_add_fd(eloop, listen_unix_sock, POLLIN,
-		listen_socket_ev, &client_fd);
+	faux_eloop_add_signal(eloop, SIGHUP, refresh_config_ev, &listener);
+	pthread_atfork(reload_atfork_prepare, reload_atfork_parent,
+		reload_atfork_child);
+	if (opts->service_threads > 0) {
+		// Sessions are served by threads of listener. Don't wait for
+		// children here. Threads wait for ACTION processes themselves.
+		threads = klishd_threads_new(listen_unix_sock, scheme, opts);
+		if (!threads) {
+			faux_eloop_free(eloop);
+			goto err;
+		}
+	} else if (opts->pool_min_idle > 0) {
+		// Pre-forked service processes accept connections themselves
+		if (!(pool = klishd_pool_new(listen_unix_sock, opts))) {
+			faux_eloop_free(eloop);
+			goto err;
+		}
+		faux_eloop_add_signal(eloop, SIGCHLD, wait_for_child_ev, pool);
+		faux_eloop_add_fd(eloop, klishd_pool_status_fd(pool), POLLIN,
+			pool_status_ev, pool);
+	} else {
+		faux_eloop_add_signal(eloop, SIGCHLD, wait_for_child_ev, NULL);
+		// Listen socket. Waiting for new connections
+		faux_eloop_add_fd(eloop, listen_unix_sock, POLLIN,
+			listen_socket_ev, &client_fd);
+	}
 	// Scheduled events
 //	faux_eloop_add_sched_once_delayed(eloop, &delayed, 1, sched_once, NULL);
 //	faux_eloop_add_sched_periodic_delayed(eloop, 2, sched_periodic, NULL, &period, FAUX_SCHED_INFINITE);
-	// Main loop
-	faux_eloop_loop(eloop);
+	listener.opts = opts;
+	listener.scheme = scheme;
+	listener.config = config;
+	listener.pool = pool;
+	listener.threads = threads;
+	// Main loop. Initial pool refill returns BOOL_FALSE within worker.
+	if (!pool || klishd_pool_refill(pool))
+		faux_eloop_loop(eloop);
 	faux_eloop_free(eloop);
+	// Scheme can be reloaded by SIGHUP
+	scheme = listener.scheme;
+	config = listener.config;
 
 	retval = 0;
 
@@ -159,12 +262,19 @@ err: // For listen daemon
 		faux_error_show(error);
 	faux_error_free(error);
 
-	// Close listen socket
-	if (listen_unix_sock >= 0)
+	// Close listen socket. Pool worker accepts connection on it later.
+	if ((listen_unix_sock >= 0) && !klishd_pool_is_worker(pool))
 		close(listen_unix_sock);
 
 	// Finish listen daemon if it's not forked service process.
-	if (client_fd < 0) {
+	if ((client_fd < 0) && !klishd_pool_is_worker(pool)) {
+
+		// Terminate idle pool workers
+		klishd_pool_free(pool);
+		// Stop service threads. Their sessions are closed.
+		klishd_threads_free(threads);
+		// Wait for scheme loader
+		reload_stop(&listener.reload);
 
 		// Free scheme
 		clear_scheme(scheme, error);
@@ -199,16 +309,23 @@ err: // For listen daemon
 	// Create event loop
 	eloop = faux_eloop_new(NULL);
 
-	// Create KTP session
-	// Function ktpd_session_new() will add new events to eloop itself.
-	ktpd_session = ktpd_session_new(client_fd, scheme, NULL, eloop);
-	if (!ktpd_session) {
-		syslog(LOG_ERR, "Can't create KTPd session");
-		goto err_client;
+	service.pool = pool;
+	service.scheme = scheme;
+	service.opts = opts;
+	service.client_fd = client_fd;
+	if (klishd_pool_is_worker(pool)) {
+		// Idle pool worker. Session is created on accept().
+		faux_eloop_add_fd(eloop, listen_unix_sock, POLLIN,
+			pool_accept_ev, &service);
+		faux_eloop_add_signal(eloop, KLISHD_POOL_RECYCLE_SIGNAL,
+			pool_recycle_ev, &service);
+	} else {
+		service.ktpd_session = service_session_new(client_fd, scheme,
+			opts, eloop);
+		if (!service.ktpd_session)
+			goto err_client;
 	}
 
-	syslog(LOG_DEBUG, "New connection %d", client_fd);
-
 	// Signals
 	faux_eloop_add_signal(eloop, SIGINT, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGTERM, stop_loop_ev, NULL);
@@ -228,10 +345,13 @@ err: // For listen daemon
 	retval = 0;
 err_client:
 
-	ktpd_session_free(ktpd_session);
+	ktpd_session_free(service.ktpd_session);
 	faux_eloop_free(eloop);
-	syslog(LOG_DEBUG, "Close connection %d", client_fd);
-	close(client_fd);
+	if (service.client_fd >= 0) {
+		syslog(LOG_DEBUG, "Close connection %d", service.client_fd);
+		close(service.client_fd);
+	}
+	klishd_pool_free(pool);
 
 	// Free scheme
 	clear_scheme(scheme, error);
@@ -246,6 +366,32 @@ err_client:
 }
 
 
+/** @brief Creates KTP session for newly connected client.
+ *
+ * Function ktpd_session_new() will add new events to eloop itself.
+ */
+ktpd_session_t *service_session_new(int client_fd, kscheme_t *scheme,
+	const struct options *opts, faux_eloop_t *eloop)
+{
+	ktpd_session_t *ktpd_session = NULL;
+
+	ktpd_session = ktpd_session_new(client_fd, scheme, NULL, eloop);
+	if (!ktpd_session) {
+		syslog(LOG_ERR, "Can't create KTPd session");
+		return NULL;
+	}
+
+	ktpd_session_set_completion_timeout(ktpd_session,
+		opts->completion_timeout);
+	ktpd_session_set_completion_max(ktpd_session, opts->completion_max);
+	ktpd_session_set_zygote(ktpd_session, opts->action_zygote);
+
+	syslog(LOG_DEBUG, "New connection %d", client_fd);
+
+	return ktpd_session;
+}
+
+
 bool_t daemonize(const char *pidfile)
 {
 	// Daemonize
@@ -261,18 +407,16 @@ bool_t daemonize(const char *pidfile)
 }
 
 
-static bool_t load_db(kscheme_t *scheme, const char *db_name,
-	faux_ini_t *config, faux_error_t *error)
+// Creates kdb object, loads and inits DB plugin
+static kdb_t *open_db(const char *db_name, faux_ini_t *config,
+	faux_error_t *error)
 {
 	kdb_t *db = NULL;
 	const char *sofile = NULL;
 
-	assert(scheme);
-	if (!scheme)
-		return BOOL_FALSE;
 	assert(db_name);
 	if (!db_name)
-		return BOOL_FALSE;
+		return NULL;
 
 	// DB.libxml2.so = <so filename>
 	if (config)
@@ -282,7 +426,7 @@ static bool_t load_db(kscheme_t *scheme, const char *db_name,
 	assert(db);
 	if (!db) {
 		faux_ini_free(config);
-		return BOOL_FALSE;
+		return NULL;
 	}
 	// Now kdb owns config
 	kdb_set_ini(db, config);
@@ -293,7 +437,7 @@ static bool_t load_db(kscheme_t *scheme, const char *db_name,
 		faux_error_sprintf(error,
 			"DB \"%s\": Can't load DB plugin", db_name);
 		kdb_free(db);
-		return BOOL_FALSE;
+		return NULL;
 	}
 
 	// Check plugin API version
@@ -305,7 +449,7 @@ static bool_t load_db(kscheme_t *scheme, const char *db_name,
 			kdb_major(db), kdb_minor(db),
 			KDB_MAJOR, KDB_MINOR);
 		kdb_free(db);
-		return BOOL_FALSE;
+		return NULL;
 	}
 
 	// Init plugin
@@ -313,29 +457,89 @@ static bool_t load_db(kscheme_t *scheme, const char *db_name,
 		faux_error_sprintf(error,
 			"DB \"%s\": Can't init DB plugin", db_name);
 		kdb_free(db);
-		return BOOL_FALSE;
+		return NULL;
+	}
+
+	return db;
+}
+
+
+// Finis DB plugin and frees kdb object
+static bool_t close_db(kdb_t *db, const char *db_name, faux_error_t *error)
+{
+	bool_t retcode = BOOL_TRUE;
+
+	// Fini plugin
+	if (kdb_has_fini_fn(db) && !kdb_fini(db)) {
+		faux_error_sprintf(error,
+			"DB \"%s\": Can't fini DB plugin", db_name);
+		retcode = BOOL_FALSE;
 	}
 
+	kdb_free(db);
+
+	return retcode;
+}
+
+
+static bool_t load_db(kscheme_t *scheme, const char *db_name,
+	faux_ini_t *config, faux_error_t *error)
+{
+	kdb_t *db = NULL;
+
+	assert(scheme);
+	if (!scheme)
+		return BOOL_FALSE;
+
+	if (!(db = open_db(db_name, config, error)))
+		return BOOL_FALSE;
+
 	// Load scheme
 	if (!kdb_has_load_fn(db) || !kdb_load_scheme(db, scheme)) {
 		faux_error_sprintf(error,
 			"DB \"%s\": Can't load scheme from DB plugin", db_name);
-		kdb_fini(db);
-		kdb_free(db);
+		close_db(db, db_name, error);
 		return BOOL_FALSE;
 	}
 
-	// Fini plugin
-	if (kdb_has_fini_fn(db) && !kdb_fini(db)) {
-		faux_error_sprintf(error,
-			"DB \"%s\": Can't fini DB plugin", db_name);
-		kdb_free(db);
+	return close_db(db, db_name, error);
+}
+
+
+/** @brief Deploys prepared scheme by DB plugin.
+ *
+ * For example "kbin" DB plugin makes binary scheme image that is loaded
+ * much faster than XML files.
+ */
+static bool_t deploy_db(const kscheme_t *scheme, const char *db_name,
+	faux_ini_t *global_config, faux_error_t *error)
+{
+	kdb_t *db = NULL;
+	faux_ini_t *config = NULL; // Sub-config for DB
+
+	assert(scheme);
+	if (!scheme)
 		return BOOL_FALSE;
+
+	if (global_config) {
+		char *prefix = NULL;
+		prefix = faux_str_mcat(&prefix, "DB.", db_name, ".", NULL);
+		config = faux_ini_extract_subini(global_config, prefix);
+		faux_str_free(prefix);
 	}
 
-	kdb_free(db);
+	if (!(db = open_db(db_name, config, error)))
+		return BOOL_FALSE;
 
-	return BOOL_TRUE;
+	// Deploy scheme
+	if (!kdb_has_deploy_fn(db) || !kdb_deploy_scheme(db, scheme)) {
+		faux_error_sprintf(error,
+			"DB \"%s\": Can't deploy scheme by DB plugin", db_name);
+		close_db(db, db_name, error);
+		return BOOL_FALSE;
+	}
+
+	return close_db(db, db_name, error);
 }
 
 
@@ -403,21 +607,6 @@ static kscheme_t *load_all_dbs(const char *dbs,
 		return NULL;
 	}
 
-
-	// Debug
-/*	{
-		kdb_t *deploy_db = NULL;
-
-		// Deploy (for testing purposes)
-		deploy_db = kdb_new("ischeme", NULL);
-		kdb_load_plugin(deploy_db);
-		kdb_init(deploy_db);
-		kdb_deploy_scheme(deploy_db, scheme);
-		kdb_fini(deploy_db);
-		kdb_free(deploy_db);
-	}
-*/
-
 	return scheme;
 }
 
@@ -457,7 +646,7 @@ static int create_listen_unix_sock(const char *path)
 	if (!path)
 		return -1;
 
-	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+	if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
 		syslog(LOG_ERR, "Can't create socket: %s", strerror(errno));
 		goto err;
 	}
@@ -515,9 +704,11 @@ static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 {
 	int wstatus = 0;
 	pid_t child_pid = -1;
+	klishd_pool_t *pool = (klishd_pool_t *)user_data;
 
 	// Wait for any child process. Doesn't block.
 	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+		klishd_pool_exited(pool, child_pid);
 		if (WIFSIGNALED(wstatus)) {
 			syslog(LOG_ERR, "Service process %d was terminated "
 				"by signal: %d",
@@ -532,36 +723,281 @@ static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	eloop = eloop;
 	type = type;
 	associated_data = associated_data;
-	user_data = user_data;
+
+	// Replace idle pool workers that were terminated
+	if (pool)
+		return klishd_pool_refill(pool);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Pool worker has accepted connection. Refill pool.
+ */
+static bool_t pool_status_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	klishd_pool_t *pool = (klishd_pool_t *)user_data;
+
+	klishd_pool_read_status(pool);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	// Returns BOOL_FALSE within newly forked worker to break listener's
+	// event loop
+	return klishd_pool_refill(pool);
+}
+
+
+/** @brief Event on listen socket within idle pool worker.
+ */
+static bool_t pool_accept_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	service_t *service = (service_t *)user_data;
+	int new_conn = -1;
+
+	assert(service);
+
+	new_conn = klishd_pool_accept(service->pool);
+	if (new_conn < 0)
+		return BOOL_TRUE; // Connection was taken by another worker
+
+	// Listen socket is closed by klishd_pool_accept()
+	faux_eloop_del_fd(eloop, info->fd);
+	service->client_fd = new_conn;
+	service->ktpd_session = service_session_new(new_conn,
+		service->scheme, service->opts, eloop);
+	if (!service->ktpd_session)
+		return BOOL_FALSE;
+
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+// Plugins' lock can be held by loader thread while plugin is initialized.
+// The forked child would never get the lock.
+static void reload_atfork_prepare(void)
+{
+	if (scheme_loading)
+		kplugin_lock();
+}
+
+
+static void reload_atfork_parent(void)
+{
+	if (scheme_loading)
+		kplugin_unlock();
+}
+
+
+// Loader thread doesn't exist within child. Child doesn't use results
+// of loading.
+static void reload_atfork_child(void)
+{
+	if (!scheme_loading)
+		return;
+	kplugin_lock_reset();
+	scheme_loading = BOOL_FALSE;
+}
+
+
+static void *reload_thread(void *arg)
+{
+	reload_t *reload = (reload_t *)arg;
+	char ch = 0;
+
+	reload->scheme = load_all_dbs(reload->dbs, reload->config,
+		reload->error);
+	faux_write_block(reload->notify_fd[1], &ch, sizeof(ch));
+
+	return NULL;
+}
+
+
+// Starts loading of scheme by helper thread. Config will be used by new
+// scheme.
+static bool_t reload_start(listener_t *listener, faux_eloop_t *eloop,
+	faux_ini_t *config)
+{
+	reload_t *reload = &listener->reload;
+	sigset_t all_sigs = {};
+	sigset_t saved_sigs = {};
+	int err = 0;
+
+	if (pipe2(reload->notify_fd, O_CLOEXEC) < 0) {
+		syslog(LOG_ERR, "Can't create pipe: %s", strerror(errno));
+		return BOOL_FALSE;
+	}
+	reload->dbs = faux_str_dup(listener->opts->dbs);
+	reload->config = config;
+	reload->scheme = NULL;
+	reload->error = faux_error_new();
+
+	// Signals are handled by listener's main thread
+	sigfillset(&all_sigs);
+	pthread_sigmask(SIG_SETMASK, &all_sigs, &saved_sigs);
+	scheme_loading = BOOL_TRUE;
+	err = pthread_create(&reload->tid, NULL, reload_thread, reload);
+	pthread_sigmask(SIG_SETMASK, &saved_sigs, NULL);
+	if (err != 0) {
+		syslog(LOG_ERR, "Can't create scheme loader thread: %s",
+			strerror(err));
+		scheme_loading = BOOL_FALSE;
+		close(reload->notify_fd[0]);
+		close(reload->notify_fd[1]);
+		faux_str_free(reload->dbs);
+		reload->dbs = NULL;
+		reload->config = NULL; // Caller frees config
+		faux_error_free(reload->error);
+		reload->error = NULL;
+		return BOOL_FALSE;
+	}
+	reload->active = BOOL_TRUE;
+	faux_eloop_add_fd(eloop, reload->notify_fd[0], POLLIN,
+		reload_done_ev, listener);
 
 	return BOOL_TRUE;
 }
 
 
-/** @brief Re-read config file.
+// Waits for loader thread. Results of loading are left within structure.
+static void reload_join(reload_t *reload)
+{
+	if (!reload->active)
+		return;
+
+	pthread_join(reload->tid, NULL);
+	scheme_loading = BOOL_FALSE;
+	reload->active = BOOL_FALSE;
+	close(reload->notify_fd[0]);
+	close(reload->notify_fd[1]);
+	faux_str_free(reload->dbs);
+	reload->dbs = NULL;
+}
+
+
+// Stops loading on exit. New scheme is dropped.
+static void reload_stop(reload_t *reload)
+{
+	if (!reload->active)
+		return;
+
+	reload_join(reload);
+	clear_scheme(reload->scheme, reload->error);
+	reload->scheme = NULL;
+	faux_ini_free(reload->config);
+	reload->config = NULL;
+	faux_error_free(reload->error);
+	reload->error = NULL;
+}
+
+
+/** @brief Re-read config file and reload scheme.
  *
- * This function can refresh klishd options but plugins (dbs for example) are
- * already inited and there is no way to re-init them on-the-fly.
+ * New scheme is loaded and prepared aside by helper thread so listener
+ * keeps serving new connections meanwhile. The running scheme is replaced
+ * on success only. Already running service processes keep their own copy
+ * of old scheme. Newly forked ones get the new scheme. Idle pool workers are
+ * replaced because they were forked with old scheme.
  */
 static bool_t refresh_config_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data)
 {
-	struct options *opts = (struct options *)user_data;
+	listener_t *listener = (listener_t *)user_data;
+	struct options *opts = listener->opts;
 	faux_ini_t *ini = NULL;
 
+	// Happy compiler
+	type = type;
+	associated_data = associated_data;
+
+	// Config will be re-read when current loading is done
+	if (listener->reload.active) {
+		syslog(LOG_INFO, "Scheme is loading now. Reload it again later");
+		listener->reload.again = BOOL_TRUE;
+		return BOOL_TRUE;
+	}
+
 	if (access(opts->cfgfile, R_OK) == 0) {
 		syslog(LOG_DEBUG, "Re-reading config file \"%s\"", opts->cfgfile);
-		if (!(ini = config_parse(opts->cfgfile, opts)))
+		if (!(ini = config_parse(opts->cfgfile, opts))) {
 			syslog(LOG_ERR, "Error while config file parsing");
+			return BOOL_TRUE;
+		}
 	} else if (opts->cfgfile_userdefined) {
 		syslog(LOG_ERR, "Can't find config file \"%s\"", opts->cfgfile);
+		return BOOL_TRUE;
 	}
-	faux_ini_free(ini); // No way to use it later
 
-	// Happy compiler
-	eloop = eloop;
-	type = type;
-	associated_data = associated_data;
+	// Threads use the scheme all the time
+	if (listener->threads) {
+		syslog(LOG_WARNING, "Scheme can't be reloaded in threaded mode");
+		faux_ini_free(ini);
+		return BOOL_TRUE;
+	}
+
+	// Load new scheme
+	syslog(LOG_INFO, "Reload scheme");
+	if (!reload_start(listener, eloop, ini)) {
+		syslog(LOG_ERR, "Can't reload scheme. Keep the old one");
+		faux_ini_free(ini);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Scheme loader thread is done. Replace scheme.
+ */
+static bool_t reload_done_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	listener_t *listener = (listener_t *)user_data;
+	reload_t *reload = &listener->reload;
+	bool_t replaced = BOOL_FALSE;
+
+	faux_eloop_del_fd(eloop, info->fd);
+	reload_join(reload);
+
+	if (!reload->scheme) {
+		faux_error_node_t *iter = faux_error_iter(reload->error);
+		const char *err = NULL;
+		while ((err = faux_error_each(&iter)))
+			syslog(LOG_ERR, "Scheme error: %s", err);
+		syslog(LOG_ERR, "Can't reload scheme. Keep the old one");
+		faux_ini_free(reload->config);
+	} else {
+		// Replace scheme
+		clear_scheme(listener->scheme, reload->error);
+		listener->scheme = reload->scheme;
+		faux_ini_free(listener->config);
+		listener->config = reload->config;
+		syslog(LOG_INFO, "Scheme was reloaded");
+		replaced = BOOL_TRUE;
+	}
+	reload->scheme = NULL;
+	reload->config = NULL;
+	faux_error_free(reload->error);
+	reload->error = NULL;
+
+	// Returns BOOL_FALSE within newly forked worker
+	if (replaced && listener->pool &&
+		!klishd_pool_recycle(listener->pool))
+		return BOOL_FALSE;
+
+	// SIGHUP was received while loading
+	if (reload->again) {
+		reload->again = BOOL_FALSE;
+		return refresh_config_ev(eloop, type, NULL, listener);
+	}
 
 	return BOOL_TRUE;
 }
@@ -578,7 +1014,7 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 
 	assert(user_data);
 
-	new_conn = accept(info->fd, NULL, NULL);
+	new_conn = accept4(info->fd, NULL, NULL, SOCK_CLOEXEC);
 	if (new_conn < 0) {
 		syslog(LOG_ERR, "Can't accept() new connection");
 		return BOOL_TRUE;
@@ -614,6 +1050,27 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
+/** @brief Listener asks idle pool worker to exit.
+ *
+ * Worker that has already accepted connection ignores request.
+ */
+static bool_t pool_recycle_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	service_t *service = (service_t *)user_data;
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	if (service->ktpd_session)
+		return BOOL_TRUE;
+
+	return BOOL_FALSE; // Stop Event Loop
+}
+
+
 static void signal_handler_empty(int signo)
 {
 	signo = signo; // Happy compiler
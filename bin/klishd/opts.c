@@ -42,6 +42,13 @@ struct options *opts_init(void)
 	opts->verbose = BOOL_FALSE;
 	opts->log_facility = LOG_DAEMON;
 	opts->dbs = faux_str_dup(DEFAULT_DBS);
+	opts->completion_timeout = DEFAULT_COMPLETION_TIMEOUT;
+	opts->completion_max = DEFAULT_COMPLETION_MAX;
+	opts->action_zygote = DEFAULT_ACTION_ZYGOTE;
+	opts->pool_min_idle = DEFAULT_POOL_MIN_IDLE;
+	opts->pool_max_idle = DEFAULT_POOL_MAX_IDLE;
+	opts->service_threads = DEFAULT_SERVICE_THREADS;
+	opts->deploy_db = NULL;
 
 	return opts;
 }
@@ -55,6 +62,7 @@ void opts_free(struct options *opts)
 	faux_str_free(opts->cfgfile);
 	faux_str_free(opts->unix_socket_path);
 	faux_str_free(opts->dbs);
+	faux_str_free(opts->deploy_db);
 	faux_free(opts);
 }
 
@@ -63,7 +71,7 @@ void opts_free(struct options *opts)
  */
 int opts_parse(int argc, char *argv[], struct options *opts)
 {
-	static const char *shortopts = "hp:f:dl:v";
+	static const char *shortopts = "hp:f:dl:vD:";
 	static const struct option longopts[] = {
 		{"help",		0, NULL, 'h'},
 		{"pid",			1, NULL, 'p'},
@@ -71,6 +79,7 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 		{"foreground",		0, NULL, 'd'},
 		{"verbose",		0, NULL, 'v'},
 		{"facility",		1, NULL, 'l'},
+		{"deploy",		1, NULL, 'D'},
 		{NULL,			0, NULL, 0}
 	};
 
@@ -103,6 +112,10 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 				_exit(-1);
 			}
 			break;
+		case 'D':
+			faux_str_free(opts->deploy_db);
+			opts->deploy_db = faux_str_dup(optarg);
+			break;
 		case 'h':
 			help(0, argv[0]);
 			_exit(0);
@@ -149,6 +162,8 @@ void help(int status, const char *argv0)
 		printf("\t-f <path>, --conf=<path> Config file ("
 			DEFAULT_CFGFILE ").\n");
 		printf("\t-l, --facility Syslog facility (DAEMON).\n");
+		printf("\t-D <db>, --deploy=<db> Load scheme, deploy it by "
+			"specified DB plugin and exit.\n");
 	}
 }
 
@@ -187,6 +202,58 @@ faux_ini_t *config_parse(const char *cfgfile, struct options *opts)
 		opts->dbs = faux_str_dup(tmp);
 	}
 
+	// Completion/help timeout
+	if ((tmp = faux_ini_find(ini, "CompletionTimeout"))) {
+		unsigned int timeout = 0;
+		if (faux_conv_atoui(tmp, &timeout, 10))
+			opts->completion_timeout = timeout;
+		else
+			syslog(LOG_ERR, "Illegal CompletionTimeout value: %s", tmp);
+	}
+
+	// Max number of completion items
+	if ((tmp = faux_ini_find(ini, "CompletionMaxCount"))) {
+		unsigned long max = 0;
+		if (faux_conv_atoul(tmp, &max, 10))
+			opts->completion_max = max;
+		else
+			syslog(LOG_ERR, "Illegal CompletionMaxCount value: %s", tmp);
+	}
+
+	// Spawn async ACTIONs by zygote process
+	if ((tmp = faux_ini_find(ini, "ActionZygote"))) {
+		bool_t zygote = BOOL_FALSE;
+		if (faux_conv_str2bool(tmp, &zygote))
+			opts->action_zygote = zygote;
+		else
+			syslog(LOG_ERR, "Illegal ActionZygote value: %s", tmp);
+	}
+
+	// Pool of pre-forked service processes
+	if ((tmp = faux_ini_find(ini, "PoolMinIdle"))) {
+		unsigned int num = 0;
+		if (faux_conv_atoui(tmp, &num, 10))
+			opts->pool_min_idle = num;
+		else
+			syslog(LOG_ERR, "Illegal PoolMinIdle value: %s", tmp);
+	}
+	if ((tmp = faux_ini_find(ini, "PoolMaxIdle"))) {
+		unsigned int num = 0;
+		if (faux_conv_atoui(tmp, &num, 10))
+			opts->pool_max_idle = num;
+		else
+			syslog(LOG_ERR, "Illegal PoolMaxIdle value: %s", tmp);
+	}
+
+	// Threads serving sessions within listener process
+	if ((tmp = faux_ini_find(ini, "ServiceThreads"))) {
+		unsigned int num = 0;
+		if (faux_conv_atoui(tmp, &num, 10))
+			opts->service_threads = num;
+		else
+			syslog(LOG_ERR, "Illegal ServiceThreads value: %s", tmp);
+	}
+
 	return ini;
 }
 
@@ -206,6 +273,12 @@ int opts_show(struct options *opts)
 	syslog(LOG_DEBUG, "opts: ConfigPath = %s\n", opts->cfgfile);
 	syslog(LOG_DEBUG, "opts: UnixSocketPath = %s\n", opts->unix_socket_path);
 	syslog(LOG_DEBUG, "opts: DBs = %s\n", opts->dbs);
+	syslog(LOG_DEBUG, "opts: CompletionTimeout = %u\n", opts->completion_timeout);
+	syslog(LOG_DEBUG, "opts: CompletionMaxCount = %zu\n", opts->completion_max);
+	syslog(LOG_DEBUG, "opts: ActionZygote = %s\n", opts->action_zygote ? "true" : "false");
+	syslog(LOG_DEBUG, "opts: PoolMinIdle = %u\n", opts->pool_min_idle);
+	syslog(LOG_DEBUG, "opts: PoolMaxIdle = %u\n", opts->pool_max_idle);
+	syslog(LOG_DEBUG, "opts: ServiceThreads = %u\n", opts->service_threads);
 
 	return 0;
 }
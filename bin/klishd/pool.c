@@ -0,0 +1,312 @@
+/*
+ * Pool of pre-forked service processes.
+ *
+ * Listener forks idle workers beforehand. Each worker prepares its own event
+ * loop and waits for new connection on the shared listen socket. The worker
+ * that wins accept() reports its PID to the listener by status pipe and
+ * becomes usual service process. Listener refills pool in background.
+ * Listen socket is non-blocking so losers of accept() race get EAGAIN and
+ * continue to wait.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+
+#include "private.h"
+
+
+struct klishd_pool_s {
+	int listen_fd;
+	int status_fd[2]; // Workers report accepted connections to listener
+	struct options *opts;
+	pid_t *idle; // PIDs of idle workers
+	size_t idle_num;
+	size_t idle_size;
+	bool_t worker; // Current process is forked worker
+};
+
+
+klishd_pool_t *klishd_pool_new(int listen_fd, struct options *opts)
+{
+	klishd_pool_t *pool = NULL;
+	int flags = 0;
+
+	assert(opts);
+	if (!opts)
+		return NULL;
+	if (listen_fd < 0)
+		return NULL;
+
+	// Workers compete for new connections
+	flags = fcntl(listen_fd, F_GETFL);
+	if ((flags < 0) ||
+		(fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+		syslog(LOG_ERR, "Can't set non-blocking listen socket: %s",
+			strerror(errno));
+		return NULL;
+	}
+
+	pool = faux_zmalloc(sizeof(*pool));
+	assert(pool);
+	if (!pool)
+		return NULL;
+
+	// Initialize
+	pool->listen_fd = listen_fd;
+	pool->opts = opts;
+	pool->idle = NULL;
+	pool->idle_num = 0;
+	pool->idle_size = 0;
+	pool->worker = BOOL_FALSE;
+	if (pipe2(pool->status_fd, O_CLOEXEC | O_NONBLOCK) < 0) {
+		syslog(LOG_ERR, "Can't create pool status pipe: %s",
+			strerror(errno));
+		faux_free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+
+/** @brief Asks idle workers to exit.
+ *
+ * Worker that has accepted connection but listener doesn't know it yet will
+ * ignore the signal.
+ */
+static void klishd_pool_stop_idle(klishd_pool_t *pool)
+{
+	size_t i = 0;
+
+	klishd_pool_read_status(pool);
+	for (i = 0; i < pool->idle_num; i++)
+		kill(pool->idle[i], KLISHD_POOL_RECYCLE_SIGNAL);
+	pool->idle_num = 0;
+}
+
+
+/** @brief Frees pool.
+ *
+ * Listener terminates idle workers. Busy workers serve their clients
+ * until the end of session.
+ */
+void klishd_pool_free(klishd_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	if (!pool->worker) {
+		klishd_pool_stop_idle(pool);
+	} else if (pool->listen_fd >= 0) {
+		close(pool->listen_fd);
+	}
+
+	if (pool->status_fd[0] >= 0)
+		close(pool->status_fd[0]);
+	if (pool->status_fd[1] >= 0)
+		close(pool->status_fd[1]);
+	faux_free(pool->idle);
+	faux_free(pool);
+}
+
+
+int klishd_pool_status_fd(const klishd_pool_t *pool)
+{
+	assert(pool);
+	if (!pool)
+		return -1;
+
+	return pool->status_fd[0];
+}
+
+
+bool_t klishd_pool_is_worker(const klishd_pool_t *pool)
+{
+	if (!pool)
+		return BOOL_FALSE;
+
+	return pool->worker;
+}
+
+
+static void klishd_pool_del_idle(klishd_pool_t *pool, pid_t pid)
+{
+	size_t i = 0;
+
+	for (i = 0; i < pool->idle_num; i++) {
+		if (pool->idle[i] != pid)
+			continue;
+		pool->idle[i] = pool->idle[--pool->idle_num];
+		return;
+	}
+}
+
+
+/** @brief Forks new idle workers.
+ *
+ * Pool is refilled up to PoolMaxIdle workers when number of idle workers
+ * falls below PoolMinIdle. At least one idle worker is always kept because
+ * nobody else accepts connections in pool mode.
+ *
+ * @return BOOL_FALSE within forked worker. So event callback can return
+ * this value to break listener's event loop.
+ */
+bool_t klishd_pool_refill(klishd_pool_t *pool)
+{
+	size_t min = 0;
+	size_t max = 0;
+
+	assert(pool);
+	if (!pool)
+		return BOOL_TRUE;
+	if (pool->worker)
+		return BOOL_FALSE;
+
+	min = pool->opts->pool_min_idle;
+	if (min < 1)
+		min = 1;
+	if (pool->idle_num >= min)
+		return BOOL_TRUE;
+	max = pool->opts->pool_max_idle;
+	if (max < min)
+		max = min;
+
+	while (pool->idle_num < max) {
+		pid_t pid = -1;
+
+		if (pool->idle_num >= pool->idle_size) {
+			pool->idle_size = max;
+			pool->idle = realloc(pool->idle,
+				pool->idle_size * sizeof(*pool->idle));
+			assert(pool->idle);
+		}
+
+		pid = fork();
+		if (pid < 0) {
+			syslog(LOG_ERR, "Can't fork pool worker: %s",
+				strerror(errno));
+			break;
+		}
+
+		// Worker
+		if (0 == pid) {
+			pool->worker = BOOL_TRUE;
+			pool->idle_num = 0;
+			close(pool->status_fd[0]);
+			pool->status_fd[0] = -1;
+			return BOOL_FALSE;
+		}
+
+		// Listener
+		pool->idle[pool->idle_num++] = pid;
+		syslog(LOG_DEBUG, "Pool worker was forked: %d", pid);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Replaces all idle workers by new ones.
+ *
+ * It's used when listener's scheme was changed.
+ *
+ * @return BOOL_FALSE within forked worker.
+ */
+bool_t klishd_pool_recycle(klishd_pool_t *pool)
+{
+	assert(pool);
+	if (!pool)
+		return BOOL_TRUE;
+	if (pool->worker)
+		return BOOL_FALSE;
+
+	klishd_pool_stop_idle(pool);
+
+	return klishd_pool_refill(pool);
+}
+
+
+/** @brief Gets PIDs of workers that have accepted connections.
+ */
+void klishd_pool_read_status(klishd_pool_t *pool)
+{
+	pid_t pids[64] = {};
+	ssize_t r = 0;
+
+	assert(pool);
+	if (!pool)
+		return;
+	if (pool->status_fd[0] < 0)
+		return;
+
+	// Writes of single PID are atomic so whole PIDs are read
+	while ((r = read(pool->status_fd[0], pids, sizeof(pids))) > 0) {
+		size_t i = 0;
+		for (i = 0; i < (r / sizeof(pids[0])); i++) {
+			klishd_pool_del_idle(pool, pids[i]);
+			syslog(LOG_INFO, "Service process for client: %d",
+				pids[i]);
+		}
+	}
+}
+
+
+/** @brief Forgets about terminated idle worker.
+ */
+void klishd_pool_exited(klishd_pool_t *pool, pid_t pid)
+{
+	if (!pool)
+		return;
+
+	klishd_pool_del_idle(pool, pid);
+}
+
+
+/** @brief Accepts new connection within worker.
+ *
+ * On success the worker doesn't belong to pool anymore. The listen socket
+ * is closed and listener is notified.
+ *
+ * @return Client's socket or < 0 if connection was taken by another worker.
+ */
+int klishd_pool_accept(klishd_pool_t *pool)
+{
+	int new_conn = -1;
+	pid_t pid = getpid();
+
+	assert(pool);
+	if (!pool || !pool->worker || (pool->listen_fd < 0))
+		return -1;
+
+	new_conn = accept4(pool->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (new_conn < 0) {
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+			(errno != EINTR) && (errno != ECONNABORTED))
+			syslog(LOG_ERR, "Can't accept() new connection: %s",
+				strerror(errno));
+		return -1;
+	}
+
+	if (write(pool->status_fd[1], &pid, sizeof(pid)) != sizeof(pid))
+		syslog(LOG_WARNING, "Can't notify listener about connection");
+	close(pool->status_fd[1]);
+	pool->status_fd[1] = -1;
+	close(pool->listen_fd);
+	pool->listen_fd = -1;
+
+	return new_conn;
+}
@@ -3,12 +3,20 @@
 #endif
 
 #include <faux/ini.h>
+#include <klish/kscheme.h>
+#include <klish/ktp_session.h>
 
 #define LOG_NAME "klishd-listen"
 #define LOG_SERVICE_NAME "klishd"
 #define DEFAULT_PIDFILE "/var/run/klishd.pid"
 #define DEFAULT_CFGFILE "/etc/klish/klishd.conf"
 #define DEFAULT_DBS "libxml2"
+#define DEFAULT_COMPLETION_TIMEOUT 0 // Unlimited
+#define DEFAULT_COMPLETION_MAX 10000
+#define DEFAULT_ACTION_ZYGOTE BOOL_FALSE
+#define DEFAULT_POOL_MIN_IDLE 0 // Fork service process on accept()
+#define DEFAULT_POOL_MAX_IDLE 0
+#define DEFAULT_SERVICE_THREADS 0 // Process per session
 
 
 /** @brief Command line and config file options
@@ -22,6 +30,13 @@ struct options {
 	bool_t foreground; // Don't daemonize
 	bool_t verbose;
 	int log_facility;
+	unsigned int completion_timeout; // ms
+	size_t completion_max;
+	bool_t action_zygote; // Spawn async ACTIONs by zygote process
+	unsigned int pool_min_idle; // Pre-forked service processes
+	unsigned int pool_max_idle;
+	unsigned int service_threads; // Threads serving sessions in listener
+	char *deploy_db; // Deploy scheme by this DB plugin and exit
 };
 
 // Options and config file
@@ -31,3 +46,30 @@ void opts_free(struct options *opts);
 int opts_parse(int argc, char *argv[], struct options *opts);
 int opts_show(struct options *opts);
 faux_ini_t *config_parse(const char *cfgfile, struct options *opts);
+
+// Service session
+ktpd_session_t *service_session_new(int client_fd, kscheme_t *scheme,
+	const struct options *opts, faux_eloop_t *eloop);
+
+// Pool of pre-forked service processes
+typedef struct klishd_pool_s klishd_pool_t;
+
+// Idle worker exits on this signal. Busy one ignores it.
+#define KLISHD_POOL_RECYCLE_SIGNAL SIGUSR1
+
+klishd_pool_t *klishd_pool_new(int listen_fd, struct options *opts);
+void klishd_pool_free(klishd_pool_t *pool);
+int klishd_pool_status_fd(const klishd_pool_t *pool);
+bool_t klishd_pool_is_worker(const klishd_pool_t *pool);
+bool_t klishd_pool_refill(klishd_pool_t *pool);
+bool_t klishd_pool_recycle(klishd_pool_t *pool);
+void klishd_pool_read_status(klishd_pool_t *pool);
+void klishd_pool_exited(klishd_pool_t *pool, pid_t pid);
+int klishd_pool_accept(klishd_pool_t *pool);
+
+// Threads serving sessions within listener process
+typedef struct klishd_threads_s klishd_threads_t;
+
+klishd_threads_t *klishd_threads_new(int listen_fd, kscheme_t *scheme,
+	const struct options *opts);
+void klishd_threads_free(klishd_threads_t *threads);
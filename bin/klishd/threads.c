@@ -0,0 +1,293 @@
+/*
+ * Threaded service mode.
+ *
+ * Listener process serves sessions itself. It starts a number of threads
+ * and each thread has its own event loop with many KTP sessions. Threads
+ * accept() new connections on the shared (non-blocking) listen socket. The
+ * scheme is shared and it's not changed while working. Mutable state
+ * (path, ustore, caches) belongs to session. Plugin code that is not
+ * thread-safe is serialized by kplugin_lock(). ACTIONs are still forked by
+ * kexec.
+ *
+ * Signals are process-wide so threads block all of them and listener's
+ * main thread handles signals. ACTION processes are watched by pidfds
+ * within thread's event loop. So nobody must call waitpid(-1).
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include <faux/faux.h>
+#include <faux/list.h>
+#include <faux/eloop.h>
+
+#include <klish/ktp_session.h>
+
+#include "private.h"
+
+
+typedef struct {
+	pthread_t tid;
+	bool_t started;
+	faux_eloop_t *eloop;
+	int wake_fd[2]; // Listener closes write end to stop thread
+	faux_list_t *sessions; // ktpd_session_t
+	bool_t stop;
+	klishd_threads_t *threads;
+} klishd_thread_t;
+
+
+struct klishd_threads_s {
+	int listen_fd;
+	kscheme_t *scheme;
+	const struct options *opts;
+	klishd_thread_t *thread;
+	size_t num;
+};
+
+
+static bool_t thread_accept_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	klishd_thread_t *thread = (klishd_thread_t *)user_data;
+	klishd_threads_t *threads = thread->threads;
+	ktpd_session_t *ktpd_session = NULL;
+	int new_conn = -1;
+
+	new_conn = accept4(info->fd, NULL, NULL, SOCK_CLOEXEC);
+	if (new_conn < 0) {
+		// Connection was taken by another thread
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+			(errno != EINTR) && (errno != ECONNABORTED))
+			syslog(LOG_ERR, "Can't accept() new connection: %s",
+				strerror(errno));
+		return BOOL_TRUE;
+	}
+
+	ktpd_session = service_session_new(new_conn, threads->scheme,
+		threads->opts, eloop);
+	if (!ktpd_session) {
+		close(new_conn);
+		return BOOL_TRUE;
+	}
+	// SIGCHLD can't be routed to the thread that owns the process.
+	// Threads rely on pidfds.
+	faux_eloop_del_signal(eloop, SIGCHLD);
+	faux_list_add(thread->sessions, ktpd_session);
+
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t thread_wake_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	klishd_thread_t *thread = (klishd_thread_t *)user_data;
+
+	thread->stop = BOOL_TRUE;
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_FALSE; // Stop Event Loop
+}
+
+
+// Session stops event loop when it's finished. Other sessions continue
+// within the same loop.
+static void thread_free_done_sessions(klishd_thread_t *thread)
+{
+	faux_list_node_t *iter = faux_list_head(thread->sessions);
+
+	while (iter) {
+		faux_list_node_t *node = iter;
+		ktpd_session_t *ktpd_session = faux_list_data(node);
+
+		iter = faux_list_next_node(iter);
+		if (!ktpd_session_done(ktpd_session))
+			continue;
+		syslog(LOG_DEBUG, "Close connection %d",
+			ktpd_session_fd(ktpd_session));
+		faux_list_del(thread->sessions, node);
+	}
+}
+
+
+static void *thread_main(void *arg)
+{
+	klishd_thread_t *thread = (klishd_thread_t *)arg;
+
+	while (!thread->stop) {
+		faux_eloop_loop(thread->eloop);
+		thread_free_done_sessions(thread);
+	}
+
+	return NULL;
+}
+
+
+static void thread_free(klishd_thread_t *thread)
+{
+	// Sessions use event loop so free them first
+	faux_list_free(thread->sessions);
+	faux_eloop_free(thread->eloop);
+	if (thread->wake_fd[0] >= 0)
+		close(thread->wake_fd[0]);
+	if (thread->wake_fd[1] >= 0)
+		close(thread->wake_fd[1]);
+}
+
+
+static bool_t thread_init(klishd_threads_t *threads, klishd_thread_t *thread)
+{
+	thread->threads = threads;
+	thread->started = BOOL_FALSE;
+	thread->stop = BOOL_FALSE;
+	thread->wake_fd[0] = -1;
+	thread->wake_fd[1] = -1;
+	thread->sessions = faux_list_new(FAUX_LIST_UNSORTED,
+		FAUX_LIST_NONUNIQUE, NULL, NULL,
+		(void (*)(void *))ktpd_session_free);
+	assert(thread->sessions);
+	thread->eloop = faux_eloop_new(NULL);
+	assert(thread->eloop);
+	if (pipe2(thread->wake_fd, O_CLOEXEC) < 0)
+		return BOOL_FALSE;
+
+	faux_eloop_add_fd(thread->eloop, threads->listen_fd, POLLIN,
+		thread_accept_ev, thread);
+	faux_eloop_add_fd(thread->eloop, thread->wake_fd[0], POLLIN,
+		thread_wake_ev, thread);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Starts service threads.
+ *
+ * Threads are created with all signals blocked.
+ */
+klishd_threads_t *klishd_threads_new(int listen_fd, kscheme_t *scheme,
+	const struct options *opts)
+{
+	klishd_threads_t *threads = NULL;
+	sigset_t all_sigs = {};
+	sigset_t saved_sigs = {};
+	int flags = 0;
+	int pidfd = -1;
+	size_t i = 0;
+
+	assert(scheme);
+	if (!scheme)
+		return NULL;
+	assert(opts);
+	if (!opts)
+		return NULL;
+	if ((listen_fd < 0) || (0 == opts->service_threads))
+		return NULL;
+
+	// Processes can't be waited for by SIGCHLD within threads
+	pidfd = syscall(SYS_pidfd_open, getpid(), 0);
+	if (pidfd < 0) {
+		syslog(LOG_ERR, "Threaded mode needs pidfd support: %s",
+			strerror(errno));
+		return NULL;
+	}
+	close(pidfd);
+
+	// Threads compete for new connections
+	flags = fcntl(listen_fd, F_GETFL);
+	if ((flags < 0) ||
+		(fcntl(listen_fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+		syslog(LOG_ERR, "Can't set non-blocking listen socket: %s",
+			strerror(errno));
+		return NULL;
+	}
+
+	threads = faux_zmalloc(sizeof(*threads));
+	assert(threads);
+	if (!threads)
+		return NULL;
+
+	// Initialize
+	threads->listen_fd = listen_fd;
+	threads->scheme = scheme;
+	threads->opts = opts;
+	threads->num = opts->service_threads;
+	threads->thread = faux_zmalloc(threads->num * sizeof(*threads->thread));
+	assert(threads->thread);
+
+	sigfillset(&all_sigs);
+	pthread_sigmask(SIG_SETMASK, &all_sigs, &saved_sigs);
+	for (i = 0; i < threads->num; i++) {
+		klishd_thread_t *thread = &threads->thread[i];
+		int err = 0;
+		if (!thread_init(threads, thread)) {
+			syslog(LOG_ERR, "Can't init service thread");
+			break;
+		}
+		err = pthread_create(&thread->tid, NULL, thread_main, thread);
+		if (err != 0) {
+			syslog(LOG_ERR, "Can't create service thread: %s",
+				strerror(err));
+			break;
+		}
+		thread->started = BOOL_TRUE;
+	}
+	pthread_sigmask(SIG_SETMASK, &saved_sigs, NULL);
+
+	if (i < threads->num) {
+		threads->num = i + 1; // Including failed one
+		klishd_threads_free(threads);
+		return NULL;
+	}
+	syslog(LOG_INFO, "Service threads are started: %zu", threads->num);
+
+	return threads;
+}
+
+
+/** @brief Stops service threads.
+ *
+ * Running sessions are closed.
+ */
+void klishd_threads_free(klishd_threads_t *threads)
+{
+	size_t i = 0;
+
+	if (!threads)
+		return;
+
+	for (i = 0; i < threads->num; i++) {
+		klishd_thread_t *thread = &threads->thread[i];
+		if (!thread->started)
+			continue;
+		close(thread->wake_fd[1]);
+		thread->wake_fd[1] = -1;
+		pthread_join(thread->tid, NULL);
+	}
+	for (i = 0; i < threads->num; i++)
+		thread_free(&threads->thread[i]);
+
+	faux_free(threads->thread);
+	faux_free(threads);
+}
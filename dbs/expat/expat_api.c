@@ -25,6 +25,7 @@
 #include "config.h"
 #endif
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -332,7 +333,26 @@ bool_t kxml_doc_stop(void)
 }
 
 
-kxml_doc_t *kxml_doc_read(const char *filename)
+// Parser object is created for each document so different documents can
+// be parsed by different threads.
+bool_t kxml_doc_is_thread_safe(void)
+{
+	return BOOL_TRUE;
+}
+
+
+static void kexpat_set_err(kxml_err_t *err, int line, int col,
+	const char *msg)
+{
+	if (!err)
+		return;
+	err->line = line;
+	err->col = col;
+	snprintf(err->msg, sizeof(err->msg), "%s", msg ? msg : "");
+}
+
+
+kxml_doc_t *kxml_doc_read(const char *filename, kxml_err_t *err)
 {
 	kxml_doc_t *doc = NULL;
 	struct stat sb = {};
@@ -347,8 +367,10 @@ kxml_doc_t *kxml_doc_read(const char *filename)
 	memset(doc, 0, sizeof(kxml_doc_t));
 	doc->filename = strdup(filename);
 	parser = XML_ParserCreate(NULL);
-	if (!parser)
+	if (!parser) {
+		kexpat_set_err(err, -1, -1, "Can't create parser");
 		goto error_parser_create;
+	}
 	XML_SetUserData(parser, doc);
 	XML_SetCharacterDataHandler(parser, kexpat_chardata_handler);
 	XML_SetElementHandler(parser,
@@ -356,20 +378,28 @@ kxml_doc_t *kxml_doc_read(const char *filename)
 		kexpat_element_end);
 
 	fd = open(filename, O_RDONLY);
-	if (fd < 0)
+	if (fd < 0) {
+		kexpat_set_err(err, -1, -1, strerror(errno));
 		goto error_open;
+	}
 	fstat(fd, &sb);
 	buffer = malloc(sb.st_size+1);
 	rb = read(fd, buffer, sb.st_size);
 	if (rb < 0) {
+		kexpat_set_err(err, -1, -1, strerror(errno));
 		close(fd);
 		goto error_parse;
 	}
 	buffer[sb.st_size] = 0;
 	close(fd);
 
-	if (!XML_Parse(parser, buffer, sb.st_size, 1))
+	if (!XML_Parse(parser, buffer, sb.st_size, 1)) {
+		kexpat_set_err(err,
+			(int)XML_GetCurrentLineNumber(parser),
+			(int)XML_GetCurrentColumnNumber(parser) + 1,
+			XML_ErrorString(XML_GetErrorCode(parser)));
 		goto error_parse;
+	}
 
 	XML_ParserFree(parser);
 	free(buffer);
@@ -410,35 +440,6 @@ bool_t kxml_doc_is_valid(const kxml_doc_t *doc)
 	return (bool_t)(doc && doc->root);
 }
 
-/*
-int kxml_doc_error_caps(kxml_doc_t *doc)
-{
-	doc = doc; // Happy compiler
-
-	return kxml_ERR_NOCAPS;
-}
-
-int kxml_doc_get_err_line(kxml_doc_t *doc)
-{
-	doc = doc; // Happy compiler
-
-	return -1;
-}
-
-int kxml_doc_get_err_col(kxml_doc_t *doc)
-{
-	doc = doc; // Happy compiler
-
-	return -1;
-}
-
-const char *kxml_doc_get_err_msg(kxml_doc_t *doc)
-{
-	doc = doc; // Happy compiler
-
-	return "";
-}
-*/
 
 kxml_nodetype_e kxml_node_type(const kxml_node_t *node)
 {
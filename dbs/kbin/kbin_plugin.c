@@ -0,0 +1,878 @@
+/*
+ * Binary scheme image.
+ *
+ * Deploy function serializes prepared scheme to the binary image. Load
+ * function maps image read-only and creates scheme objects directly from
+ * typed records. There is no text parsing while loading. Image contains
+ * header, records and string table. All references within image are
+ * offsets from the beginning of image so image can be mapped to any
+ * address. Numbers have native byte order so image can't be moved to
+ * another architecture. It's not a problem because image is deployed on
+ * the same host usually.
+ *
+ * Image layout:
+ * [header][records (PLUGINs, ENTRYs, ACTIONs, HOTKEYs)][string table]
+ *
+ * String table begins with '\0' so zero string offset means NULL.
+ * ENTRY record is always placed before its nested records. So loader
+ * can easily detect loops within broken image.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/error.h>
+#include <klish/kscheme.h>
+#include <klish/kdb.h>
+
+#define TAG "KBIN"
+
+#define KBIN_DEFAULT_PATH "/etc/klish/scheme.kbin"
+#define KBIN_MAGIC "KLISHBIN"
+#define KBIN_VERSION 1
+#define KBIN_BYTE_ORDER 0x01020304
+#define KBIN_UNBOUNDED UINT32_MAX // KENTRY_OCCURS_UNBOUNDED
+
+
+uint8_t kdb_kbin_major = KDB_MAJOR;
+uint8_t kdb_kbin_minor = KDB_MINOR;
+
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t size; // Whole image size
+	uint32_t plugins_num;
+	uint32_t plugins_off; // Array of kbin_plugin_t
+	uint32_t entrys_num;
+	uint32_t entrys_off; // Array of offsets of top level kbin_entry_t
+	uint32_t strings_off;
+	uint32_t strings_size;
+} kbin_header_t;
+
+typedef struct {
+	uint32_t name;
+	uint32_t id;
+	uint32_t file;
+	uint32_t conf;
+} kbin_plugin_t;
+
+typedef struct {
+	uint32_t name;
+	uint32_t help;
+	uint32_t ref;
+	uint32_t value;
+	uint32_t min;
+	uint32_t max;
+	uint32_t cache_ttl;
+	uint32_t timeout;
+	uint32_t entrys_num;
+	uint32_t entrys_off; // Array of offsets of nested kbin_entry_t
+	uint32_t actions_num;
+	uint32_t actions_off; // Array of kbin_action_t
+	uint32_t hotkeys_num;
+	uint32_t hotkeys_off; // Array of kbin_hotkey_t
+	uint8_t link; // Link has name, help and ref only
+	uint8_t container;
+	uint8_t mode;
+	uint8_t purpose;
+	uint8_t restore;
+	uint8_t order;
+	uint8_t filter;
+	uint8_t cache;
+} kbin_entry_t;
+
+typedef struct {
+	uint32_t sym_ref;
+	uint32_t lock;
+	uint32_t script;
+	uint8_t interrupt;
+	uint8_t in;
+	uint8_t out;
+	uint8_t exec_on;
+	uint8_t update_retcode;
+	int8_t permanent;
+	int8_t sync;
+	uint8_t reserved;
+} kbin_action_t;
+
+typedef struct {
+	uint32_t key;
+	uint32_t cmd;
+} kbin_hotkey_t;
+
+
+/*
+ * Deploy
+ */
+
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+} kbin_buf_t;
+
+typedef struct {
+	kbin_buf_t rec;
+	kbin_buf_t str;
+	uint32_t *hash; // Offsets of unique strings. Zero is empty slot
+	size_t hash_size;
+	size_t hash_num;
+	bool_t overflow; // Image doesn't fit 32-bit offsets
+} kbin_writer_t;
+
+
+// Reserves zeroed space aligned to 4 bytes
+static uint32_t kbin_buf_reserve(kbin_writer_t *w, kbin_buf_t *buf,
+	size_t len)
+{
+	size_t off = (buf->len + 3) & ~(size_t)3;
+
+	if ((off + len) > UINT32_MAX) {
+		w->overflow = BOOL_TRUE;
+		return 0;
+	}
+	if ((off + len) > buf->size) {
+		size_t size = buf->size ? buf->size : 4096;
+		while (size < (off + len))
+			size *= 2;
+		buf->data = realloc(buf->data, size);
+		assert(buf->data);
+		memset(buf->data + buf->size, 0, size - buf->size);
+		buf->size = size;
+	}
+	buf->len = off + len;
+
+	return (uint32_t)off;
+}
+
+
+static uint32_t kbin_put(kbin_writer_t *w, const void *data, size_t len)
+{
+	uint32_t off = kbin_buf_reserve(w, &w->rec, len);
+
+	if (w->overflow)
+		return 0;
+	memcpy(w->rec.data + off, data, len);
+
+	return off;
+}
+
+
+static size_t kbin_hash(const char *str)
+{
+	size_t h = 2166136261u;
+
+	while (*str)
+		h = (h ^ (unsigned char)*str++) * 16777619u;
+
+	return h;
+}
+
+
+// Strings are deduplicated. Names like "view" or "action" are repeated
+// many times within the scheme.
+static uint32_t kbin_str(kbin_writer_t *w, const char *str)
+{
+	size_t i = 0;
+	size_t len = 0;
+	uint32_t off = 0;
+
+	if (faux_str_is_empty(str))
+		return 0;
+
+	// Grow hash table
+	if ((w->hash_num * 2) >= w->hash_size) {
+		uint32_t *old = w->hash;
+		size_t old_size = w->hash_size;
+		w->hash_size = old_size ? (old_size * 2) : 1024;
+		w->hash = faux_zmalloc(w->hash_size * sizeof(*w->hash));
+		assert(w->hash);
+		for (i = 0; i < old_size; i++) {
+			size_t j = 0;
+			if (0 == old[i])
+				continue;
+			j = kbin_hash(w->str.data + old[i]) & (w->hash_size - 1);
+			while (w->hash[j] != 0)
+				j = (j + 1) & (w->hash_size - 1);
+			w->hash[j] = old[i];
+		}
+		faux_free(old);
+	}
+
+	i = kbin_hash(str) & (w->hash_size - 1);
+	while (w->hash[i] != 0) {
+		if (strcmp(w->str.data + w->hash[i], str) == 0)
+			return w->hash[i];
+		i = (i + 1) & (w->hash_size - 1);
+	}
+
+	len = strlen(str) + 1;
+	if ((w->str.len + len) > UINT32_MAX) {
+		w->overflow = BOOL_TRUE;
+		return 0;
+	}
+	// Strings are not aligned
+	if ((w->str.len + len) > w->str.size) {
+		size_t size = w->str.size ? w->str.size : 4096;
+		while (size < (w->str.len + len))
+			size *= 2;
+		w->str.data = realloc(w->str.data, size);
+		assert(w->str.data);
+		w->str.size = size;
+	}
+	off = (uint32_t)w->str.len;
+	memcpy(w->str.data + off, str, len);
+	w->str.len += len;
+	w->hash[i] = off;
+	w->hash_num++;
+
+	return off;
+}
+
+
+static uint32_t kbin_write_entry(kbin_writer_t *w, const kentry_t *kentry)
+{
+	kbin_entry_t e = {};
+	uint32_t off = 0;
+	ssize_t num = 0;
+
+	off = kbin_buf_reserve(w, &w->rec, sizeof(e));
+	if (w->overflow)
+		return 0;
+
+	e.name = kbin_str(w, kentry_name(kentry));
+	e.help = kbin_str(w, kentry_help(kentry));
+	e.ref = kbin_str(w, kentry_ref_str(kentry));
+
+	// Links (ENTRY with 'ref' attribute) doesn't need the following fields
+	// that will be replaced by content of referenced ENTRY
+	if (e.ref != 0) {
+		e.link = 1;
+		memcpy(w->rec.data + off, &e, sizeof(e));
+		return off;
+	}
+
+	e.container = kentry_container(kentry);
+	e.mode = kentry_mode(kentry);
+	e.purpose = kentry_purpose(kentry);
+	e.min = kentry_min(kentry);
+	if (kentry_max(kentry) == (size_t)KENTRY_OCCURS_UNBOUNDED)
+		e.max = KBIN_UNBOUNDED;
+	else
+		e.max = kentry_max(kentry);
+	e.value = kbin_str(w, kentry_value(kentry));
+	e.restore = kentry_restore(kentry);
+	e.order = kentry_order(kentry);
+	e.filter = kentry_filter(kentry);
+	e.cache = kentry_cache(kentry);
+	e.cache_ttl = kentry_cache_ttl(kentry);
+	e.timeout = kentry_timeout(kentry);
+
+	// ENTRY list. Nested records are written before list of its offsets.
+	num = kentry_entrys_len(kentry);
+	if (num > 0) {
+		kentry_entrys_node_t *iter = kentry_entrys_iter(kentry);
+		kentry_t *nentry = NULL;
+		uint32_t *offs = faux_zmalloc(num * sizeof(*offs));
+		assert(offs);
+		while ((nentry = kentry_entrys_each(&iter)))
+			offs[e.entrys_num++] = kbin_write_entry(w, nentry);
+		e.entrys_off = kbin_put(w, offs, e.entrys_num * sizeof(*offs));
+		faux_free(offs);
+	}
+
+	// ACTION list
+	num = kentry_actions_len(kentry);
+	if (num > 0) {
+		kentry_actions_node_t *iter = kentry_actions_iter(kentry);
+		kaction_t *kaction = NULL;
+		e.actions_off = kbin_buf_reserve(w, &w->rec,
+			num * sizeof(kbin_action_t));
+		while (!w->overflow && (kaction = kentry_actions_each(&iter))) {
+			kbin_action_t a = {};
+			a.sym_ref = kbin_str(w, kaction_sym_ref(kaction));
+			a.lock = kbin_str(w, kaction_lock(kaction));
+			a.script = kbin_str(w, kaction_script(kaction));
+			a.interrupt = kaction_interrupt(kaction);
+			a.in = kaction_in(kaction);
+			a.out = kaction_out(kaction);
+			a.exec_on = kaction_exec_on(kaction);
+			a.update_retcode = kaction_update_retcode(kaction);
+			a.permanent = kaction_permanent(kaction);
+			a.sync = kaction_sync(kaction);
+			memcpy(w->rec.data + e.actions_off +
+				e.actions_num * sizeof(a), &a, sizeof(a));
+			e.actions_num++;
+		}
+	}
+
+	// HOTKEY list
+	num = kentry_hotkeys_len(kentry);
+	if (num > 0) {
+		kentry_hotkeys_node_t *iter = kentry_hotkeys_iter(kentry);
+		khotkey_t *khotkey = NULL;
+		e.hotkeys_off = kbin_buf_reserve(w, &w->rec,
+			num * sizeof(kbin_hotkey_t));
+		while (!w->overflow && (khotkey = kentry_hotkeys_each(&iter))) {
+			kbin_hotkey_t h = {};
+			h.key = kbin_str(w, khotkey_key(khotkey));
+			h.cmd = kbin_str(w, khotkey_cmd(khotkey));
+			memcpy(w->rec.data + e.hotkeys_off +
+				e.hotkeys_num * sizeof(h), &h, sizeof(h));
+			e.hotkeys_num++;
+		}
+	}
+
+	if (w->overflow)
+		return 0;
+	memcpy(w->rec.data + off, &e, sizeof(e));
+
+	return off;
+}
+
+
+static bool_t kbin_write_scheme(kbin_writer_t *w, const kscheme_t *scheme)
+{
+	kbin_header_t hdr = {};
+	kscheme_plugins_node_t *plugins_iter = NULL;
+	kscheme_entrys_node_t *entrys_iter = NULL;
+	kplugin_t *kplugin = NULL;
+	kentry_t *kentry = NULL;
+	uint32_t *offs = NULL;
+	size_t num = 0;
+
+	// Header is filled at the end
+	kbin_buf_reserve(w, &w->rec, sizeof(hdr));
+	// Zero offset within string table is NULL
+	kbin_buf_reserve(w, &w->str, 1);
+
+	// PLUGIN list
+	plugins_iter = kscheme_plugins_iter(scheme);
+	while ((kplugin = kscheme_plugins_each(&plugins_iter))) {
+		kbin_plugin_t p = {};
+		p.name = kbin_str(w, kplugin_name(kplugin));
+		p.id = kbin_str(w, kplugin_id(kplugin));
+		p.file = kbin_str(w, kplugin_file(kplugin));
+		p.conf = kbin_str(w, kplugin_conf(kplugin));
+		if (0 == hdr.plugins_num)
+			hdr.plugins_off = kbin_put(w, &p, sizeof(p));
+		else
+			kbin_put(w, &p, sizeof(p));
+		hdr.plugins_num++;
+	}
+
+	// ENTRY list
+	entrys_iter = kscheme_entrys_iter(scheme);
+	while ((kentry = kscheme_entrys_each(&entrys_iter))) {
+		if (num <= hdr.entrys_num) {
+			num = num ? (num * 2) : 64;
+			offs = realloc(offs, num * sizeof(*offs));
+			assert(offs);
+		}
+		offs[hdr.entrys_num++] = kbin_write_entry(w, kentry);
+	}
+	if (hdr.entrys_num > 0)
+		hdr.entrys_off = kbin_put(w, offs,
+			hdr.entrys_num * sizeof(*offs));
+	faux_free(offs);
+
+	// String table
+	hdr.strings_off = kbin_buf_reserve(w, &w->rec, 0);
+	hdr.strings_size = w->str.len;
+	if (w->overflow || ((hdr.strings_off + w->str.len) > UINT32_MAX))
+		return BOOL_FALSE;
+
+	memcpy(hdr.magic, KBIN_MAGIC, sizeof(hdr.magic));
+	hdr.version = KBIN_VERSION;
+	hdr.byte_order = KBIN_BYTE_ORDER;
+	hdr.size = hdr.strings_off + hdr.strings_size;
+	memcpy(w->rec.data, &hdr, sizeof(hdr));
+
+	return BOOL_TRUE;
+}
+
+
+bool_t kdb_kbin_deploy_scheme(kdb_t *db, const kscheme_t *scheme)
+{
+	faux_ini_t *ini = NULL;
+	faux_error_t *error = NULL;
+	const char *out_path = NULL;
+	char *tmp_path = NULL;
+	kbin_writer_t w = {};
+	int f = -1;
+	bool_t retcode = BOOL_FALSE;
+
+	assert(db);
+	if (!db)
+		return BOOL_FALSE;
+	assert(scheme);
+	if (!scheme)
+		return BOOL_FALSE;
+
+	// Get configuration info from kdb object
+	ini = kdb_ini(db);
+	if (ini)
+		out_path = faux_ini_find(ini, "DeployPath");
+	error = kdb_error(db);
+
+	if (!kbin_write_scheme(&w, scheme)) {
+		faux_error_add(error, TAG": Scheme is too large for image");
+		goto err;
+	}
+
+	// Running klishd can load image at the same time. So new image is
+	// written to temporary file and then atomically replaces old one.
+	if (out_path) {
+		tmp_path = faux_str_sprintf("%s.XXXXXX", out_path);
+		f = mkstemp(tmp_path);
+	} else {
+		f = STDOUT_FILENO;
+	}
+	if (f < 0) {
+		faux_error_sprintf(error, TAG": Can't create file for %s: %s",
+			out_path, strerror(errno));
+		goto err;
+	}
+	if ((faux_write_block(f, w.rec.data, w.rec.len) < 0) ||
+		(faux_write_block(f, w.str.data, w.str.len) < 0)) {
+		faux_error_sprintf(error, TAG": Can't write image: %s",
+			strerror(errno));
+		goto err;
+	}
+	if (out_path) {
+		fchmod(f, 00644);
+		close(f);
+		f = -1;
+		if (rename(tmp_path, out_path) < 0) {
+			faux_error_sprintf(error, TAG": Can't create %s: %s",
+				out_path, strerror(errno));
+			goto err;
+		}
+		faux_str_free(tmp_path);
+		tmp_path = NULL;
+	}
+
+	retcode = BOOL_TRUE;
+err:
+	if (out_path && (f >= 0))
+		close(f);
+	if (tmp_path) {
+		unlink(tmp_path);
+		faux_str_free(tmp_path);
+	}
+	faux_free(w.rec.data);
+	faux_free(w.str.data);
+	faux_free(w.hash);
+
+	return retcode;
+}
+
+
+/*
+ * Load
+ */
+
+typedef struct {
+	const char *data;
+	size_t size;
+	const kbin_header_t *hdr;
+	const char *strings;
+	faux_error_t *error;
+} kbin_image_t;
+
+
+// Gets pointer to array of records. Records can't overlap header and
+// string table.
+static const void *kbin_rec(const kbin_image_t *img, uint32_t off,
+	uint32_t num, size_t rec_size)
+{
+	if (0 == num)
+		return NULL;
+	if ((off < sizeof(kbin_header_t)) || (off % 4) ||
+		(off > img->hdr->strings_off))
+		return NULL;
+	if (num > ((img->hdr->strings_off - off) / rec_size))
+		return NULL;
+
+	return img->data + off;
+}
+
+
+static bool_t kbin_get_str(const kbin_image_t *img, uint32_t off,
+	const char **str)
+{
+	if (off >= img->hdr->strings_size)
+		return BOOL_FALSE;
+	*str = (0 == off) ? NULL : (img->strings + off);
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t kbin_check_header(const kbin_image_t *img)
+{
+	const kbin_header_t *hdr = img->hdr;
+
+	if (img->size < sizeof(*hdr)) {
+		faux_error_add(img->error, TAG": Image is too short");
+		return BOOL_FALSE;
+	}
+	if (memcmp(hdr->magic, KBIN_MAGIC, sizeof(hdr->magic)) != 0) {
+		faux_error_add(img->error, TAG": It's not a klish scheme image");
+		return BOOL_FALSE;
+	}
+	if (hdr->byte_order != KBIN_BYTE_ORDER) {
+		faux_error_add(img->error, TAG": Image has foreign byte order");
+		return BOOL_FALSE;
+	}
+	if (hdr->version != KBIN_VERSION) {
+		faux_error_sprintf(img->error,
+			TAG": Image version is %u, need %u",
+			hdr->version, KBIN_VERSION);
+		return BOOL_FALSE;
+	}
+	if ((hdr->size != img->size) ||
+		(hdr->strings_off < sizeof(*hdr)) ||
+		(hdr->strings_off > hdr->size) ||
+		(hdr->strings_size != (hdr->size - hdr->strings_off)) ||
+		(0 == hdr->strings_size) ||
+		(img->data[hdr->size - 1] != '\0')) {
+		faux_error_add(img->error, TAG": Image is broken");
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static kaction_t *kbin_load_action(const kbin_image_t *img,
+	const kbin_action_t *a)
+{
+	kaction_t *kaction = NULL;
+	const char *sym_ref = NULL;
+	const char *lock = NULL;
+	const char *script = NULL;
+
+	if (!kbin_get_str(img, a->sym_ref, &sym_ref) ||
+		!kbin_get_str(img, a->lock, &lock) ||
+		!kbin_get_str(img, a->script, &script))
+		return NULL;
+
+	kaction = kaction_new();
+	if (!kaction)
+		return NULL;
+	if ((sym_ref && !kaction_set_sym_ref(kaction, sym_ref)) ||
+		(lock && !kaction_set_lock(kaction, lock)) ||
+		(script && !kaction_set_script(kaction, script)) ||
+		!kaction_set_interrupt(kaction, a->interrupt) ||
+		!kaction_set_in(kaction, a->in) ||
+		!kaction_set_out(kaction, a->out) ||
+		!kaction_set_exec_on(kaction, a->exec_on) ||
+		!kaction_set_update_retcode(kaction, a->update_retcode) ||
+		!kaction_set_permanent(kaction, a->permanent) ||
+		!kaction_set_sync(kaction, a->sync)) {
+		kaction_free(kaction);
+		return NULL;
+	}
+
+	return kaction;
+}
+
+
+static bool_t kbin_load_nested(const kbin_image_t *img, uint32_t off,
+	const kbin_entry_t *e, kentry_t *kentry);
+
+
+static kentry_t *kbin_load_entry(const kbin_image_t *img, uint32_t off)
+{
+	const kbin_entry_t *e = NULL;
+	kentry_t *kentry = NULL;
+	const char *name = NULL;
+	const char *help = NULL;
+	const char *ref = NULL;
+	const char *value = NULL;
+
+	e = kbin_rec(img, off, 1, sizeof(*e));
+	if (!e || !kbin_get_str(img, e->name, &name) || !name ||
+		!kbin_get_str(img, e->help, &help) ||
+		!kbin_get_str(img, e->ref, &ref) ||
+		!kbin_get_str(img, e->value, &value)) {
+		faux_error_sprintf(img->error,
+			TAG": Broken ENTRY record at offset %u", off);
+		return NULL;
+	}
+
+	kentry = kentry_new(name);
+	if (!kentry) {
+		faux_error_sprintf(img->error,
+			TAG": ENTRY \"%s\": Can't create object", name);
+		return NULL;
+	}
+	if (help)
+		kentry_set_help(kentry, help);
+	if (ref)
+		kentry_set_ref_str(kentry, ref);
+	if (e->link)
+		return kentry;
+
+	kentry_set_container(kentry, e->container);
+	kentry_set_mode(kentry, e->mode);
+	kentry_set_purpose(kentry, e->purpose);
+	kentry_set_min(kentry, e->min);
+	if (KBIN_UNBOUNDED == e->max)
+		kentry_set_max(kentry, (size_t)KENTRY_OCCURS_UNBOUNDED);
+	else
+		kentry_set_max(kentry, e->max);
+	if (value)
+		kentry_set_value(kentry, value);
+	kentry_set_restore(kentry, e->restore);
+	kentry_set_order(kentry, e->order);
+	kentry_set_filter(kentry, e->filter);
+	kentry_set_cache(kentry, e->cache);
+	kentry_set_cache_ttl(kentry, e->cache_ttl);
+	kentry_set_timeout(kentry, e->timeout);
+
+	if (!kbin_load_nested(img, off, e, kentry)) {
+		faux_error_sprintf(img->error,
+			TAG": ENTRY \"%s\": Illegal nested elements", name);
+		kentry_free(kentry);
+		return NULL;
+	}
+
+	return kentry;
+}
+
+
+static bool_t kbin_load_nested(const kbin_image_t *img, uint32_t off,
+	const kbin_entry_t *e, kentry_t *kentry)
+{
+	const uint32_t *offs = NULL;
+	const kbin_action_t *actions = NULL;
+	const kbin_hotkey_t *hotkeys = NULL;
+	uint32_t i = 0;
+
+	// ENTRY list
+	offs = kbin_rec(img, e->entrys_off, e->entrys_num, sizeof(*offs));
+	if (!offs && (e->entrys_num > 0))
+		return BOOL_FALSE;
+	for (i = 0; i < e->entrys_num; i++) {
+		kentry_t *nkentry = NULL;
+		// Nested records follow the parent one. It prevents loops.
+		if (offs[i] <= off)
+			return BOOL_FALSE;
+		nkentry = kbin_load_entry(img, offs[i]);
+		if (!nkentry)
+			return BOOL_FALSE;
+		kentry_set_parent(nkentry, kentry);
+		if (!kentry_add_entrys(kentry, nkentry)) {
+			faux_error_sprintf(img->error,
+				TAG": Can't add ENTRY \"%s\"",
+				kentry_name(nkentry));
+			kentry_free(nkentry);
+			return BOOL_FALSE;
+		}
+	}
+
+	// ACTION list
+	actions = kbin_rec(img, e->actions_off, e->actions_num,
+		sizeof(*actions));
+	if (!actions && (e->actions_num > 0))
+		return BOOL_FALSE;
+	for (i = 0; i < e->actions_num; i++) {
+		kaction_t *kaction = kbin_load_action(img, &actions[i]);
+		if (!kaction)
+			return BOOL_FALSE;
+		if (!kentry_add_actions(kentry, kaction)) {
+			kaction_free(kaction);
+			return BOOL_FALSE;
+		}
+	}
+
+	// HOTKEY list
+	hotkeys = kbin_rec(img, e->hotkeys_off, e->hotkeys_num,
+		sizeof(*hotkeys));
+	if (!hotkeys && (e->hotkeys_num > 0))
+		return BOOL_FALSE;
+	for (i = 0; i < e->hotkeys_num; i++) {
+		khotkey_t *khotkey = NULL;
+		const char *key = NULL;
+		const char *cmd = NULL;
+		if (!kbin_get_str(img, hotkeys[i].key, &key) ||
+			!kbin_get_str(img, hotkeys[i].cmd, &cmd))
+			return BOOL_FALSE;
+		khotkey = khotkey_new(key, cmd);
+		if (!khotkey)
+			return BOOL_FALSE;
+		if (!kentry_add_hotkeys(kentry, khotkey)) {
+			khotkey_free(khotkey);
+			return BOOL_FALSE;
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t kbin_load_plugins(const kbin_image_t *img, kscheme_t *scheme)
+{
+	const kbin_plugin_t *plugins = NULL;
+	uint32_t i = 0;
+
+	plugins = kbin_rec(img, img->hdr->plugins_off, img->hdr->plugins_num,
+		sizeof(*plugins));
+	if (!plugins && (img->hdr->plugins_num > 0)) {
+		faux_error_add(img->error, TAG": Broken PLUGIN list");
+		return BOOL_FALSE;
+	}
+
+	for (i = 0; i < img->hdr->plugins_num; i++) {
+		const kbin_plugin_t *p = &plugins[i];
+		kplugin_t *kplugin = NULL;
+		const char *name = NULL;
+		const char *id = NULL;
+		const char *file = NULL;
+		const char *conf = NULL;
+
+		if (!kbin_get_str(img, p->name, &name) || !name ||
+			!kbin_get_str(img, p->id, &id) ||
+			!kbin_get_str(img, p->file, &file) ||
+			!kbin_get_str(img, p->conf, &conf)) {
+			faux_error_add(img->error, TAG": Broken PLUGIN record");
+			return BOOL_FALSE;
+		}
+		kplugin = kplugin_new(name);
+		if (!kplugin)
+			return BOOL_FALSE;
+		if (id)
+			kplugin_set_id(kplugin, id);
+		if (file)
+			kplugin_set_file(kplugin, file);
+		if (conf)
+			kplugin_set_conf(kplugin, conf);
+		if (!kscheme_add_plugins(scheme, kplugin)) {
+			faux_error_sprintf(img->error,
+				TAG": Can't add PLUGIN \"%s\". "
+				"Probably duplication", name);
+			kplugin_free(kplugin);
+			return BOOL_FALSE;
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t kbin_load_entrys(const kbin_image_t *img, kscheme_t *scheme)
+{
+	const uint32_t *offs = NULL;
+	uint32_t i = 0;
+
+	offs = kbin_rec(img, img->hdr->entrys_off, img->hdr->entrys_num,
+		sizeof(*offs));
+	if (!offs && (img->hdr->entrys_num > 0)) {
+		faux_error_add(img->error, TAG": Broken ENTRY list");
+		return BOOL_FALSE;
+	}
+
+	for (i = 0; i < img->hdr->entrys_num; i++) {
+		kentry_t *kentry = kbin_load_entry(img, offs[i]);
+		if (!kentry)
+			return BOOL_FALSE;
+		if (!kscheme_add_entrys(scheme, kentry)) {
+			faux_error_sprintf(img->error,
+				TAG": Can't add ENTRY \"%s\". "
+				"Probably duplication", kentry_name(kentry));
+			kentry_free(kentry);
+			return BOOL_FALSE;
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+bool_t kdb_kbin_load_scheme(kdb_t *db, kscheme_t *scheme)
+{
+	faux_ini_t *ini = NULL;
+	const char *path = NULL;
+	kbin_image_t img = {};
+	struct stat st = {};
+	void *map = MAP_FAILED;
+	int f = -1;
+	bool_t retcode = BOOL_FALSE;
+
+	assert(db);
+	if (!db)
+		return BOOL_FALSE;
+	assert(scheme);
+	if (!scheme)
+		return BOOL_FALSE;
+
+	// Get configuration info from kdb object
+	ini = kdb_ini(db);
+	if (ini)
+		path = faux_ini_find(ini, "BinPath");
+	if (!path)
+		path = KBIN_DEFAULT_PATH;
+	img.error = kdb_error(db);
+
+	f = open(path, O_RDONLY | O_CLOEXEC);
+	if (f < 0) {
+		faux_error_sprintf(img.error, TAG": Can't open %s: %s",
+			path, strerror(errno));
+		return BOOL_FALSE;
+	}
+	if (fstat(f, &st) < 0) {
+		faux_error_sprintf(img.error, TAG": Can't stat %s: %s",
+			path, strerror(errno));
+		close(f);
+		return BOOL_FALSE;
+	}
+	if ((st.st_size < (off_t)sizeof(kbin_header_t)) ||
+		(st.st_size > (off_t)UINT32_MAX)) {
+		faux_error_sprintf(img.error, TAG": Illegal image size %s",
+			path);
+		close(f);
+		return BOOL_FALSE;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+	close(f);
+	if (MAP_FAILED == map) {
+		faux_error_sprintf(img.error, TAG": Can't map %s: %s",
+			path, strerror(errno));
+		return BOOL_FALSE;
+	}
+
+	img.data = map;
+	img.size = st.st_size;
+	img.hdr = map;
+	if (!kbin_check_header(&img))
+		goto err;
+	img.strings = img.data + img.hdr->strings_off;
+
+	if (!kbin_load_plugins(&img, scheme))
+		goto err;
+	if (!kbin_load_entrys(&img, scheme))
+		goto err;
+
+	retcode = BOOL_TRUE;
+err:
+	munmap(map, st.st_size);
+	if (!retcode)
+		faux_error_sprintf(img.error, TAG": Can't load %s", path);
+
+	return retcode;
+}
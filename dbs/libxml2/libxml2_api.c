@@ -1,10 +1,12 @@
 /** @file libxml2_api.c
  */
 
+#include <stdio.h>
 #include <errno.h>
 #include <string.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/xmlerror.h>
 
 #include <faux/faux.h>
 #include <faux/str.h>
@@ -13,6 +15,9 @@
 
 bool_t kxml_doc_start(void)
 {
+	// Must be called before parsing within threads
+	xmlInitParser();
+
 	return BOOL_TRUE;
 }
 
@@ -24,16 +29,44 @@ bool_t kxml_doc_stop(void)
 }
 
 
-kxml_doc_t *kxml_doc_read(const char *filename)
+kxml_doc_t *kxml_doc_read(const char *filename, kxml_err_t *err)
 {
 	xmlDoc *doc = NULL;
+	const xmlError *xml_err = NULL;
 
 	if (faux_str_is_empty(filename))
 		return NULL;
 
 	doc = xmlReadFile(filename, NULL, 0);
+	if (doc || !err)
+		return (kxml_doc_t *)doc;
+
+	// The last error is stored per thread
+	err->line = -1;
+	err->col = -1;
+	snprintf(err->msg, sizeof(err->msg), "Can't parse document");
+	xml_err = xmlGetLastError();
+	if (xml_err) {
+		size_t len = 0;
+		if (xml_err->line > 0)
+			err->line = xml_err->line;
+		if (xml_err->int2 > 0)
+			err->col = xml_err->int2;
+		if (xml_err->message)
+			snprintf(err->msg, sizeof(err->msg), "%s",
+				xml_err->message);
+		len = strlen(err->msg);
+		if ((len > 0) && (err->msg[len - 1] == '\n'))
+			err->msg[len - 1] = '\0';
+	}
 
-	return (kxml_doc_t *)doc;
+	return NULL;
+}
+
+
+bool_t kxml_doc_is_thread_safe(void)
+{
+	return xmlHasFeature(XML_WITH_THREAD) ? BOOL_TRUE : BOOL_FALSE;
 }
 
 
@@ -50,31 +83,6 @@ bool_t kxml_doc_is_valid(const kxml_doc_t *doc)
 }
 
 
-/*
-int kxml_doc_error_caps(kxml_doc_t *doc)
-{
-	doc = doc; // happy compiler
-	return kxmlERR_NOCAPS;
-}
-
-int kxml_doc_err_line(kxml_doc_t *doc)
-{
-	doc = doc; // happy compiler
-	return -1;
-}
-
-int kxml_doc_err_col(kxml_doc_t *doc)
-{
-	doc = doc; // happy compiler
-	return -1;
-}
-
-const char *kxml_doc_err_msg(kxml_doc_t *doc)
-{
-	doc = doc; // happy compiler
-	return "";
-}
-*/
 
 kxml_nodetype_e kxml_node_type(const kxml_node_t *node)
 {
@@ -8,6 +8,7 @@
  * ------------------------------------------------------
  */
 
+#include <stdio.h>
 #include <errno.h>
 #include <roxml.h>
 #include <string.h>
@@ -29,14 +30,28 @@ bool_t kxml_doc_stop(void)
 }
 
 
-kxml_doc_t *kxml_doc_read(const char *filename)
+kxml_doc_t *kxml_doc_read(const char *filename, kxml_err_t *err)
 {
 	node_t *doc = roxml_load_doc((char *)filename);
 
+	// The roxml doesn't provide error details
+	if (!doc && err) {
+		err->line = -1;
+		err->col = -1;
+		snprintf(err->msg, sizeof(err->msg), "Can't parse document");
+	}
+
 	return (kxml_doc_t *)doc;
 }
 
 
+// The roxml_release(RELEASE_ALL) frees buffers of all documents
+bool_t kxml_doc_is_thread_safe(void)
+{
+	return BOOL_FALSE;
+}
+
+
 void kxml_doc_release(kxml_doc_t *doc)
 {
 	if (!doc)
@@ -52,27 +67,6 @@ bool_t kxml_doc_is_valid(const kxml_doc_t *doc)
 	return (bool_t)(doc != NULL);
 }
 
-/*
-int kxml_doc_error_caps(kxml_doc_t *doc)
-{
-	return kxml_ERR_NOCAPS;
-}
-
-int kxml_doc_get_err_line(kxml_doc_t *doc)
-{
-	return -1;
-}
-
-int kxml_doc_get_err_col(kxml_doc_t *doc)
-{
-	return -1;
-}
-
-const char *kxml_doc_get_err_msg(kxml_doc_t *doc)
-{
-	return "";
-}
-*/
 
 kxml_nodetype_e kxml_node_type(const kxml_node_t *node)
 {
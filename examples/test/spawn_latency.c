@@ -0,0 +1,108 @@
+/*
+ * Spawn latency with high RLIMIT_NOFILE. The child closes inherited
+ * descriptors like forked ACTION does and executes /bin/true. The
+ * kexec_close_fds() is compared to the old loop up to _SC_OPEN_MAX.
+ *
+ * Usage: spawn_latency [iterations]
+ * Raise hard limit before (ulimit -Hn 1048576) to see the difference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include <klish/kexec.h>
+
+
+#define DEFAULT_ITERATIONS 100
+
+
+typedef enum {
+	CLOSE_NONE,
+	CLOSE_FDS,
+	CLOSE_LOOP,
+} close_method_e;
+
+
+static void close_loop(void)
+{
+	int fdmax = (int)sysconf(_SC_OPEN_MAX);
+	int fd = -1;
+
+	for (fd = (STDERR_FILENO + 1); fd < fdmax; fd++)
+		close(fd);
+}
+
+
+// Returns average spawn time in microseconds or -1 on error
+static double spawn_latency(close_method_e method, unsigned int iterations)
+{
+	struct timespec start = {};
+	struct timespec end = {};
+	unsigned int i = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		pid_t pid = fork();
+		int wstatus = 0;
+
+		if (pid < 0)
+			return -1;
+		if (0 == pid) {
+			if (CLOSE_FDS == method)
+				kexec_close_fds(NULL, 0);
+			else if (CLOSE_LOOP == method)
+				close_loop();
+			execl("/bin/true", "true", (char *)NULL);
+			_exit(-1);
+		}
+		if ((waitpid(pid, &wstatus, 0) < 0) ||
+			!WIFEXITED(wstatus) || (WEXITSTATUS(wstatus) != 0))
+			return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e6 +
+		(end.tv_nsec - start.tv_nsec) / 1e3) / iterations;
+}
+
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = DEFAULT_ITERATIONS;
+	struct rlimit rl = {};
+	double none = 0;
+	double fds = 0;
+	double loop = 0;
+
+	if (argc > 1)
+		iterations = (unsigned int)strtoul(argv[1], NULL, 10);
+	if (0 == iterations)
+		iterations = DEFAULT_ITERATIONS;
+
+	// Use max allowed number of descriptors like busy daemon can
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	printf("RLIMIT_NOFILE: %ld, iterations: %u\n",
+		sysconf(_SC_OPEN_MAX), iterations);
+
+	none = spawn_latency(CLOSE_NONE, iterations);
+	fds = spawn_latency(CLOSE_FDS, iterations);
+	loop = spawn_latency(CLOSE_LOOP, iterations);
+	if ((none < 0) || (fds < 0) || (loop < 0)) {
+		fprintf(stderr, "Error: Can't spawn /bin/true\n");
+		return -1;
+	}
+
+	printf("No closing:        %10.1f us\n", none);
+	printf("kexec_close_fds(): %10.1f us\n", fds);
+	printf("Loop to OPEN_MAX:  %10.1f us\n", loop);
+
+	return 0;
+}
@@ -26,6 +26,8 @@ struct ientry_s {
 	char *restore;
 	char *order;
 	char *filter;
+	char *cache;
+	char *timeout;
 	ientry_t * (*entrys)[]; // Nested entrys
 	iaction_t * (*actions)[];
 	ihotkey_t * (*hotkeys)[];
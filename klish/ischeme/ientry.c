@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 
 #include <faux/str.h>
 #include <faux/list.h>
@@ -13,6 +14,65 @@
 #define TAG "ENTRY"
 
 
+// Time is a number with optional "ms" or "s" suffix. Default unit is
+// second. Result is in milliseconds.
+static bool_t ientry_parse_time(const char *str, unsigned int *ms)
+{
+	char *time_str = NULL;
+	size_t len = 0;
+	unsigned int t = 0;
+	unsigned int multiplier = 1000;
+	bool_t res = BOOL_FALSE;
+
+	time_str = faux_str_dup(str);
+	len = strlen(time_str);
+	if ((len > 2) && !faux_str_casecmp(time_str + len - 2, "ms")) {
+		time_str[len - 2] = '\0';
+		multiplier = 1;
+	} else if ((len > 1) && !faux_str_casecmp(time_str + len - 1, "s")) {
+		time_str[len - 1] = '\0';
+	}
+	if (faux_conv_atoui(time_str, &t, 10) && (t > 0) &&
+		(t <= (UINT_MAX / multiplier))) {
+		*ms = t * multiplier;
+		res = BOOL_TRUE;
+	}
+	faux_str_free(time_str);
+
+	return res;
+}
+
+
+// Cache attribute can be "false", "input", "session" or "ttl:<time>".
+static bool_t ientry_parse_cache(const char *str, kentry_t *entry)
+{
+	const char *ttl_prefix = "ttl:";
+	unsigned int ttl = 0;
+
+	if (!faux_str_casecmp(str, "false") || !faux_str_casecmp(str, "none")) {
+		kentry_set_cache(entry, KENTRY_CACHE_NONE);
+		return BOOL_TRUE;
+	}
+	if (!faux_str_casecmp(str, "input")) {
+		kentry_set_cache(entry, KENTRY_CACHE_INPUT);
+		return BOOL_TRUE;
+	}
+	if (!faux_str_casecmp(str, "session")) {
+		kentry_set_cache(entry, KENTRY_CACHE_SESSION);
+		return BOOL_TRUE;
+	}
+	if (faux_str_casecmpn(str, ttl_prefix, strlen(ttl_prefix)) != 0)
+		return BOOL_FALSE;
+
+	if (!ientry_parse_time(str + strlen(ttl_prefix), &ttl))
+		return BOOL_FALSE;
+	kentry_set_cache(entry, KENTRY_CACHE_TTL);
+	kentry_set_cache_ttl(entry, ttl);
+
+	return BOOL_TRUE;
+}
+
+
 bool_t ientry_parse(const ientry_t *info, kentry_t *entry, faux_error_t *error)
 {
 	bool_t retcode = BOOL_TRUE;
@@ -149,6 +209,24 @@ bool_t ientry_parse(const ientry_t *info, kentry_t *entry, faux_error_t *error)
 		}
 	}
 
+	// Cache
+	if (!faux_str_is_empty(info->cache)) {
+		if (!ientry_parse_cache(info->cache, entry)) {
+			faux_error_add(error, TAG": Illegal 'cache' attribute");
+			retcode = BOOL_FALSE;
+		}
+	}
+
+	// Timeout
+	if (!faux_str_is_empty(info->timeout)) {
+		unsigned int timeout = 0;
+		if (!ientry_parse_time(info->timeout, &timeout) ||
+			!kentry_set_timeout(entry, timeout)) {
+			faux_error_add(error, TAG": Illegal 'timeout' attribute");
+			retcode = BOOL_FALSE;
+		}
+	}
+
 	return retcode;
 }
 
@@ -402,6 +480,33 @@ char *ientry_deploy(const kentry_t *kentry, int level)
 		}
 		attr2ctext(&str, "filter", filter, level + 1);
 
+		// Cache
+		switch (kentry_cache(kentry)) {
+		case KENTRY_CACHE_INPUT:
+			attr2ctext(&str, "cache", "input", level + 1);
+			break;
+		case KENTRY_CACHE_SESSION:
+			attr2ctext(&str, "cache", "session", level + 1);
+			break;
+		case KENTRY_CACHE_TTL:
+			num = faux_str_sprintf("ttl:%ums",
+				kentry_cache_ttl(kentry));
+			attr2ctext(&str, "cache", num, level + 1);
+			faux_str_free(num);
+			num = NULL;
+			break;
+		default:
+			break;
+		}
+
+		// Timeout
+		if (kentry_timeout(kentry) > 0) {
+			num = faux_str_sprintf("%ums", kentry_timeout(kentry));
+			attr2ctext(&str, "timeout", num, level + 1);
+			faux_str_free(num);
+			num = NULL;
+		}
+
 		// ENTRY list
 		entrys_iter = kentry_entrys_iter(kentry);
 		if (entrys_iter) {
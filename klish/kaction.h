@@ -66,6 +66,10 @@ bool_t kaction_set_sym(kaction_t *action, ksym_t *sym);
 kplugin_t *kaction_plugin(const kaction_t *action);
 bool_t kaction_set_plugin(kaction_t *action, kplugin_t *plugin);
 
+void *kaction_compiled(const kaction_t *action);
+bool_t kaction_set_compiled(kaction_t *action, void *compiled,
+	ksym_compiled_free_fn compiled_free);
+
 tri_t kaction_permanent(const kaction_t *action);
 bool_t kaction_set_permanent(kaction_t *action, tri_t permanent);
 bool_t kaction_is_permanent(const kaction_t *action);
@@ -0,0 +1,34 @@
+/** @file karena.h
+ *
+ * @brief Klish arena allocator. Memory is allocated by simple pointer
+ * increment within big chunks and is released all at once.
+ */
+
+#ifndef _klish_karena_h
+#define _klish_karena_h
+
+#include <stddef.h>
+#include <faux/faux.h>
+
+// The first chunk is small. Each next chunk is twice bigger up to max size.
+#define KARENA_MIN_CHUNK_SIZE 256
+#define KARENA_DEFAULT_CHUNK_SIZE 4096
+
+typedef struct karena_s karena_t;
+
+C_DECL_BEGIN
+
+karena_t *karena_new(size_t chunk_size);
+void karena_free(karena_t *arena);
+
+void *karena_alloc(karena_t *arena, size_t size);
+char *karena_str_dup(karena_t *arena, const char *str);
+
+// Statistics
+size_t karena_allocs(const karena_t *arena);
+size_t karena_chunks(const karena_t *arena);
+size_t karena_used(const karena_t *arena);
+
+C_DECL_END
+
+#endif // _klish_karena_h
@@ -0,0 +1,33 @@
+/** @file kcache.h
+ *
+ * @brief Klish PTYPE validation cache. LRU list of validation results.
+ */
+
+#ifndef _klish_kcache_h
+#define _klish_kcache_h
+
+#include <stdint.h>
+#include <faux/faux.h>
+
+#define KCACHE_DEFAULT_MAX_LEN 256
+
+// TTL value for records that never expire
+#define KCACHE_TTL_INFINITE 0
+
+typedef struct kcache_s kcache_t;
+
+C_DECL_BEGIN
+
+kcache_t *kcache_new(size_t max_len);
+void kcache_free(kcache_t *cache);
+
+bool_t kcache_find(kcache_t *cache, const void *ptype, const char *value,
+	const char *key, int *retcode, const char **out);
+bool_t kcache_add(kcache_t *cache, const void *ptype, const char *value,
+	const char *key, unsigned int ttl, int retcode, const char *out);
+void kcache_clear(kcache_t *cache);
+size_t kcache_len(const kcache_t *cache);
+
+C_DECL_END
+
+#endif // _klish_kcache_h
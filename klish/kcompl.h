@@ -0,0 +1,45 @@
+/** @file kcompl.h
+ *
+ * @brief Klish completion collector. Completion syms put items directly
+ * to collector instead of text output.
+ */
+
+#ifndef _klish_kcompl_h
+#define _klish_kcompl_h
+
+#include <faux/faux.h>
+#include <faux/list.h>
+#include <klish/kentry.h>
+
+// Default max number of completion items
+#define KCOMPL_DEFAULT_MAX_LEN 10000
+
+typedef struct kcompl_s kcompl_t;
+typedef struct kcompl_item_s kcompl_item_t;
+
+typedef faux_list_node_t kcompl_items_node_t;
+
+C_DECL_BEGIN
+
+kcompl_t *kcompl_new(const char *prefix, size_t max_len);
+void kcompl_free(kcompl_t *compl);
+
+const char *kcompl_prefix(const kcompl_t *compl);
+size_t kcompl_max_len(const kcompl_t *compl);
+pid_t kcompl_pid(const kcompl_t *compl);
+bool_t kcompl_is_full(const kcompl_t *compl);
+bool_t kcompl_add(kcompl_t *compl, const kentry_t *entry,
+	const char *text, const char *help);
+bool_t kcompl_add_text(kcompl_t *compl, const kentry_t *entry, const char *out);
+ssize_t kcompl_items_len(const kcompl_t *compl);
+kcompl_items_node_t *kcompl_items_iter(const kcompl_t *compl);
+kcompl_item_t *kcompl_items_each(kcompl_items_node_t **iter);
+
+// Completion item
+const kentry_t *kcompl_item_entry(const kcompl_item_t *item);
+const char *kcompl_item_text(const kcompl_item_t *item);
+const char *kcompl_item_help(const kcompl_item_t *item);
+
+C_DECL_END
+
+#endif // _klish_kcompl_h
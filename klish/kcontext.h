@@ -47,6 +47,10 @@ const kpargv_t *kcontext_parent_pargv(const kcontext_t *context);
 FAUX_HIDDEN bool_t kcontext_set_parent_pargv(kcontext_t *context,
 	const kpargv_t *parent_pargv);
 
+// Own candidate parg. Overrides parent pargv's candidate
+FAUX_HIDDEN bool_t kcontext_set_candidate_parg(kcontext_t *context,
+	kparg_t *candidate_parg);
+
 // Parent context object
 const kcontext_t *kcontext_parent_context(const kcontext_t *context);
 FAUX_HIDDEN bool_t kcontext_set_parent_context(kcontext_t *context,
@@ -73,6 +77,13 @@ FAUX_HIDDEN bool_t kcontext_set_stdout(kcontext_t *context, int stdout);
 int kcontext_stderr(const kcontext_t *context);
 FAUX_HIDDEN bool_t kcontext_set_stderr(kcontext_t *context, int stderr);
 
+// Output of sym function executed within daemon. It's a capture file
+// while thread-safe sync sym is executed. Else process-wide stdout/stderr.
+int kcontext_fdout(const kcontext_t *context);
+int kcontext_fderr(const kcontext_t *context);
+FAUX_HIDDEN bool_t kcontext_set_capture(kcontext_t *context,
+	int capture_out, int capture_err);
+
 // bufout
 faux_buf_t *kcontext_bufout(const kcontext_t *context);
 FAUX_HIDDEN bool_t kcontext_set_bufout(kcontext_t *context, faux_buf_t *bufout);
@@ -113,14 +124,26 @@ int kcontext_printf_err(const kcontext_t *context, const char *fmt, ...);
 kparg_t *kcontext_candidate_parg(const kcontext_t *context);
 const kentry_t *kcontext_candidate_entry(const kcontext_t *context);
 const char *kcontext_candidate_value(const kcontext_t *context);
+const char *kcontext_prefix(const kcontext_t *context);
+bool_t kcontext_add_completion(kcontext_t *context, const char *text,
+	const char *help);
 const kaction_t *kcontext_action(const kcontext_t *context);
 const char *kcontext_script(const kcontext_t *context);
+void *kcontext_compiled(const kcontext_t *context);
 bool_t kcontext_named_udata_new(kcontext_t *context,
 	const char *name, void *data, kudata_data_free_fn free_fn);
 void *kcontext_named_udata(const kcontext_t *context, const char *name);
 void *kcontext_udata(const kcontext_t *context);
+bool_t kcontext_session_udata_new(kcontext_t *context,
+	const char *name, void *data, kudata_data_free_fn free_fn);
+void *kcontext_session_udata(const kcontext_t *context, const char *name);
 const kentry_t *kcontext_command(const kcontext_t *context);
 
+// Direct execution of silent sync ACTIONs
+FAUX_HIDDEN bool_t kcontext_exec_silent(ksession_t *session, kpargv_t *pargv,
+	const kpargv_t *parent_pargv, const kcontext_t *parent_context,
+	const kexec_t *parent_exec, faux_buf_t *bufout, int *retcode);
+
 
 C_DECL_END
 
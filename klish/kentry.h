@@ -45,6 +45,14 @@ typedef enum {
 	KENTRY_FILTER_DUAL, // Entry can be filter or non-filter
 } kentry_filter_e;
 
+// Caching of PTYPE validation results
+typedef enum {
+	KENTRY_CACHE_NONE, // Don't cache
+	KENTRY_CACHE_SESSION, // Cache while session is alive
+	KENTRY_CACHE_TTL, // Cache for 'cache_ttl' milliseconds
+	KENTRY_CACHE_INPUT, // Cache while the same line is being completed
+} kentry_cache_e;
+
 // Number of max occurs
 typedef enum {
 	KENTRY_OCCURS_UNBOUNDED = (size_t)(-1),
@@ -53,6 +61,17 @@ typedef enum {
 
 typedef bool_t (*kentry_udata_free_fn)(void *data);
 
+// Keyword dispatch index of SWITCH ENTRY
+typedef struct kentry_index_s kentry_index_t;
+
+typedef struct {
+	const kentry_index_t *index;
+	size_t keyword; // Current matched keyword
+	size_t keyword_end; // Next after last matched keyword
+	size_t other; // Current non-keyword ENTRY
+	size_t visited; // Position of the last returned ENTRY + 1. 0 - none
+} kentry_index_iter_t;
+
 
 C_DECL_BEGIN
 
@@ -99,6 +118,13 @@ bool_t kentry_set_order(kentry_t *entry, bool_t order);
 // Filter
 kentry_filter_e kentry_filter(const kentry_t *entry);
 bool_t kentry_set_filter(kentry_t *entry, kentry_filter_e filter);
+kentry_cache_e kentry_cache(const kentry_t *entry);
+bool_t kentry_set_cache(kentry_t *entry, kentry_cache_e cache);
+unsigned int kentry_cache_ttl(const kentry_t *entry);
+bool_t kentry_set_cache_ttl(kentry_t *entry, unsigned int cache_ttl);
+// Timeout
+unsigned int kentry_timeout(const kentry_t *entry);
+bool_t kentry_set_timeout(kentry_t *entry, unsigned int timeout);
 // User data
 void *kentry_udata(const kentry_t *entry);
 bool_t kentry_set_udata(kentry_t *entry, void *data, kentry_udata_free_fn udata_free_fn);
@@ -120,6 +146,7 @@ kentry_actions_node_t *kentry_actions_iter(const kentry_t *entry);
 kaction_t *kentry_actions_each(kentry_actions_node_t **iter);
 kaction_io_e kentry_in(const kentry_t *entry);
 kaction_io_e kentry_out(const kentry_t *entry);
+bool_t kentry_actions_are_silent(const kentry_t *entry);
 
 // HOTKEYs
 faux_list_t *kentry_hotkeys(const kentry_t *entry);
@@ -134,6 +161,15 @@ kentry_t *kentry_nested_by_purpose(const kentry_t *entry, kentry_purpose_e purpo
 bool_t kentry_set_nested_by_purpose(kentry_t *entry, kentry_purpose_e purpose,
 	kentry_t *nested);
 
+// Parser indexes
+bool_t kentry_build_index(kentry_t *entry);
+const char *kentry_keyword(const kentry_t *entry);
+size_t kentry_pos(const kentry_t *entry);
+bool_t kentry_index_iter_init(const kentry_t *entry, const char *arg,
+	kentry_index_iter_t *iter);
+kentry_t *kentry_index_each(kentry_index_iter_t *iter);
+bool_t kentry_index_last_visited(const kentry_index_iter_t *iter);
+
 C_DECL_END
 
 #endif // _klish_kentry_h
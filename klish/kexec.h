@@ -8,6 +8,7 @@
 
 #include <faux/list.h>
 #include <faux/buf.h>
+#include <faux/eloop.h>
 #include <klish/kcontext.h>
 #include <klish/ksession.h>
 
@@ -15,6 +16,11 @@ typedef struct kexec_s kexec_t;
 
 typedef faux_list_node_t kexec_contexts_node_t;
 
+// Callback to inform about kexec progress within event loop: ACTION's
+// process is terminated or in-daemon stream stage is completed. Return
+// value is returned to event loop.
+typedef bool_t (*kexec_event_fn)(kexec_t *exec, void *udata);
+
 
 C_DECL_BEGIN
 
@@ -30,6 +36,9 @@ bool_t kexec_set_stdin(kexec_t *exec, int stdin);
 // STDOUT
 int kexec_stdout(const kexec_t *exec);
 bool_t kexec_set_stdout(kexec_t *exec, int stdout);
+// Owner reads STDOUT pipe directly (bulk transfer). Exec must not read it.
+bool_t kexec_stdout_held(const kexec_t *exec);
+bool_t kexec_set_stdout_held(kexec_t *exec, bool_t stdout_held);
 // STDERR
 int kexec_stderr(const kexec_t *exec);
 bool_t kexec_set_stderr(kexec_t *exec, int stderr);
@@ -50,6 +59,10 @@ kpath_t *kexec_saved_path(const kexec_t *exec);
 // Line
 const char *kexec_line(const kexec_t *exec);
 bool_t kexec_set_line(kexec_t *exec, const char *line);
+// Event loop to watch for ACTION's processes and in-daemon stream stages
+faux_eloop_t *kexec_eloop(const kexec_t *exec);
+bool_t kexec_set_eloop(kexec_t *exec, faux_eloop_t *eloop,
+	kexec_event_fn event_cb, void *udata);
 
 // CONTEXTs
 bool_t kexec_add_contexts(kexec_t *exec, kcontext_t *context);
@@ -59,10 +72,11 @@ kexec_contexts_node_t *kexec_contexts_iter(const kexec_t *exec);
 kcontext_t *kexec_contexts_each(kexec_contexts_node_t **iter);
 
 bool_t kexec_continue_command_execution(kexec_t *exec, pid_t pid, int wstatus);
+bool_t kexec_wait_children(kexec_t *exec);
+void kexec_close_fds(const int *keep, size_t keep_num);
 bool_t kexec_exec(kexec_t *exec);
 bool_t kexec_need_stdin(const kexec_t *exec);
 bool_t kexec_interactive(const kexec_t *exec);
-bool_t kexec_set_winsize(kexec_t *exec);
 const kaction_t *kexec_current_action(const kexec_t *exec);
 
 C_DECL_END
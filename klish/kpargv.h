@@ -9,6 +9,8 @@
 #include <faux/list.h>
 #include <faux/argv.h>
 #include <klish/kentry.h>
+#include <klish/karena.h>
+#include <klish/kcompl.h>
 
 
 typedef enum {
@@ -38,12 +40,22 @@ typedef struct kparg_s kparg_t;
 typedef faux_list_node_t kpargv_pargs_node_t;
 typedef faux_list_node_t kpargv_completions_node_t;
 
+// Values of pargs grouped by entry. Groups and values are in order of
+// appearance. Value can be NULL.
+typedef struct {
+	const kentry_t *entry;
+	const char **values;
+	size_t num;
+} kpargv_group_t;
+
 
 C_DECL_BEGIN
 
 // Parg
 
 kparg_t *kparg_new(const kentry_t *entry, const char *value);
+kparg_t *kparg_new_arena(karena_t *arena, const kentry_t *entry,
+	const char *value);
 void kparg_free(kparg_t *parg);
 
 const kentry_t *kparg_entry(const kparg_t *parg);
@@ -54,6 +66,8 @@ const char *kparg_value(const kparg_t *parg);
 
 kpargv_t *kpargv_new();
 void kpargv_free(kpargv_t *pargv);
+kparg_t *kpargv_new_parg(kpargv_t *pargv, const kentry_t *entry,
+	const char *value);
 
 // Status
 kpargv_status_e kpargv_status(const kpargv_t *pargv);
@@ -94,6 +108,7 @@ kparg_t *kpargv_pargs_last(const kpargv_t *pargv);
 kparg_t *kpargv_entry_exists(const kpargv_t *pargv, const void *entry);
 kparg_t *kpargv_find(const kpargv_t *pargv, const char *entry_name);
 faux_list_t *kpargv_find_multi(const kpargv_t *pargv, const char *entry_name);
+ssize_t kpargv_groups(const kpargv_t *pargv, kpargv_group_t **groups);
 
 // Completions
 faux_list_t *kpargv_completions(const kpargv_t *pargv);
@@ -103,6 +118,10 @@ bool_t kpargv_completions_is_empty(const kpargv_t *pargv);
 kpargv_completions_node_t *kpargv_completions_iter(const kpargv_t *pargv);
 const kentry_t *kpargv_completions_each(kpargv_completions_node_t **iter);
 
+// Completion collector
+kcompl_t *kpargv_compl(const kpargv_t *pargv);
+bool_t kpargv_set_compl(kpargv_t *pargv, kcompl_t *compl);
+
 // Debug
 bool_t kpargv_debug(const kpargv_t *pargv);
 
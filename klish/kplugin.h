@@ -68,6 +68,11 @@ int kplugin_fini_session(kplugin_t *plugin, kcontext_t *context);
 int kplugin_init(kplugin_t *plugin, kcontext_t *context);
 int kplugin_fini(kplugin_t *plugin, kcontext_t *context);
 
+// Serializes execution of plugin code by threads
+void kplugin_lock(void);
+void kplugin_unlock(void);
+void kplugin_lock_reset(void);
+
 // SYMs
 faux_list_t *kplugin_syms(const kplugin_t *plugin);
 bool_t kplugin_add_syms(kplugin_t *plugin, ksym_t *sym);
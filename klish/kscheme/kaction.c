@@ -25,6 +25,8 @@ struct kaction_s {
 	tri_t permanent;
 	tri_t sync;
 	char *script;
+	void *compiled; // Precompiled script (see ksym_compile_fn)
+	ksym_compiled_free_fn compiled_free;
 };
 
 
@@ -76,6 +78,9 @@ KSET(action, ksym_t *, sym);
 KGET(action, kplugin_t *, plugin);
 KSET(action, kplugin_t *, plugin);
 
+// Precompiled script
+KGET(action, void *, compiled);
+
 
 kaction_t *kaction_new(void)
 {
@@ -97,6 +102,8 @@ kaction_t *kaction_new(void)
 	action->script = NULL;
 	action->sym = NULL;
 	action->plugin = NULL;
+	action->compiled = NULL;
+	action->compiled_free = NULL;
 
 	return action;
 }
@@ -110,11 +117,31 @@ void kaction_free(kaction_t *action)
 	faux_str_free(action->sym_ref);
 	faux_str_free(action->lock);
 	faux_str_free(action->script);
+	if (action->compiled && action->compiled_free)
+		action->compiled_free(action->compiled);
 
 	faux_free(action);
 }
 
 
+bool_t kaction_set_compiled(kaction_t *action, void *compiled,
+	ksym_compiled_free_fn compiled_free)
+{
+	assert(action);
+	if (!action)
+		return BOOL_FALSE;
+
+	// Free old value
+	if (action->compiled && action->compiled_free)
+		action->compiled_free(action->compiled);
+
+	action->compiled = compiled;
+	action->compiled_free = compiled_free;
+
+	return BOOL_TRUE;
+}
+
+
 bool_t kaction_meet_exec_conditions(const kaction_t *action, int current_retcode)
 {
 	bool_t r = BOOL_FALSE; // Default is pessimistic
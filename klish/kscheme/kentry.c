@@ -28,6 +28,9 @@ struct kentry_s {
 	bool_t restore; // Should entry restore its depth while execution
 	bool_t order; // Is entry ordered
 	kentry_filter_e filter; // Is entry filter. Filter can't have inline actions.
+	kentry_cache_e cache; // Cache PTYPE validation results
+	unsigned int cache_ttl; // Cache TTL in milliseconds
+	unsigned int timeout; // Completion/help timeout in milliseconds
 	faux_list_t *entrys; // Nested ENTRYs
 	faux_list_t *actions; // Nested ACTIONs
 	faux_list_t *hotkeys; // Hotkeys
@@ -35,6 +38,25 @@ struct kentry_s {
 	kentry_t** nested_by_purpose;
 	void *udata;
 	kentry_udata_free_fn udata_free_fn;
+	kentry_index_t *index; // Keyword dispatch index for SWITCH
+	const char *keyword; // Keyword for builtin COMMAND PTYPE. Don't free
+	size_t pos; // Position within parent's nested ENTRYs list
+};
+
+
+// Nested ENTRY with builtin COMMAND-like PTYPE
+typedef struct {
+	const char *keyword; // Link to ENTRY's value or name. Don't free
+	size_t pos; // Position among COMMON nested ENTRYs
+	kentry_t *entry;
+} kentry_index_item_t;
+
+struct kentry_index_s {
+	size_t len; // Number of COMMON nested ENTRYs
+	kentry_index_item_t *keywords; // Sorted by keyword then by position
+	size_t keywords_len;
+	kentry_index_item_t *others; // Sorted by position
+	size_t others_len;
 };
 
 
@@ -91,6 +113,24 @@ KSET_BOOL(entry, order);
 KGET(entry, kentry_filter_e, filter);
 KSET(entry, kentry_filter_e, filter);
 
+// Cache
+KGET(entry, kentry_cache_e, cache);
+KSET(entry, kentry_cache_e, cache);
+
+// Cache TTL
+KGET(entry, unsigned int, cache_ttl);
+KSET(entry, unsigned int, cache_ttl);
+
+// Timeout
+KGET(entry, unsigned int, timeout);
+KSET(entry, unsigned int, timeout);
+
+// Keyword
+KGET(entry, const char *, keyword);
+
+// Position within parent's list
+KGET(entry, size_t, pos);
+
 // Nested ENTRYs list
 KGET(entry, faux_list_t *, entrys);
 static KCMP_NESTED(entry, entry, name);
@@ -144,8 +184,14 @@ kentry_t *kentry_new(const char *name)
 	entry->restore = BOOL_FALSE;
 	entry->order = BOOL_FALSE;
 	entry->filter = KENTRY_FILTER_FALSE;
+	entry->cache = KENTRY_CACHE_NONE;
+	entry->cache_ttl = 0;
+	entry->timeout = 0; // Default
 	entry->udata = NULL;
 	entry->udata_free_fn = NULL;
+	entry->index = NULL;
+	entry->keyword = NULL;
+	entry->pos = 0;
 
 	// ENTRY list
 	entry->entrys = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_UNIQUE,
@@ -182,6 +228,17 @@ static void kentry_free_non_link(kentry_t *entry)
 }
 
 
+static void kentry_index_free(kentry_index_t *index)
+{
+	if (!index)
+		return;
+
+	faux_free(index->keywords);
+	faux_free(index->others);
+	faux_free(index);
+}
+
+
 static void kentry_free_common(kentry_t *entry)
 {
 	if (!entry)
@@ -193,6 +250,7 @@ static void kentry_free_common(kentry_t *entry)
 	faux_str_free(entry->ref_str);
 	if (entry->udata && entry->udata_free_fn)
 		entry->udata_free_fn(entry->udata);
+	kentry_index_free(entry->index);
 }
 
 
@@ -250,6 +308,12 @@ bool_t kentry_link(kentry_t *dst, const kentry_t *src)
 	// order - orig
 	// filter - ref
 	dst->filter = src->filter;
+	// cache - ref
+	dst->cache = src->cache;
+	// cache_ttl - ref
+	dst->cache_ttl = src->cache_ttl;
+	// timeout - ref
+	dst->timeout = src->timeout;
 	// entrys - ref
 	dst->entrys = src->entrys;
 	// actions - ref
@@ -260,6 +324,9 @@ bool_t kentry_link(kentry_t *dst, const kentry_t *src)
 	dst->nested_by_purpose = src->nested_by_purpose;
 	// udata - orig
 	// udata_free_fn - orig
+	// index - orig
+	// keyword - orig
+	// pos - orig
 
 	return BOOL_TRUE;
 }
@@ -359,3 +426,266 @@ kaction_io_e kentry_out(const kentry_t *entry)
 
 	return io;
 }
+
+
+// Check if all ENTRY's actions are sync and silent. Such actions can be
+// executed directly without forking and output grabbing.
+bool_t kentry_actions_are_silent(const kentry_t *entry)
+{
+	kentry_actions_node_t *iter = NULL;
+	kaction_t *action = NULL;
+
+	if (!entry)
+		return BOOL_FALSE;
+	if (kentry_actions_len(entry) <= 0)
+		return BOOL_FALSE;
+	iter = kentry_actions_iter(entry);
+	while ((action = kentry_actions_each(&iter))) {
+		const ksym_t *sym = kaction_sym(action);
+		if (!sym || !ksym_function(sym))
+			return BOOL_FALSE;
+		if (!kaction_is_sync(action) || !ksym_silent(sym))
+			return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Get keyword of ENTRY if the ENTRY uses builtin COMMAND (or COMMAND_CASE)
+// PTYPE. Such ENTRY can match the only argument equal to its value (or
+// name). Returns NULL for all other ENTRYs.
+static const char *kentry_find_keyword(const kentry_t *entry)
+{
+	const kentry_t *ptype = NULL;
+	const kaction_t *action = NULL;
+	const ksym_t *sym = NULL;
+	const kplugin_t *plugin = NULL;
+	const char *sym_name = NULL;
+
+	if (kentry_purpose(entry) != KENTRY_PURPOSE_COMMON)
+		return NULL;
+	if (kentry_container(entry))
+		return NULL;
+	ptype = kentry_nested_by_purpose(entry, KENTRY_PURPOSE_PTYPE);
+	if (!ptype)
+		return NULL;
+	if (kentry_actions_len(ptype) != 1)
+		return NULL;
+	action = (const kaction_t *)faux_list_data(
+		faux_list_head(kentry_actions(ptype)));
+	// PTYPE must be executed anyway and must define result
+	if (!kaction_meet_exec_conditions(action, 0) ||
+		!kaction_update_retcode(action))
+		return NULL;
+	sym = kaction_sym(action);
+	plugin = kaction_plugin(action);
+	if (!sym || !plugin)
+		return NULL;
+	if (faux_str_casecmp(kplugin_name(plugin), "klish") != 0)
+		return NULL;
+	sym_name = ksym_name(sym);
+	if ((faux_str_casecmp(sym_name, "COMMAND") != 0) &&
+		(faux_str_casecmp(sym_name, "COMMAND_CASE") != 0))
+		return NULL;
+
+	if (kentry_value(entry))
+		return kentry_value(entry);
+
+	return kentry_name(entry);
+}
+
+
+static int kentry_index_item_compare(const void *first, const void *second)
+{
+	const kentry_index_item_t *f = (const kentry_index_item_t *)first;
+	const kentry_index_item_t *s = (const kentry_index_item_t *)second;
+	int r = 0;
+
+	r = faux_str_casecmp(f->keyword, s->keyword);
+	if (r != 0)
+		return r;
+	if (f->pos < s->pos)
+		return -1;
+	if (f->pos > s->pos)
+		return 1;
+
+	return 0;
+}
+
+
+/** @brief Builds indexes used by parser.
+ *
+ * The ENTRY gets its keyword (if any) and nested ENTRYs get their
+ * positions within the list. The positions are dense so parser can use
+ * bitmaps for nested ENTRYs.
+ *
+ * For SWITCH ENTRY the keyword dispatch index is built. Nested ENTRYs with
+ * builtin COMMAND PTYPEs are sorted by case-folded keyword so parser can
+ * find the only candidates for the argument instead of the PTYPE execution
+ * for each nested ENTRY. Other nested ENTRYs are stored in declaration
+ * order and are always tried.
+ *
+ * Must be executed when all ACTIONs of the scheme are resolved.
+ */
+bool_t kentry_build_index(kentry_t *entry)
+{
+	kentry_index_t *index = NULL;
+	kentry_entrys_node_t *iter = NULL;
+	kentry_t *nested = NULL;
+	size_t len = 0;
+	size_t pos = 0;
+
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+
+	entry->keyword = kentry_find_keyword(entry);
+	iter = kentry_entrys_iter(entry);
+	while ((nested = kentry_entrys_each(&iter)))
+		nested->pos = pos++;
+
+	kentry_index_free(entry->index);
+	entry->index = NULL;
+
+	if (kentry_mode(entry) != KENTRY_MODE_SWITCH)
+		return BOOL_TRUE;
+	len = kentry_entrys_len(entry);
+	if (len <= 0)
+		return BOOL_TRUE;
+
+	index = faux_zmalloc(sizeof(*index));
+	assert(index);
+	index->keywords = faux_zmalloc(len * sizeof(*index->keywords));
+	assert(index->keywords);
+	index->others = faux_zmalloc(len * sizeof(*index->others));
+	assert(index->others);
+
+	iter = kentry_entrys_iter(entry);
+	while ((nested = kentry_entrys_each(&iter))) {
+		const char *keyword = NULL;
+		kentry_index_item_t *item = NULL;
+
+		// Parser ignores entries with non-COMMON purpose
+		if (kentry_purpose(nested) != KENTRY_PURPOSE_COMMON)
+			continue;
+		keyword = kentry_find_keyword(nested);
+		if (keyword)
+			item = &index->keywords[index->keywords_len++];
+		else
+			item = &index->others[index->others_len++];
+		item->keyword = keyword;
+		item->pos = index->len++;
+		item->entry = nested;
+	}
+
+	// Index is useless without keywords
+	if (0 == index->keywords_len) {
+		kentry_index_free(index);
+		return BOOL_TRUE;
+	}
+
+	qsort(index->keywords, index->keywords_len, sizeof(*index->keywords),
+		kentry_index_item_compare);
+	entry->index = index;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Initializes iterator over nested ENTRYs that can match argument.
+ *
+ * Iterator returns nested ENTRYs in declaration order. Nested ENTRYs with
+ * keywords that don't match the argument are skipped. Returns BOOL_FALSE if
+ * ENTRY has no index so linear scan must be used.
+ */
+bool_t kentry_index_iter_init(const kentry_t *entry, const char *arg,
+	kentry_index_iter_t *iter)
+{
+	const kentry_index_t *index = NULL;
+	size_t begin = 0;
+	size_t end = 0;
+
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	assert(iter);
+	if (!iter)
+		return BOOL_FALSE;
+	index = entry->index;
+	if (!index || !arg)
+		return BOOL_FALSE;
+
+	// Lower bound of matched keywords
+	end = index->keywords_len;
+	while (begin < end) {
+		size_t middle = begin + (end - begin) / 2;
+		if (faux_str_casecmp(index->keywords[middle].keyword, arg) < 0)
+			begin = middle + 1;
+		else
+			end = middle;
+	}
+	// Upper bound
+	end = begin;
+	while ((end < index->keywords_len) &&
+		(faux_str_casecmp(index->keywords[end].keyword, arg) == 0))
+		end++;
+
+	iter->index = index;
+	iter->keyword = begin;
+	iter->keyword_end = end;
+	iter->other = 0;
+	iter->visited = 0;
+
+	return BOOL_TRUE;
+}
+
+
+kentry_t *kentry_index_each(kentry_index_iter_t *iter)
+{
+	const kentry_index_t *index = NULL;
+	const kentry_index_item_t *keyword = NULL;
+	const kentry_index_item_t *other = NULL;
+
+	assert(iter);
+	if (!iter)
+		return NULL;
+	index = iter->index;
+	if (!index)
+		return NULL;
+
+	if (iter->keyword < iter->keyword_end)
+		keyword = &index->keywords[iter->keyword];
+	if (iter->other < index->others_len)
+		other = &index->others[iter->other];
+
+	// Merge two lists by position to keep declaration order
+	if (keyword && (!other || (keyword->pos < other->pos))) {
+		iter->keyword++;
+		iter->visited = keyword->pos + 1;
+		return keyword->entry;
+	}
+	if (other) {
+		iter->other++;
+		iter->visited = other->pos + 1;
+		return other->entry;
+	}
+
+	return NULL;
+}
+
+
+/** @brief Checks if the last declared COMMON nested ENTRY was returned
+ * by iterator.
+ *
+ * Linear scan gets the status of the last declared nested ENTRY. If the
+ * index skipped it then the status is NOTFOUND.
+ */
+bool_t kentry_index_last_visited(const kentry_index_iter_t *iter)
+{
+	assert(iter);
+	if (!iter || !iter->index)
+		return BOOL_FALSE;
+
+	return (iter->visited == iter->index->len) ? BOOL_TRUE : BOOL_FALSE;
+}
@@ -1,9 +1,11 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
 #include <dlfcn.h>
+#include <pthread.h>
 
 #include <faux/str.h>
 #include <faux/list.h>
@@ -32,6 +34,14 @@ struct kplugin_s {
 };
 
 
+// Plugins are not thread-safe generally. They have global state, use
+// process-wide stdout or call setlocale(). So several threads serving
+// sessions within single process must not execute plugin code at the same
+// time. Lock is recursive because plugin function can execute other
+// symbols.
+static pthread_mutex_t kplugin_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+
 // Simple methods
 
 // Name
@@ -225,6 +235,8 @@ err:
 
 int kplugin_init(kplugin_t *plugin, kcontext_t *context)
 {
+	int rc = -1;
+
 	assert(plugin);
 	if (!plugin)
 		return -1;
@@ -237,12 +249,18 @@ int kplugin_init(kplugin_t *plugin, kcontext_t *context)
 	// Be sure the context type is appropriate one
 	kcontext_set_type(context, KCONTEXT_TYPE_PLUGIN_INIT);
 
-	return plugin->init_fn(context);
+	kplugin_lock();
+	rc = plugin->init_fn(context);
+	kplugin_unlock();
+
+	return rc;
 }
 
 
 int kplugin_fini(kplugin_t *plugin, kcontext_t *context)
 {
+	int rc = -1;
+
 	assert(plugin);
 	if (!plugin)
 		return -1;
@@ -255,12 +273,18 @@ int kplugin_fini(kplugin_t *plugin, kcontext_t *context)
 	// Be sure the context type is appropriate one
 	kcontext_set_type(context, KCONTEXT_TYPE_PLUGIN_FINI);
 
-	return plugin->fini_fn(context);
+	kplugin_lock();
+	rc = plugin->fini_fn(context);
+	kplugin_unlock();
+
+	return rc;
 }
 
 
 int kplugin_init_session(kplugin_t *plugin, kcontext_t *context)
 {
+	int rc = -1;
+
 	assert(plugin);
 	if (!plugin)
 		return -1;
@@ -273,12 +297,18 @@ int kplugin_init_session(kplugin_t *plugin, kcontext_t *context)
 	// Be sure the context type is appropriate one
 	kcontext_set_type(context, KCONTEXT_TYPE_PLUGIN_INIT);
 
-	return plugin->init_session_fn(context);
+	kplugin_lock();
+	rc = plugin->init_session_fn(context);
+	kplugin_unlock();
+
+	return rc;
 }
 
 
 int kplugin_fini_session(kplugin_t *plugin, kcontext_t *context)
 {
+	int rc = -1;
+
 	assert(plugin);
 	if (!plugin)
 		return -1;
@@ -291,5 +321,31 @@ int kplugin_fini_session(kplugin_t *plugin, kcontext_t *context)
 	// Be sure the context type is appropriate one
 	kcontext_set_type(context, KCONTEXT_TYPE_PLUGIN_FINI);
 
-	return plugin->fini_session_fn(context);
+	kplugin_lock();
+	rc = plugin->fini_session_fn(context);
+	kplugin_unlock();
+
+	return rc;
+}
+
+
+void kplugin_lock(void)
+{
+	pthread_mutex_lock(&kplugin_mutex);
+}
+
+
+void kplugin_unlock(void)
+{
+	pthread_mutex_unlock(&kplugin_mutex);
+}
+
+
+// Reinitializes lock within forked child. The lock can be held by thread
+// that doesn't exist within child.
+void kplugin_lock_reset(void)
+{
+	pthread_mutex_t mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+	kplugin_mutex = mutex;
 }
@@ -78,11 +78,12 @@ void kscheme_free(kscheme_t *scheme)
 	if (!scheme)
 		return;
 
-	// kustore_free() must be before plugin_free() because plugin_free()
-	// does dlclose() and ustore free function is will not be accessible
+	// kustore_free() and ENTRYs freeing must be before plugin_free()
+	// because plugin_free() does dlclose(). Free functions of ustore and
+	// of compiled ACTION data can be provided by plugins.
 	kustore_free(scheme->ustore);
-	faux_list_free(scheme->plugins);
 	faux_list_free(scheme->entrys);
+	faux_list_free(scheme->plugins);
 
 	faux_free(scheme);
 }
@@ -265,6 +266,12 @@ bool_t kscheme_prepare_action_list(kscheme_t *scheme, kentry_t *entry,
 		}
 		kaction_set_sym(action, sym);
 		kaction_set_plugin(action, plugin);
+		// Precompile script once to don't parse it on each execution
+		if (ksym_compile(sym)) {
+			kaction_set_compiled(action,
+				ksym_compile(sym)(kaction_script(action)),
+				ksym_compiled_free(sym));
+		}
 		// Filter can't contain sync symbols
 		if ((kentry_filter(entry) != KENTRY_FILTER_FALSE) &&
 			kaction_is_sync(action)) {
@@ -396,6 +403,31 @@ bool_t kscheme_prepare_entry(kscheme_t *scheme, kentry_t *entry,
 }
 
 
+// Build parser indexes: keyword dispatch indexes for SWITCH ENTRYs and
+// positions of nested ENTRYs. It's a separate pass because all ACTIONs
+// (nested PTYPEs too) must be resolved before.
+static bool_t kscheme_prepare_index(kentry_t *entry)
+{
+	kentry_entrys_node_t *iter = NULL;
+	kentry_t *nested_entry = NULL;
+
+	if (!kentry_build_index(entry))
+		return BOOL_FALSE;
+
+	// Link shares nested ENTRYs with original ENTRY. Don't process them
+	// twice. Additionally link can reference its own parent.
+	if (kentry_ref_str(entry))
+		return BOOL_TRUE;
+
+	iter = kentry_entrys_iter(entry);
+	while ((nested_entry = kentry_entrys_each(&iter)))
+		if (!kscheme_prepare_index(nested_entry))
+			return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
 /** @brief Prepares schema for execution.
  *
  * It loads plugins, link unresolved symbols, then iterates all the
@@ -423,6 +455,13 @@ bool_t kscheme_prepare(kscheme_t *scheme, kcontext_t *context, faux_error_t *err
 			return BOOL_FALSE;
 	}
 
+	// Parser indexes
+	entrys_iter = kscheme_entrys_iter(scheme);
+	while ((entry = kscheme_entrys_each(&entrys_iter))) {
+		if (!kscheme_prepare_index(entry))
+			return BOOL_FALSE;
+	}
+
 	return BOOL_TRUE;
 }
 
@@ -9,6 +9,7 @@
 #include <faux/error.h>
 #include <klish/khelper.h>
 #include <klish/ksym.h>
+#include <klish/kplugin.h>
 
 
 struct ksym_s {
@@ -17,6 +18,16 @@ struct ksym_s {
 	tri_t permanent; // Dry-run option has no effect for permanent sym
 	tri_t sync; // Don't fork before sync sym execution
 	bool_t silent; // Silent syn doesn't have stdin, stdout, stderr
+	bool_t thread_safe; // Don't serialize sym execution by threads
+	ksym_compile_fn compile; // Precompile ACTION's script
+	ksym_compiled_free_fn compiled_free; // Free precompiled object
+	ksym_stream_init_fn stream_init; // In-daemon filter: create state
+	ksym_stream_line_fn stream_line; // In-daemon filter: process line
+	ksym_stream_fini_fn stream_fini; // In-daemon filter: finish
+	ksym_job_init_fn job_init; // In-daemon job: create state
+	ksym_job_poll_fn job_poll; // In-daemon job: descriptors to poll
+	ksym_job_event_fn job_event; // In-daemon job: process events
+	ksym_job_fini_fn job_fini; // In-daemon job: finish
 };
 
 
@@ -42,6 +53,25 @@ KSET(sym, tri_t, sync);
 KGET(sym, bool_t, silent);
 KSET(sym, bool_t, silent);
 
+// Thread-safe
+KGET_BOOL(sym, thread_safe);
+KSET_BOOL(sym, thread_safe);
+
+// Compile
+KGET(sym, ksym_compile_fn, compile);
+KGET(sym, ksym_compiled_free_fn, compiled_free);
+
+// Stream
+KGET(sym, ksym_stream_init_fn, stream_init);
+KGET(sym, ksym_stream_line_fn, stream_line);
+KGET(sym, ksym_stream_fini_fn, stream_fini);
+
+// Job
+KGET(sym, ksym_job_init_fn, job_init);
+KGET(sym, ksym_job_poll_fn, job_poll);
+KGET(sym, ksym_job_event_fn, job_event);
+KGET(sym, ksym_job_fini_fn, job_fini);
+
 
 ksym_t *ksym_new(const char *name, ksym_fn function)
 {
@@ -61,6 +91,16 @@ ksym_t *ksym_new(const char *name, ksym_fn function)
 	sym->permanent = TRI_UNDEFINED;
 	sym->sync = TRI_UNDEFINED;
 	sym->silent = BOOL_FALSE;
+	sym->thread_safe = BOOL_FALSE;
+	sym->compile = NULL;
+	sym->compiled_free = NULL;
+	sym->stream_init = NULL;
+	sym->stream_line = NULL;
+	sym->stream_fini = NULL;
+	sym->job_init = NULL;
+	sym->job_poll = NULL;
+	sym->job_event = NULL;
+	sym->job_fini = NULL;
 
 	return sym;
 }
@@ -83,6 +123,96 @@ ksym_t *ksym_new_ext(const char *name, ksym_fn function,
 }
 
 
+bool_t ksym_set_compile(ksym_t *sym, ksym_compile_fn compile,
+	ksym_compiled_free_fn compiled_free)
+{
+	assert(sym);
+	if (!sym)
+		return BOOL_FALSE;
+
+	sym->compile = compile;
+	sym->compiled_free = compiled_free;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t ksym_set_stream(ksym_t *sym, ksym_stream_init_fn init,
+	ksym_stream_line_fn line, ksym_stream_fini_fn fini)
+{
+	assert(sym);
+	if (!sym)
+		return BOOL_FALSE;
+
+	sym->stream_init = init;
+	sym->stream_line = line;
+	sym->stream_fini = fini;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t ksym_is_stream(const ksym_t *sym)
+{
+	assert(sym);
+	if (!sym)
+		return BOOL_FALSE;
+
+	return (sym->stream_init && sym->stream_line && sym->stream_fini) ?
+		BOOL_TRUE : BOOL_FALSE;
+}
+
+
+bool_t ksym_set_job(ksym_t *sym, ksym_job_init_fn init,
+	ksym_job_poll_fn poll, ksym_job_event_fn event, ksym_job_fini_fn fini)
+{
+	assert(sym);
+	if (!sym)
+		return BOOL_FALSE;
+
+	sym->job_init = init;
+	sym->job_poll = poll;
+	sym->job_event = event;
+	sym->job_fini = fini;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t ksym_is_job(const ksym_t *sym)
+{
+	assert(sym);
+	if (!sym)
+		return BOOL_FALSE;
+
+	return (sym->job_init && sym->job_poll && sym->job_event &&
+		sym->job_fini) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+// Locks plugins' code execution if sym is not thread-safe
+void ksym_lock(const ksym_t *sym)
+{
+	assert(sym);
+	if (!sym)
+		return;
+
+	if (!sym->thread_safe)
+		kplugin_lock();
+}
+
+
+void ksym_unlock(const ksym_t *sym)
+{
+	assert(sym);
+	if (!sym)
+		return;
+
+	if (!sym->thread_safe)
+		kplugin_unlock();
+}
+
+
 void ksym_free(ksym_t *sym)
 {
 	if (!sym)
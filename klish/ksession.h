@@ -8,10 +8,23 @@
 
 #include <klish/kscheme.h>
 #include <klish/kpath.h>
+#include <klish/kcache.h>
+#include <klish/kudata.h>
 
 #define KSESSION_STARTING_ENTRY "main"
 
 typedef struct ksession_s ksession_t;
+typedef struct kzygote_s kzygote_t; // To use with session structure
+
+// Execution statistics of completion/help ENTRY
+typedef struct {
+	const kentry_t *entry;
+	size_t runs; // Number of executions
+	size_t timeouts; // Number of executions killed by timeout
+	unsigned int max_time; // Max execution time (ms)
+} ksession_stat_t;
+
+typedef faux_list_node_t ksession_stats_node_t;
 
 
 C_DECL_BEGIN
@@ -22,6 +35,38 @@ void ksession_free(ksession_t *session);
 kscheme_t *ksession_scheme(const ksession_t *session);
 kpath_t *ksession_path(const ksession_t *session);
 
+// PTYPE validation cache
+kcache_t *ksession_cache(const ksession_t *session);
+void ksession_cache_invalidate(ksession_t *session);
+
+// Completion/help parsing cache
+kcache_t *ksession_parse_cache(const ksession_t *session);
+const char *ksession_parse_cache_path(const ksession_t *session);
+bool_t ksession_set_parse_cache_path(ksession_t *session, const char *path);
+const char *ksession_parse_cache_line(const ksession_t *session);
+bool_t ksession_set_parse_cache_line(ksession_t *session, const char *line);
+bool_t ksession_parse_cache_active(const ksession_t *session);
+bool_t ksession_set_parse_cache_active(ksession_t *session, bool_t active);
+
+// Completion/help timeout (ms). 0 - unlimited
+unsigned int ksession_completion_timeout(const ksession_t *session);
+bool_t ksession_set_completion_timeout(ksession_t *session,
+	unsigned int completion_timeout);
+
+// Max number of completion items. 0 - unlimited
+size_t ksession_completion_max(const ksession_t *session);
+bool_t ksession_set_completion_max(ksession_t *session, size_t completion_max);
+
+// Zygote to spawn async ACTIONs. Session owns it
+kzygote_t *ksession_zygote(const ksession_t *session);
+bool_t ksession_set_zygote(ksession_t *session, kzygote_t *zygote);
+
+// Completion/help execution statistics
+bool_t ksession_stat_update(ksession_t *session, const kentry_t *entry,
+	unsigned int time, bool_t timed_out);
+ksession_stats_node_t *ksession_stats_iter(const ksession_t *session);
+ksession_stat_t *ksession_stats_each(ksession_stats_node_t **iter);
+
 // Done
 bool_t ksession_done(const ksession_t *session);
 bool_t ksession_set_done(ksession_t *session, bool_t done);
@@ -58,6 +103,16 @@ bool_t ksession_set_isatty_stdout(ksession_t *session, bool_t isatty_stdout);
 bool_t ksession_isatty_stderr(const ksession_t *session);
 bool_t ksession_set_isatty_stderr(ksession_t *session, bool_t isatty_stderr);
 
+// Session's pseudo terminal
+bool_t ksession_pty_lease(ksession_t *session, int *ptm, int *pts,
+	const char **pts_fname);
+bool_t ksession_pty_set_winsize(ksession_t *session);
+
+// Session's named user data. Plugins keep per-session state here
+bool_t ksession_named_udata_new(ksession_t *session,
+	const char *name, void *data, kudata_data_free_fn free_fn);
+void *ksession_named_udata(const ksession_t *session, const char *name);
+
 C_DECL_END
 
 #endif // _klish_ksession_h
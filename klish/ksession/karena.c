@@ -0,0 +1,214 @@
+/** @file karena.c
+ *
+ * Arena allocator for short-living objects like parsed arguments. Each
+ * allocation is a pointer increment within current chunk. New chunk is
+ * allocated when current one is exhausted. The first chunk is small because
+ * most of arenas serve a few objects only. Next chunks grow twice up to
+ * 'chunk_size'. Big objects get their own chunk.
+ * There is no way to free single object. The whole arena is freed at once.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <faux/faux.h>
+#include <klish/karena.h>
+
+// Alignment of allocated objects
+#define KARENA_ALIGN (sizeof(void *) > sizeof(long double) ? \
+	sizeof(void *) : sizeof(long double))
+#define KARENA_ALIGN_SIZE(size) \
+	(((size) + KARENA_ALIGN - 1) & ~(KARENA_ALIGN - 1))
+
+
+typedef struct karena_chunk_s karena_chunk_t;
+
+struct karena_chunk_s {
+	karena_chunk_t *next;
+	size_t size; // Size of data
+	size_t used; // Used bytes of data
+	// Aligned data follows chunk header
+};
+
+struct karena_s {
+	karena_chunk_t *chunks; // Current chunk is a head
+	size_t chunk_size; // Max size of regular chunk
+	size_t next_chunk_size; // Size of next regular chunk
+	size_t allocs; // Number of served allocations
+	size_t nchunks; // Number of real memory allocations
+	size_t used; // Total bytes given to users
+};
+
+
+static char *karena_chunk_data(karena_chunk_t *chunk)
+{
+	return (char *)chunk + KARENA_ALIGN_SIZE(sizeof(*chunk));
+}
+
+
+static karena_chunk_t *karena_chunk_new(size_t size)
+{
+	karena_chunk_t *chunk = NULL;
+
+	chunk = faux_malloc(KARENA_ALIGN_SIZE(sizeof(*chunk)) + size);
+	assert(chunk);
+	if (!chunk)
+		return NULL;
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+
+karena_t *karena_new(size_t chunk_size)
+{
+	karena_t *arena = NULL;
+
+	arena = faux_zmalloc(sizeof(*arena));
+	assert(arena);
+	if (!arena)
+		return NULL;
+
+	// Initialize
+	arena->chunks = NULL;
+	arena->chunk_size = chunk_size ? chunk_size : KARENA_DEFAULT_CHUNK_SIZE;
+	arena->next_chunk_size = KARENA_MIN_CHUNK_SIZE;
+	if (arena->next_chunk_size > arena->chunk_size)
+		arena->next_chunk_size = arena->chunk_size;
+	arena->allocs = 0;
+	arena->nchunks = 0;
+	arena->used = 0;
+
+	return arena;
+}
+
+
+void karena_free(karena_t *arena)
+{
+	karena_chunk_t *chunk = NULL;
+
+	if (!arena)
+		return;
+
+	chunk = arena->chunks;
+	while (chunk) {
+		karena_chunk_t *next = chunk->next;
+		faux_free(chunk);
+		chunk = next;
+	}
+
+	faux_free(arena);
+}
+
+
+/** @brief Allocates zeroed memory within arena.
+ */
+void *karena_alloc(karena_t *arena, size_t size)
+{
+	karena_chunk_t *chunk = NULL;
+	char *ptr = NULL;
+
+	assert(arena);
+	if (!arena)
+		return NULL;
+
+	size = KARENA_ALIGN_SIZE(size ? size : 1);
+	chunk = arena->chunks;
+
+	if (!chunk || ((chunk->size - chunk->used) < size)) {
+		// Big object gets its own chunk. Don't make it current because
+		// current chunk can still have a free space.
+		if (size > (arena->chunk_size / 4)) {
+			karena_chunk_t *big = karena_chunk_new(size);
+			if (!big)
+				return NULL;
+			big->used = size;
+			if (chunk) {
+				big->next = chunk->next;
+				chunk->next = big;
+			} else {
+				arena->chunks = big;
+			}
+			arena->nchunks++;
+			arena->allocs++;
+			arena->used += size;
+			ptr = karena_chunk_data(big);
+			memset(ptr, 0, size);
+			return ptr;
+		}
+		// Small chunk can be not enough for the object
+		while (arena->next_chunk_size < size)
+			arena->next_chunk_size *= 2;
+		chunk = karena_chunk_new(arena->next_chunk_size);
+		if (!chunk)
+			return NULL;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		arena->nchunks++;
+		if (arena->next_chunk_size < arena->chunk_size) {
+			arena->next_chunk_size *= 2;
+			if (arena->next_chunk_size > arena->chunk_size)
+				arena->next_chunk_size = arena->chunk_size;
+		}
+	}
+
+	ptr = karena_chunk_data(chunk) + chunk->used;
+	chunk->used += size;
+	arena->allocs++;
+	arena->used += size;
+	memset(ptr, 0, size);
+
+	return ptr;
+}
+
+
+char *karena_str_dup(karena_t *arena, const char *str)
+{
+	size_t len = 0;
+	char *dst = NULL;
+
+	if (!str)
+		return NULL;
+
+	len = strlen(str);
+	dst = karena_alloc(arena, len + 1);
+	if (!dst)
+		return NULL;
+	memcpy(dst, str, len + 1);
+
+	return dst;
+}
+
+
+size_t karena_allocs(const karena_t *arena)
+{
+	assert(arena);
+	if (!arena)
+		return 0;
+
+	return arena->allocs;
+}
+
+
+size_t karena_chunks(const karena_t *arena)
+{
+	assert(arena);
+	if (!arena)
+		return 0;
+
+	return arena->nchunks;
+}
+
+
+size_t karena_used(const karena_t *arena)
+{
+	assert(arena);
+	if (!arena)
+		return 0;
+
+	return arena->used;
+}
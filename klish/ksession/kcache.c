@@ -0,0 +1,314 @@
+/** @file kcache.c
+ *
+ * PTYPE validation results cache. Records are found by hash table. The
+ * stored hash is compared before strings. Records are linked to the
+ * recency list too. The most recently used record is a list tail. So the
+ * list head will be removed on overflow. All operations are O(1).
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kcache.h>
+
+// Max number of hash buckets
+#define KCACHE_BUCKETS_MAX 1024
+
+
+typedef struct kcache_rec_s kcache_rec_t;
+
+struct kcache_rec_s {
+	const void *ptype; // Don't free. Just a key
+	char *value; // Candidate value
+	char *key; // Serialized parent pargv
+	uint32_t hash; // Hash of ptype, value and key
+	struct timespec expire; // Zero means infinite
+	int retcode;
+	char *out; // Normalized value
+	kcache_rec_t *hnext; // Next record within hash bucket
+	kcache_rec_t *prev; // Less recently used record
+	kcache_rec_t *next; // More recently used record
+};
+
+struct kcache_s {
+	kcache_rec_t **buckets;
+	size_t buckets_num; // Power of 2
+	kcache_rec_t *head; // Least recently used record
+	kcache_rec_t *tail; // Most recently used record
+	size_t len;
+	size_t max_len;
+};
+
+
+static void kcache_rec_free(kcache_rec_t *rec)
+{
+	if (!rec)
+		return;
+
+	faux_str_free(rec->value);
+	faux_str_free(rec->key);
+	faux_str_free(rec->out);
+	faux_free(rec);
+}
+
+
+// FNV-1a
+static uint32_t kcache_hash_add(uint32_t hash, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	size_t i = 0;
+
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+static uint32_t kcache_hash(const void *ptype, const char *value,
+	const char *key)
+{
+	uint32_t hash = 2166136261u;
+
+	hash = kcache_hash_add(hash, &ptype, sizeof(ptype));
+	// Include '\0' to separate value and key
+	hash = kcache_hash_add(hash, value, strlen(value) + 1);
+	hash = kcache_hash_add(hash, key, strlen(key));
+
+	return hash;
+}
+
+
+static kcache_rec_t **kcache_bucket(kcache_t *cache, uint32_t hash)
+{
+	return &cache->buckets[hash & (cache->buckets_num - 1)];
+}
+
+
+// Links record as the most recently used one
+static void kcache_lru_link(kcache_t *cache, kcache_rec_t *rec)
+{
+	rec->prev = cache->tail;
+	rec->next = NULL;
+	if (cache->tail)
+		cache->tail->next = rec;
+	else
+		cache->head = rec;
+	cache->tail = rec;
+}
+
+
+static void kcache_lru_unlink(kcache_t *cache, kcache_rec_t *rec)
+{
+	if (rec->prev)
+		rec->prev->next = rec->next;
+	else
+		cache->head = rec->next;
+	if (rec->next)
+		rec->next->prev = rec->prev;
+	else
+		cache->tail = rec->prev;
+	rec->prev = NULL;
+	rec->next = NULL;
+}
+
+
+// Removes record from hash table and recency list and frees it
+static void kcache_rec_del(kcache_t *cache, kcache_rec_t *rec)
+{
+	kcache_rec_t **link = kcache_bucket(cache, rec->hash);
+
+	while (*link != rec)
+		link = &(*link)->hnext;
+	*link = rec->hnext;
+	kcache_lru_unlink(cache, rec);
+	cache->len--;
+	kcache_rec_free(rec);
+}
+
+
+static bool_t kcache_rec_expired(const kcache_rec_t *rec,
+	const struct timespec *now)
+{
+	if ((0 == rec->expire.tv_sec) && (0 == rec->expire.tv_nsec))
+		return BOOL_FALSE;
+	if (now->tv_sec != rec->expire.tv_sec)
+		return (now->tv_sec > rec->expire.tv_sec) ? BOOL_TRUE : BOOL_FALSE;
+
+	return (now->tv_nsec >= rec->expire.tv_nsec) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+kcache_t *kcache_new(size_t max_len)
+{
+	kcache_t *cache = NULL;
+
+	cache = faux_zmalloc(sizeof(*cache));
+	assert(cache);
+	if (!cache)
+		return NULL;
+
+	// Initialize
+	cache->max_len = max_len;
+	cache->buckets_num = 1;
+	while ((cache->buckets_num < max_len) &&
+		(cache->buckets_num < KCACHE_BUCKETS_MAX))
+		cache->buckets_num <<= 1;
+	cache->buckets = faux_zmalloc(cache->buckets_num *
+		sizeof(*cache->buckets));
+	assert(cache->buckets);
+	cache->head = NULL;
+	cache->tail = NULL;
+	cache->len = 0;
+
+	return cache;
+}
+
+
+void kcache_free(kcache_t *cache)
+{
+	if (!cache)
+		return;
+
+	kcache_clear(cache);
+	faux_free(cache->buckets);
+
+	faux_free(cache);
+}
+
+
+/** @brief Finds cached validation result.
+ *
+ * Found record becomes the most recently used. Expired record is removed.
+ * Output string belongs to cache and is valid until next cache operation.
+ */
+bool_t kcache_find(kcache_t *cache, const void *ptype, const char *value,
+	const char *key, int *retcode, const char **out)
+{
+	kcache_rec_t *rec = NULL;
+	uint32_t hash = 0;
+	struct timespec now = {};
+
+	assert(cache);
+	if (!cache)
+		return BOOL_FALSE;
+	if (!value)
+		return BOOL_FALSE;
+	if (!key)
+		key = "";
+
+	hash = kcache_hash(ptype, value, key);
+	for (rec = *kcache_bucket(cache, hash); rec; rec = rec->hnext) {
+		if ((rec->hash == hash) &&
+			(rec->ptype == ptype) &&
+			(strcmp(rec->value, value) == 0) &&
+			(strcmp(rec->key, key) == 0))
+			break;
+	}
+	if (!rec)
+		return BOOL_FALSE;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (kcache_rec_expired(rec, &now)) {
+		kcache_rec_del(cache, rec);
+		return BOOL_FALSE;
+	}
+
+	// Move record to the tail
+	kcache_lru_unlink(cache, rec);
+	kcache_lru_link(cache, rec);
+
+	if (retcode)
+		*retcode = rec->retcode;
+	if (out)
+		*out = rec->out;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Adds validation result to cache.
+ *
+ * @param [in] ttl Time to live in milliseconds or KCACHE_TTL_INFINITE.
+ */
+bool_t kcache_add(kcache_t *cache, const void *ptype, const char *value,
+	const char *key, unsigned int ttl, int retcode, const char *out)
+{
+	kcache_rec_t *rec = NULL;
+	kcache_rec_t **bucket = NULL;
+
+	assert(cache);
+	if (!cache)
+		return BOOL_FALSE;
+	if (!value)
+		return BOOL_FALSE;
+	if (0 == cache->max_len)
+		return BOOL_FALSE;
+
+	// Remove least recently used records
+	while (cache->head && (cache->len >= cache->max_len))
+		kcache_rec_del(cache, cache->head);
+
+	rec = faux_zmalloc(sizeof(*rec));
+	assert(rec);
+	rec->ptype = ptype;
+	rec->value = faux_str_dup(value);
+	rec->key = faux_str_dup(key ? key : "");
+	rec->hash = kcache_hash(ptype, rec->value, rec->key);
+	rec->retcode = retcode;
+	rec->out = faux_str_dup(out);
+	if (ttl != KCACHE_TTL_INFINITE) {
+		clock_gettime(CLOCK_MONOTONIC, &rec->expire);
+		rec->expire.tv_sec += ttl / 1000;
+		rec->expire.tv_nsec += (long)(ttl % 1000) * 1000000l;
+		if (rec->expire.tv_nsec >= 1000000000l) {
+			rec->expire.tv_sec++;
+			rec->expire.tv_nsec -= 1000000000l;
+		}
+	}
+
+	bucket = kcache_bucket(cache, rec->hash);
+	rec->hnext = *bucket;
+	*bucket = rec;
+	kcache_lru_link(cache, rec);
+	cache->len++;
+
+	return BOOL_TRUE;
+}
+
+
+void kcache_clear(kcache_t *cache)
+{
+	kcache_rec_t *rec = NULL;
+
+	assert(cache);
+	if (!cache)
+		return;
+
+	rec = cache->head;
+	while (rec) {
+		kcache_rec_t *next = rec->next;
+		kcache_rec_free(rec);
+		rec = next;
+	}
+	memset(cache->buckets, 0, cache->buckets_num * sizeof(*cache->buckets));
+	cache->head = NULL;
+	cache->tail = NULL;
+	cache->len = 0;
+}
+
+
+size_t kcache_len(const kcache_t *cache)
+{
+	assert(cache);
+	if (!cache)
+		return 0;
+
+	return cache->len;
+}
@@ -0,0 +1,193 @@
+/** @file kcompl.c
+ *
+ * Completion collector. Items are sorted by text and unique. The items
+ * that don't match the prefix are dropped. When collector is full the
+ * generation of completions can be stopped.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <faux/str.h>
+#include <faux/list.h>
+#include <klish/khelper.h>
+#include <klish/kcompl.h>
+
+
+struct kcompl_item_s {
+	const kentry_t *entry; // Candidate entry item belongs to. Don't free
+	char *text; // Full text of item (including prefix)
+	char *help; // Optional help string
+};
+
+
+struct kcompl_s {
+	char *prefix; // Typed part of the last argument
+	size_t prefix_len;
+	size_t max_len; // 0 - unlimited
+	bool_t is_full; // Some items were dropped because of max_len
+	pid_t pid; // Owner process. Forked children can't use collector
+	faux_list_t *items;
+};
+
+
+// Prefix
+KGET_STR(compl, prefix);
+
+// Max length
+KGET(compl, size_t, max_len);
+
+// Owner process
+KGET(compl, pid_t, pid);
+
+// Is full
+KGET_BOOL(compl, is_full);
+
+// Items
+KNESTED_LEN(compl, items);
+KNESTED_ITER(compl, items);
+KNESTED_EACH(compl, kcompl_item_t *, items);
+
+
+// Item's candidate entry
+KGET(compl_item, const kentry_t *, entry);
+
+// Item's full text
+KGET_STR(compl_item, text);
+
+// Item's help
+KGET_STR(compl_item, help);
+
+
+static int kcompl_item_compare(const void *first, const void *second)
+{
+	const kcompl_item_t *f = (const kcompl_item_t *)first;
+	const kcompl_item_t *s = (const kcompl_item_t *)second;
+
+	return strcmp(f->text, s->text);
+}
+
+
+static int kcompl_item_kcompare(const void *key, const void *list_item)
+{
+	const char *f = (const char *)key;
+	const kcompl_item_t *s = (const kcompl_item_t *)list_item;
+
+	return strcmp(f, s->text);
+}
+
+
+static void kcompl_item_free(void *data)
+{
+	kcompl_item_t *item = (kcompl_item_t *)data;
+
+	if (!item)
+		return;
+
+	faux_str_free(item->text);
+	faux_str_free(item->help);
+	faux_free(item);
+}
+
+
+kcompl_t *kcompl_new(const char *prefix, size_t max_len)
+{
+	kcompl_t *compl = NULL;
+
+	compl = faux_zmalloc(sizeof(*compl));
+	assert(compl);
+	if (!compl)
+		return NULL;
+
+	// Initialize
+	compl->prefix = faux_str_dup(prefix ? prefix : "");
+	compl->prefix_len = strlen(compl->prefix);
+	compl->max_len = max_len;
+	compl->is_full = BOOL_FALSE;
+	compl->pid = getpid();
+	compl->items = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
+		kcompl_item_compare, kcompl_item_kcompare, kcompl_item_free);
+	assert(compl->items);
+
+	return compl;
+}
+
+
+void kcompl_free(kcompl_t *compl)
+{
+	if (!compl)
+		return;
+
+	faux_list_free(compl->items);
+	faux_str_free(compl->prefix);
+
+	faux_free(compl);
+}
+
+
+/** @brief Adds completion item.
+ *
+ * Items that don't match prefix and duplicates are silently ignored.
+ *
+ * @return BOOL_FALSE if collector is full so generation can be stopped.
+ */
+bool_t kcompl_add(kcompl_t *compl, const kentry_t *entry,
+	const char *text, const char *help)
+{
+	kcompl_item_t *item = NULL;
+
+	assert(compl);
+	if (!compl)
+		return BOOL_FALSE;
+	if (!text)
+		return BOOL_TRUE;
+
+	if ((compl->prefix_len > 0) &&
+		(strncmp(compl->prefix, text, compl->prefix_len) != 0))
+		return BOOL_TRUE;
+	if (faux_list_kfind(compl->items, text))
+		return BOOL_TRUE;
+	if ((compl->max_len > 0) &&
+		((size_t)faux_list_len(compl->items) >= compl->max_len)) {
+		compl->is_full = BOOL_TRUE;
+		return BOOL_FALSE;
+	}
+
+	item = faux_zmalloc(sizeof(*item));
+	assert(item);
+	if (!item)
+		return BOOL_FALSE;
+	item->entry = entry;
+	item->text = faux_str_dup(text);
+	item->help = faux_str_dup(help);
+	if (!faux_list_add(compl->items, item))
+		kcompl_item_free(item);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Adds completion items from text output.
+ *
+ * It's a fallback for syms that print newline-separated completions.
+ */
+bool_t kcompl_add_text(kcompl_t *compl, const kentry_t *entry, const char *out)
+{
+	const char *str = out;
+	char *l = NULL;
+	bool_t res = BOOL_TRUE;
+
+	assert(compl);
+	if (!compl)
+		return BOOL_FALSE;
+
+	while (res && (l = faux_str_getline(str, &str))) {
+		res = kcompl_add(compl, entry, l, NULL);
+		faux_str_free(l);
+	}
+
+	return res;
+}
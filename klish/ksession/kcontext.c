@@ -8,6 +8,7 @@
 #include <faux/str.h>
 #include <faux/conv.h>
 #include <faux/list.h>
+#include <faux/file.h>
 #include <klish/khelper.h>
 #include <klish/kpargv.h>
 #include <klish/kcontext.h>
@@ -28,11 +29,14 @@ struct kcontext_s {
 	const kpargv_t *parent_pargv; // Parent
 	const kcontext_t *parent_context; // Parent context (if available)
 	const kexec_t *parent_exec; // Parent exec (if available)
+	kparg_t *candidate_parg; // Overrides parent pargv's candidate. Don't free
 	faux_list_node_t *action_iter; // Current action
 	ksym_t *sym;
 	int stdin;
 	int stdout;
 	int stderr;
+	int capture_out; // Output of in-daemon sym. Don't close
+	int capture_err;
 	faux_buf_t *bufout; // Don't free. Just a link
 	faux_buf_t *buferr; // Don't free. Just a link
 	pid_t pid;
@@ -80,6 +84,9 @@ FAUX_HIDDEN KSET(context, const kcontext_t *, parent_context);
 KGET(context, const kexec_t *, parent_exec);
 FAUX_HIDDEN KSET(context, const kexec_t *, parent_exec);
 
+// Own candidate parg
+FAUX_HIDDEN KSET(context, kparg_t *, candidate_parg);
+
 // Action iterator
 KGET(context, faux_list_node_t *, action_iter);
 FAUX_HIDDEN KSET(context, faux_list_node_t *, action_iter);
@@ -96,6 +103,46 @@ FAUX_HIDDEN KSET(context, int, stdout);
 KGET(context, int, stderr);
 FAUX_HIDDEN KSET(context, int, stderr);
 
+int kcontext_fdout(const kcontext_t *context)
+{
+	assert(context);
+	if (!context)
+		return -1;
+
+	if (context->capture_out >= 0)
+		return context->capture_out;
+
+	return STDOUT_FILENO;
+}
+
+
+int kcontext_fderr(const kcontext_t *context)
+{
+	assert(context);
+	if (!context)
+		return -1;
+
+	if (context->capture_err >= 0)
+		return context->capture_err;
+
+	return STDERR_FILENO;
+}
+
+
+FAUX_HIDDEN bool_t kcontext_set_capture(kcontext_t *context,
+	int capture_out, int capture_err)
+{
+	assert(context);
+	if (!context)
+		return BOOL_FALSE;
+
+	context->capture_out = capture_out;
+	context->capture_err = capture_err;
+
+	return BOOL_TRUE;
+}
+
+
 // bufout
 KGET(context, faux_buf_t *, bufout);
 FAUX_HIDDEN KSET(context, faux_buf_t *, bufout);
@@ -147,11 +194,14 @@ kcontext_t *kcontext_new(kcontext_type_e type)
 	context->parent_pargv = NULL; // Don't free
 	context->parent_context = NULL; // Don't free
 	context->parent_exec = NULL; // Don't free
+	context->candidate_parg = NULL; // Don't free
 	context->action_iter = NULL;
 	context->sym = NULL;
 	context->stdin = -1;
 	context->stdout = -1;
 	context->stderr = -1;
+	context->capture_out = -1;
+	context->capture_err = -1;
 	context->bufout = NULL;
 	context->buferr = NULL;
 	context->pid = -1; // PID of currently executed ACTION
@@ -192,6 +242,9 @@ kparg_t *kcontext_candidate_parg(const kcontext_t *context)
 	assert(context);
 	if (!context)
 		return NULL;
+	// Concurrently executed contexts can't share parent pargv's candidate
+	if (context->candidate_parg)
+		return context->candidate_parg;
 	pargv = kcontext_parent_pargv(context);
 	if (!pargv)
 		return NULL;
@@ -230,6 +283,62 @@ const char *kcontext_candidate_value(const kcontext_t *context)
 }
 
 
+/** @brief Gets typed part of the argument to complete.
+ *
+ * It's for completion and help syms.
+ */
+const char *kcontext_prefix(const kcontext_t *context)
+{
+	const char *prefix = NULL;
+
+	assert(context);
+	if (!context)
+		return NULL;
+	prefix = kcontext_candidate_value(context);
+
+	return prefix ? prefix : "";
+}
+
+
+/** @brief Adds completion item for completion and help syms.
+ *
+ * Item is stored to completion collector of parent pargv directly. So
+ * items that don't match the prefix are not transferred at all. The help
+ * is optional. Collector is unavailable within forked process (async
+ * ACTION) or if there is no collector at all. Then the text fallback is
+ * used i.e. the item line (and help line if specified) is printed.
+ *
+ * @return BOOL_FALSE if collector is full and generation can be stopped.
+ */
+bool_t kcontext_add_completion(kcontext_t *context, const char *text,
+	const char *help)
+{
+	const kpargv_t *pargv = NULL;
+	kcompl_t *compl = NULL;
+
+	assert(context);
+	if (!context)
+		return BOOL_FALSE;
+	if (!text)
+		return BOOL_TRUE;
+
+	pargv = kcontext_parent_pargv(context);
+	if (pargv)
+		compl = kpargv_compl(pargv);
+	if (compl && (kcompl_pid(compl) == getpid()))
+		return kcompl_add(compl, kcontext_candidate_entry(context),
+			text, help);
+
+	// Text fallback
+	if (help)
+		kcontext_printf(context, "%s\n%s\n", text, help);
+	else
+		kcontext_printf(context, "%s\n", text);
+
+	return BOOL_TRUE;
+}
+
+
 const kaction_t *kcontext_action(const kcontext_t *context)
 {
 	faux_list_node_t *node = NULL;
@@ -262,6 +371,22 @@ const char *kcontext_script(const kcontext_t *context)
 }
 
 
+void *kcontext_compiled(const kcontext_t *context)
+{
+	const kaction_t *action = NULL;
+
+	assert(context);
+	if (!context)
+		return NULL;
+
+	action = kcontext_action(context);
+	if (!action)
+		return NULL;
+
+	return kaction_compiled(action);
+}
+
+
 bool_t kcontext_named_udata_new(kcontext_t *context,
 	const char *name, void *data, kudata_data_free_fn free_fn)
 {
@@ -283,6 +408,31 @@ void *kcontext_named_udata(const kcontext_t *context, const char *name)
 }
 
 
+bool_t kcontext_session_udata_new(kcontext_t *context,
+	const char *name, void *data, kudata_data_free_fn free_fn)
+{
+	assert(context);
+	if (!context)
+		return BOOL_FALSE;
+	if (!context->session)
+		return BOOL_FALSE;
+
+	return ksession_named_udata_new(context->session, name, data, free_fn);
+}
+
+
+void *kcontext_session_udata(const kcontext_t *context, const char *name)
+{
+	assert(context);
+	if (!context)
+		return NULL;
+	if (!context->session)
+		return NULL;
+
+	return ksession_named_udata(context->session, name);
+}
+
+
 void *kcontext_udata(const kcontext_t *context)
 {
 	kplugin_t *plugin = NULL;
@@ -345,6 +495,7 @@ static int kcontext_vprintf(const kcontext_t *context,
 	faux_buf_t *buf = NULL;
 	int rc = -1;
 	FILE *f = NULL;
+	int capture = -1;
 
 	if (!context)
 		return -1;
@@ -358,9 +509,11 @@ static int kcontext_vprintf(const kcontext_t *context,
 	if (is_stderr) {
 		buf = kcontext_buferr(context);
 		f = stderr;
+		capture = context->capture_err;
 	} else {
 		buf = kcontext_bufout(context);
 		f = stdout;
+		capture = context->capture_out;
 	}
 
 	// "Silent" output
@@ -374,6 +527,12 @@ static int kcontext_vprintf(const kcontext_t *context,
 		if (rc > 0)
 			faux_buf_write(buf, line, rc);
 		faux_str_free(line);
+	// Thread-safe sync sym. Process-wide stdout is not redirected.
+	} else if (capture >= 0) {
+		char *line = NULL;
+		line = faux_str_vsprintf(fmt, ap);
+		rc = faux_write_block(capture, line, strlen(line));
+		faux_str_free(line);
 	} else {
 		rc = vfprintf(f, fmt, ap);
 		fflush(f);
@@ -407,3 +566,67 @@ int kcontext_printf_err(const kcontext_t *context, const char *fmt, ...)
 
 	return rc;
 }
+
+
+/** @brief Executes silent sync ACTIONs of command without kexec_t.
+ *
+ * It's a fast path for service entries like PTYPEs and CONDitions. All
+ * ACTIONs of the command must be sync and silent (see
+ * kentry_actions_are_silent()). So there is no need to fork, to create pipes
+ * and event loop. The functions are called directly and output is written
+ * to the bufout. Context is allocated on the stack and lives while function
+ * is executed only.
+ */
+FAUX_HIDDEN bool_t kcontext_exec_silent(ksession_t *session, kpargv_t *pargv,
+	const kpargv_t *parent_pargv, const kcontext_t *parent_context,
+	const kexec_t *parent_exec, faux_buf_t *bufout, int *retcode)
+{
+	kcontext_t context = {};
+	faux_list_node_t *iter = NULL;
+
+	assert(pargv);
+	if (!pargv)
+		return BOOL_FALSE;
+	if (!kpargv_command(pargv))
+		return BOOL_FALSE;
+
+	context.type = KCONTEXT_TYPE_SERVICE_ACTION;
+	context.scheme = session ? ksession_scheme(session) : NULL;
+	context.retcode = 0;
+	context.session = session;
+	context.pargv = pargv; // Don't free. Caller owns it
+	context.parent_pargv = parent_pargv;
+	context.parent_context = parent_context;
+	context.parent_exec = parent_exec;
+	context.stdin = -1;
+	context.stdout = -1;
+	context.stderr = -1;
+	context.capture_out = -1;
+	context.capture_err = -1;
+	context.bufout = bufout;
+	context.pid = -1;
+	context.is_last_pipeline_stage = BOOL_TRUE;
+
+	iter = faux_list_head(kentry_actions(kpargv_command(pargv)));
+	while (iter) {
+		const kaction_t *action = (const kaction_t *)faux_list_data(iter);
+		ksym_t *sym = kaction_sym(action);
+		int exitcode = 0;
+
+		context.action_iter = iter;
+		iter = faux_list_next_node(iter);
+		if (!kaction_meet_exec_conditions(action, context.retcode))
+			continue;
+		ksym_lock(sym);
+		exitcode = ksym_function(sym)(&context);
+		ksym_unlock(sym);
+		if (kaction_update_retcode(action))
+			context.retcode = exitcode;
+	}
+	context.done = BOOL_TRUE;
+
+	if (retcode)
+		*retcode = context.retcode;
+
+	return BOOL_TRUE;
+}
@@ -1,5 +1,6 @@
 /** @file kexec.c
  */
+#define _GNU_SOURCE
 #define _XOPEN_SOURCE
 #define _XOPEN_SOURCE_EXTENDED
 #include <stdlib.h>
@@ -14,6 +15,12 @@
 #include <termios.h>
 #include <signal.h>
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <dirent.h>
 
 #include <faux/list.h>
 #include <faux/buf.h>
@@ -22,14 +29,26 @@
 #include <klish/kcontext.h>
 #include <klish/kpath.h>
 #include <klish/kexec.h>
+#include <klish/kzygote.h>
+#include <klish/kplugin.h>
+
+
+// PID of context while in-daemon stream stage is active. The waitpid()
+// never reports PID 0.
+#define KEXEC_STREAM_PID 0
+// Stream stage doesn't read input while output buffer is so long
+#define KEXEC_STREAM_BUF_LIMIT 65536
+// PID of context while the rest of sync ACTION's output is written by event
+// loop. Context can't have active stream stage at the same time.
+#define KEXEC_DRAIN_PID 0
+// PID of context while in-daemon job is active
+#define KEXEC_JOB_PID 0
+// Max number of descriptors in-daemon job can wait for
+#define KEXEC_JOB_FDS_MAX 8
+// Interrupt symbol (^C) got from terminal
+#define KEXEC_JOB_INTERRUPT 0x03
 
 
-#define PTMX_PATH "/dev/ptmx"
-
-
-// Declaration of grabber. Implementation is in the grabber.c
-void grabber(int fds[][2]);
-
 struct kexec_s {
 	kcontext_type_e type; // Common ACTIONs or service ACTIONs
 	ksession_t *session;
@@ -37,6 +56,7 @@ struct kexec_s {
 	bool_t dry_run;
 	int stdin;
 	int stdout;
+	bool_t stdout_held; // Owner reads stdout pipe directly
 	int stderr;
 	faux_buf_t *bufin;
 	faux_buf_t *bufout;
@@ -45,8 +65,81 @@ struct kexec_s {
 	char *pts_fname; // Pseudoterminal slave file name
 	int pts; // Pseudoterminal slave handler
 	char *line; // Full command to execute (text)
+	faux_eloop_t *eloop; // Event loop to watch for processes and streams
+	kexec_event_fn event_cb; // Process is terminated or stream is done
+	void *event_udata;
+	faux_list_t *streams; // Active in-daemon stream stages
+	faux_list_t *drains; // Sync ACTIONs' output that is not written yet
+	faux_list_t *jobs; // Active in-daemon jobs
+	faux_list_t *children; // Forked processes that are not waited yet
 };
 
+
+// Forked process of ACTION
+typedef struct kexec_child_s {
+	kexec_t *exec;
+	kcontext_t *context;
+	pid_t pid; // -1 if process is already waited
+	int pidfd; // -1 if pidfd is not supported
+} kexec_child_t;
+
+static void kexec_child_free(kexec_child_t *child);
+
+
+// In-daemon stream stage
+typedef struct kexec_stream_s {
+	kexec_t *exec;
+	kcontext_t *context;
+	const ksym_t *sym;
+	void *state; // Filter's state. NULL when filter is finished
+	int fdin;
+	int fdout;
+	int fdin_flags; // Saved file status flags
+	int fdout_flags;
+	faux_buf_t *bufin;
+	faux_buf_t *bufout;
+	char *line; // Incomplete line
+	size_t line_len;
+	size_t line_size;
+	bool_t eof; // Input is over. Only output remains
+	int retcode;
+} kexec_stream_t;
+
+static void kexec_stream_free(kexec_stream_t *stream);
+
+
+// The rest of sync ACTION's output that doesn't fit into the pipe
+typedef struct kexec_drain_s {
+	kexec_t *exec;
+	kcontext_t *context;
+	int fdout; // Own dup()ed fds. Other watchers can use the original ones
+	int fderr;
+	faux_buf_t *bufout;
+	faux_buf_t *buferr;
+} kexec_drain_t;
+
+static void kexec_drain_free(kexec_drain_t *drain);
+
+
+// In-daemon job
+typedef struct kexec_job_s {
+	kexec_t *exec;
+	kcontext_t *context;
+	const ksym_t *sym;
+	void *state; // Job's state. NULL when job is finished
+	struct pollfd fds[KEXEC_JOB_FDS_MAX]; // Job's descriptors within eloop
+	size_t fds_num;
+	int fdin; // Terminal to get interrupt from
+	struct termios fdin_termios; // Saved terminal settings
+	int fdout; // Own dup()ed fds. Other watchers can use the original ones
+	int fderr;
+	faux_buf_t *bufout;
+	faux_buf_t *buferr;
+	int retcode;
+} kexec_job_t;
+
+static void kexec_job_free(kexec_job_t *job);
+
 // Dry-run
 KGET_BOOL(exec, dry_run);
 KSET_BOOL(exec, dry_run);
@@ -58,6 +151,8 @@ KSET(exec, int, stdin);
 // STDOUT
 KGET(exec, int, stdout);
 KSET(exec, int, stdout);
+KGET_BOOL(exec, stdout_held);
+KSET_BOOL(exec, stdout_held);
 
 // STDERR
 KGET(exec, int, stderr);
@@ -82,6 +177,9 @@ KGET(exec, kpath_t *, saved_path);
 KGET_STR(exec, line);
 KSET_STR(exec, line);
 
+// Eloop
+KGET(exec, faux_eloop_t *, eloop);
+
 // CONTEXT list
 KADD_NESTED(exec, kcontext_t *, contexts);
 KNESTED_LEN(exec, contexts);
@@ -114,15 +212,39 @@ kexec_t *kexec_new(ksession_t *session, kcontext_type_e type)
 	exec->dry_run = BOOL_FALSE;
 	exec->saved_path = NULL;
 	exec->line = NULL;
+	exec->eloop = NULL;
+	exec->event_cb = NULL;
+	exec->event_udata = NULL;
 
 	// List of execute contexts
 	exec->contexts = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
 		NULL, NULL, (void (*)(void *))kcontext_free);
 	assert(exec->contexts);
 
+	// List of in-daemon stream stages
+	exec->streams = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))kexec_stream_free);
+	assert(exec->streams);
+
+	// List of sync ACTIONs' output to write
+	exec->drains = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))kexec_drain_free);
+	assert(exec->drains);
+
+	// List of in-daemon jobs
+	exec->jobs = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))kexec_job_free);
+	assert(exec->jobs);
+
+	// List of forked processes
+	exec->children = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))kexec_child_free);
+	assert(exec->children);
+
 	// I/O
 	exec->stdin = -1;
 	exec->stdout = -1;
+	exec->stdout_held = BOOL_FALSE;
 	exec->stderr = -1;
 
 	exec->bufin = faux_buf_new(0);
@@ -142,6 +264,12 @@ void kexec_free(kexec_t *exec)
 	if (!exec)
 		return;
 
+	// Streams use contexts' fds so free them first
+	faux_list_free(exec->streams);
+	faux_list_free(exec->drains);
+	faux_list_free(exec->jobs);
+	// Abandoned processes are killed
+	faux_list_free(exec->children);
 	faux_list_free(exec->contexts);
 
 	if (exec->stdin != -1)
@@ -274,33 +402,67 @@ bool_t kexec_add(kexec_t *exec, kcontext_t *context)
 }
 
 
-bool_t kexec_set_winsize(kexec_t *exec)
+static bool_t kexec_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t drain_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static void stream_move(kexec_stream_t *stream, faux_eloop_t *eloop);
+static void job_move(kexec_job_t *job, faux_eloop_t *eloop);
+
+
+// Event loop can be changed (or removed before eloop freeing) while
+// processes are running. So move pidfds, unwritten output, in-daemon
+// streams and jobs to the new one.
+bool_t kexec_set_eloop(kexec_t *exec, faux_eloop_t *eloop,
+	kexec_event_fn event_cb, void *udata)
 {
-	size_t width = 0;
-	size_t height = 0;
-	struct winsize ws = {};
-	int res = -1;
+	faux_list_node_t *iter = NULL;
+	kexec_child_t *child = NULL;
+	kexec_drain_t *drain = NULL;
+	kexec_stream_t *stream = NULL;
+	kexec_job_t *job = NULL;
 
+	assert(exec);
 	if (!exec)
 		return BOOL_FALSE;
-	if (exec->pts < 0)
-		return BOOL_FALSE;
-	if (!isatty(exec->pts))
-		return BOOL_FALSE;
-	if (!exec->session)
-		return BOOL_FALSE;
 
-	// Set pseudo terminal window size
-	width = ksession_term_width(exec->session);
-	height = ksession_term_height(exec->session);
-	if ((width == 0) || (height == 0))
-		return BOOL_FALSE;
+	iter = faux_list_head(exec->children);
+	while ((child = (kexec_child_t *)faux_list_each(&iter))) {
+		if (child->pidfd < 0)
+			continue;
+		if (exec->eloop)
+			faux_eloop_del_fd(exec->eloop, child->pidfd);
+		if (eloop)
+			faux_eloop_add_fd(eloop, child->pidfd, POLLIN,
+				kexec_child_ev, child);
+	}
 
-	ws.ws_col = (unsigned short)width;
-	ws.ws_row = (unsigned short)height;
-	res = ioctl(exec->pts, TIOCSWINSZ, &ws);
-	if (res < 0)
-		return BOOL_FALSE;
+	iter = faux_list_head(exec->drains);
+	while ((drain = (kexec_drain_t *)faux_list_each(&iter))) {
+		int fds[] = {drain->fdout, drain->fderr};
+		size_t i = 0;
+		for (i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+			if (fds[i] < 0)
+				continue;
+			if (exec->eloop)
+				faux_eloop_del_fd(exec->eloop, fds[i]);
+			if (eloop)
+				faux_eloop_add_fd(eloop, fds[i], POLLOUT,
+					drain_ev, drain);
+		}
+	}
+
+	iter = faux_list_head(exec->streams);
+	while ((stream = (kexec_stream_t *)faux_list_each(&iter)))
+		stream_move(stream, eloop);
+
+	iter = faux_list_head(exec->jobs);
+	while ((job = (kexec_job_t *)faux_list_each(&iter)))
+		job_move(job, eloop);
+
+	exec->eloop = eloop;
+	exec->event_cb = event_cb;
+	exec->event_udata = udata;
 
 	return BOOL_TRUE;
 }
@@ -320,7 +482,7 @@ static bool_t kexec_prepare(kexec_t *exec)
 	bool_t isatty_stderr = BOOL_FALSE;
 	int pts = -1;
 	int ptm = -1;
-	char *pts_name = NULL;
+	const char *pts_name = NULL;
 
 
 	assert(exec);
@@ -342,30 +504,16 @@ static bool_t kexec_prepare(kexec_t *exec)
 			isatty_stdout = ksession_isatty_stdout(exec->session);
 		isatty_stderr = ksession_isatty_stderr(exec->session);
 	}
+	// Pseudo terminal belongs to session. It's created once and then
+	// it's leased to commands. Window size is maintained by session.
 	if (isatty_stdin || isatty_stdout || isatty_stderr) {
-		ptm = open(PTMX_PATH, O_RDWR, O_NOCTTY);
-		if (ptm < 0)
+		if (!ksession_pty_lease(exec->session, &ptm, &pts, &pts_name))
 			return BOOL_FALSE;
-		// Set O_NONBLOCK flag here. Because this flag is ignored while
-		// open() ptmx. I don't know why. fcntl() is working fine.
-		fflags = fcntl(ptm, F_GETFL);
-		fcntl(ptm, F_SETFL, fflags | O_NONBLOCK);
-		grantpt(ptm);
-		unlockpt(ptm);
-		pts_name = ptsname(ptm);
-		// In a case of pseudo-terminal the pts
-		// must be reopened later in the child after setsid(). So
-		// save filename of pts
+		// In a case of pseudo-terminal the child must set it as
+		// controlling terminal after setsid(). Zygote's child reopens
+		// pts by name. So save filename of pts
 		kexec_set_pts_fname(exec, pts_name);
-		// Open client side (pts) of pseudo terminal. It's necessary for
-		// sync action execution. Additionally open descriptor makes
-		// action (from child) to don't send SIGHUP on terminal handler.
-		pts = open(pts_name, O_RDWR, O_NOCTTY);
-		if (pts < 0)
-			return BOOL_FALSE;
 		kexec_set_pts(exec, pts);
-		// Set pseudo terminal window size
-		kexec_set_winsize(exec);
 	}
 
 	// Create "global" stdin, stdout, stderr for the whole job execution.
@@ -375,7 +523,7 @@ static bool_t kexec_prepare(kexec_t *exec)
 		r_end = pts;
 		w_end = ptm;
 	} else {
-		if (pipe(pipefd) < 0)
+		if (pipe2(pipefd, O_CLOEXEC) < 0)
 			return BOOL_FALSE;
 		// Write end of 'stdin' pipe must be non-blocked
 		fflags = fcntl(pipefd[1], F_GETFL);
@@ -392,7 +540,7 @@ static bool_t kexec_prepare(kexec_t *exec)
 		r_end = ptm;
 		w_end = pts;
 	} else {
-		if (pipe(pipefd) < 0)
+		if (pipe2(pipefd, O_CLOEXEC) < 0)
 			return BOOL_FALSE;
 		// Read end of 'stdout' pipe must be non-blocked
 		fflags = fcntl(pipefd[0], F_GETFL);
@@ -409,7 +557,7 @@ static bool_t kexec_prepare(kexec_t *exec)
 		r_end = ptm;
 		w_end = pts;
 	} else {
-		if (pipe(pipefd) < 0)
+		if (pipe2(pipefd, O_CLOEXEC) < 0)
 			return BOOL_FALSE;
 		// Read end of 'stderr' pipe must be non-blocked
 		fflags = fcntl(pipefd[0], F_GETFL);
@@ -437,7 +585,7 @@ static bool_t kexec_prepare(kexec_t *exec)
 		// Create pipes beetween processes
 		if (next) {
 			kcontext_t *next_context = (kcontext_t *)faux_list_data(next);
-			if (pipe(pipefd) < 0)
+			if (pipe2(pipefd, O_CLOEXEC) < 0)
 				return BOOL_FALSE;
 			kcontext_set_stdout(context, pipefd[1]); // Write end
 			kcontext_set_stdin(next_context, pipefd[0]); // Read end
@@ -448,20 +596,522 @@ static bool_t kexec_prepare(kexec_t *exec)
 }
 
 
+// === Forked processes
+// Each forked process is watched by pidfd within kexec's event loop. So
+// termination of process is dispatched directly to its context. Only own
+// processes are waited for. If pidfd is not supported then owner of
+// event loop calls kexec_wait_children() on SIGCHLD.
+
+
+static bool_t exec_action_sequence(kexec_t *exec, kcontext_t *context,
+	pid_t pid, int wstatus);
+
+
+static int kexec_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+	pid = pid; // Happy compiler
+	return -1;
+#endif
+}
+
+
+static void kexec_child_free(kexec_child_t *child)
+{
+	if (!child)
+		return;
+
+	if (child->pidfd >= 0) {
+		if (child->exec->eloop)
+			faux_eloop_del_fd(child->exec->eloop, child->pidfd);
+		close(child->pidfd);
+	}
+	// Nobody will wait for the process so don't leave zombie
+	if (child->pid > 0) {
+		kill(child->pid, SIGKILL);
+		while ((waitpid(child->pid, NULL, 0) < 0) && (EINTR == errno));
+	}
+
+	faux_free(child);
+}
+
+
+static bool_t kexec_child_add(kexec_t *exec, kcontext_t *context, pid_t pid)
+{
+	kexec_child_t *child = NULL;
+
+	child = faux_zmalloc(sizeof(*child));
+	assert(child);
+	if (!child)
+		return BOOL_FALSE;
+	child->exec = exec;
+	child->context = context;
+	child->pid = pid;
+	child->pidfd = kexec_pidfd_open(pid);
+	faux_list_add(exec->children, child);
+	if ((child->pidfd >= 0) && exec->eloop)
+		faux_eloop_add_fd(exec->eloop, child->pidfd, POLLIN,
+			kexec_child_ev, child);
+
+	return BOOL_TRUE;
+}
+
+
+// Process is waited. Continue ACTION sequence of its context.
+static void kexec_child_done(kexec_child_t *child, int wstatus)
+{
+	kexec_t *exec = child->exec;
+	kcontext_t *context = child->context;
+	pid_t pid = child->pid;
+	faux_list_node_t *iter = NULL;
+
+	child->pid = -1;
+	for (iter = faux_list_head(exec->children); iter;
+		iter = faux_list_next_node(iter)) {
+		if (faux_list_data(iter) == child) {
+			faux_list_del(exec->children, iter);
+			break;
+		}
+	}
+
+	exec_action_sequence(exec, context, pid, wstatus);
+}
+
+
+static bool_t kexec_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	kexec_child_t *child = (kexec_child_t *)user_data;
+	kexec_t *exec = child->exec;
+	int wstatus = 0;
+	pid_t r = -1;
+
+	while (((r = waitpid(child->pid, &wstatus, WNOHANG)) < 0) &&
+		(EINTR == errno));
+	if (0 == r) // Not terminated yet
+		return BOOL_TRUE;
+	// Somebody else has waited for the process. Exit status is unknown.
+	if (r < 0)
+		wstatus = 0xff00;
+	kexec_child_done(child, wstatus);
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	// Callback can free exec
+	if (exec->event_cb)
+		return exec->event_cb(exec, exec->event_udata);
+
+	return BOOL_TRUE;
+}
+
+
+// Waits for own terminated processes that are not watched by pidfd.
+// Doesn't block.
+bool_t kexec_wait_children(kexec_t *exec)
+{
+	faux_list_node_t *iter = NULL;
+
+	assert(exec);
+	if (!exec)
+		return BOOL_FALSE;
+
+	iter = faux_list_head(exec->children);
+	while (iter) {
+		kexec_child_t *child = (kexec_child_t *)faux_list_data(iter);
+		int wstatus = 0;
+		iter = faux_list_next_node(iter);
+		if (child->pidfd >= 0)
+			continue;
+		if (waitpid(child->pid, &wstatus, WNOHANG) > 0)
+			kexec_child_done(child, wstatus);
+	}
+
+	return BOOL_TRUE;
+}
+
+
 // === SYNC symbol execution
 // The function will be executed right here. It's necessary for
-// navigation implementation for example. To grab function output the
-// service process will be forked. It gets output and stores it to the
-// internal buffer. After sym function return grabber will write
-// buffered data back. So grabber will simulate async sym execution.
-static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
+// navigation implementation for example. The output of function is
+// captured to the temporary files (pipes can't be used because nobody
+// reads them while function is executed). Then output is passed to the
+// exec's buffers (last pipeline stage) or to the pipeline streams. The
+// rest of data that doesn't fit into the pipe is written by event loop.
+// The next ACTION waits for it like for forked process.
+
+
+// === Descriptors
+// All descriptors created by klish have close-on-exec flag. Additionally
+// forked child closes inherited descriptors before ACTION execution
+// because ACTION can be a plugin's function that doesn't exec().
+
+
+static bool_t kexec_fd_is_kept(int fd, const int *keep, size_t keep_num)
+{
+	size_t i = 0;
+
+	for (i = 0; i < keep_num; i++) {
+		if (keep[i] == fd)
+			return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+#ifdef SYS_close_range
+// Closes [first, last] range excluding kept fds. Returns -1 if
+// close_range() is not supported by kernel.
+static int kexec_close_range(unsigned int first, unsigned int last,
+	const int *keep, size_t keep_num)
+{
+	unsigned int fd = first;
+
+	while (fd <= last) {
+		unsigned int stop = last;
+		size_t i = 0;
+		// Nearest kept fd
+		for (i = 0; i < keep_num; i++) {
+			if ((keep[i] >= (int)fd) && ((unsigned int)keep[i] <= stop))
+				stop = (unsigned int)keep[i] - 1;
+		}
+		if ((stop >= fd) &&
+			(syscall(SYS_close_range, fd, stop, 0) < 0))
+			return -1;
+		if (stop == last)
+			break;
+		fd = stop + 2; // Skip kept fd
+	}
+
+	return 0;
+}
+#endif
+
+
+/** @brief Closes all descriptors except stdin, stdout, stderr and kept ones.
+ *
+ * The close_range() is used if possible. Else open descriptors are got
+ * from /proc/self/fd. The loop up to _SC_OPEN_MAX is the last resort. It
+ * can be really slow with high RLIMIT_NOFILE.
+ */
+void kexec_close_fds(const int *keep, size_t keep_num)
+{
+	DIR *dir = NULL;
+	int fd = -1;
+	int fdmax = 0;
+
+#ifdef SYS_close_range
+	if (kexec_close_range(STDERR_FILENO + 1, ~0U, keep, keep_num) == 0)
+		return;
+#endif
+
+	if ((dir = opendir("/proc/self/fd"))) {
+		struct dirent *de = NULL;
+		int dfd = dirfd(dir);
+		while ((de = readdir(dir))) {
+			char *endptr = NULL;
+			fd = (int)strtol(de->d_name, &endptr, 10);
+			if ((endptr == de->d_name) || (*endptr != '\0'))
+				continue; // "." and ".."
+			if ((fd <= STDERR_FILENO) || (fd == dfd) ||
+				kexec_fd_is_kept(fd, keep, keep_num))
+				continue;
+			close(fd);
+		}
+		closedir(dir);
+		return;
+	}
+
+	fdmax = (int)sysconf(_SC_OPEN_MAX);
+	for (fd = (STDERR_FILENO + 1); fd < fdmax; fd++) {
+		if (!kexec_fd_is_kept(fd, keep, keep_num))
+			close(fd);
+	}
+}
+
+
+// Creates file to capture output of sync sym
+static int capture_new(void)
+{
+	char template[] = "/tmp/klish.capture.XXXXXX";
+	int fd = -1;
+
+#ifdef MFD_CLOEXEC
+	fd = memfd_create("klish-capture", MFD_CLOEXEC);
+	if (fd >= 0)
+		return fd;
+#endif
+	fd = mkostemp(template, O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	unlink(template);
+
+	return fd;
+}
+
+
+// Reads all available data from fd to buffer. Doesn't block on
+// non-blocked fds.
+static bool_t buf_read_fd(faux_buf_t *buf, int fd)
+{
+	ssize_t r = 0;
+
+	do {
+		void *data = NULL;
+		ssize_t len = faux_buf_dwrite_lock_easy(buf, &data);
+		if (len <= 0)
+			break;
+		r = read(fd, data, len);
+		faux_buf_dwrite_unlock_easy(buf, (r < 0) ? 0 : r);
+	} while (r > 0);
+
+	return BOOL_TRUE;
+}
+
+
+// Writes buffered data to fd while it doesn't block. Pipe is writable
+// without blocking if there is at least PIPE_BUF free space.
+static bool_t buf_write_nonblock(faux_buf_t *buf, int fd)
+{
+	while (faux_buf_len(buf) > 0) {
+		struct pollfd pfd = {};
+		void *data = NULL;
+		ssize_t len = 0;
+		ssize_t r = 0;
+
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		if (poll(&pfd, 1, 0) <= 0)
+			break;
+		if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+			return BOOL_FALSE; // Nobody reads the data
+		len = faux_buf_dread_lock_easy(buf, &data);
+		if (len <= 0)
+			break;
+		if (len > PIPE_BUF)
+			len = PIPE_BUF;
+		r = write(fd, data, len);
+		faux_buf_dread_unlock_easy(buf, (r < 0) ? 0 : r);
+		if (r < 0)
+			return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Passes captured output to exec's buffer or to the stream. Returns buffer
+// with the rest of data that can't be written to stream without blocking.
+static faux_buf_t *capture_pass(int capture_fd, faux_buf_t *buf,
+	int exec_fd, int fd)
+{
+	faux_buf_t *rest = NULL;
+
+	if (lseek(capture_fd, 0, SEEK_SET) < 0)
+		return NULL;
+
+	// Last pipeline stage has a buffer. Previous ACTIONs can write to the
+	// exec's stream. So get their data first to keep order.
+	if (buf) {
+		if (exec_fd >= 0)
+			buf_read_fd(buf, exec_fd);
+		buf_read_fd(buf, capture_fd);
+		return NULL;
+	}
+
+	rest = faux_buf_new(0);
+	buf_read_fd(rest, capture_fd);
+	if (!buf_write_nonblock(rest, fd) || (faux_buf_len(rest) == 0)) {
+		faux_buf_free(rest);
+		return NULL;
+	}
+
+	return rest;
+}
+
+
+static void drain_release(kexec_drain_t *drain, int *fd, faux_buf_t **buf)
+{
+	if (*fd >= 0) {
+		if (drain->exec->eloop)
+			faux_eloop_del_fd(drain->exec->eloop, *fd);
+		close(*fd);
+		*fd = -1;
+	}
+	faux_buf_free(*buf);
+	*buf = NULL;
+}
+
+
+static void kexec_drain_free(kexec_drain_t *drain)
+{
+	if (!drain)
+		return;
+
+	drain_release(drain, &drain->fdout, &drain->bufout);
+	drain_release(drain, &drain->fderr, &drain->buferr);
+
+	faux_free(drain);
+}
+
+
+static bool_t drain_add_fd(kexec_drain_t *drain, const faux_buf_t *buf,
+	int fd, int *drain_fd)
+{
+	if (!buf)
+		return BOOL_TRUE;
+	*drain_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (*drain_fd < 0)
+		return BOOL_FALSE;
+	if (drain->exec->eloop)
+		faux_eloop_add_fd(drain->exec->eloop, *drain_fd, POLLOUT,
+			drain_ev, drain);
+
+	return BOOL_TRUE;
+}
+
+
+// Output will be written while exec's event loop is running. The
+// buffers belong to drain now.
+static bool_t drain_new(kexec_t *exec, kcontext_t *context,
+	faux_buf_t *rest_out, faux_buf_t *rest_err)
+{
+	kexec_drain_t *drain = NULL;
+
+	drain = faux_zmalloc(sizeof(*drain));
+	assert(drain);
+	if (!drain) {
+		faux_buf_free(rest_out);
+		faux_buf_free(rest_err);
+		return BOOL_FALSE;
+	}
+	drain->exec = exec;
+	drain->context = context;
+	drain->fdout = -1;
+	drain->fderr = -1;
+	drain->bufout = rest_out;
+	drain->buferr = rest_err;
+	faux_list_add(exec->drains, drain);
+
+	if (!drain_add_fd(drain, rest_out, kcontext_stdout(context),
+		&drain->fdout) ||
+		!drain_add_fd(drain, rest_err, kcontext_stderr(context),
+		&drain->fderr)) {
+		faux_list_del(exec->drains, faux_list_tail(exec->drains));
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t drain_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	kexec_drain_t *drain = (kexec_drain_t *)user_data;
+	kexec_t *exec = drain->exec;
+	kcontext_t *context = drain->context;
+	int *fd = NULL;
+	faux_buf_t **buf = NULL;
+	faux_list_node_t *iter = NULL;
+
+	if (info->fd == drain->fdout) {
+		fd = &drain->fdout;
+		buf = &drain->bufout;
+	} else {
+		fd = &drain->fderr;
+		buf = &drain->buferr;
+	}
+
+	// Data is written or nobody reads output (the rest is dropped)
+	if ((info->revents & (POLLHUP | POLLERR | POLLNVAL)) ||
+		!buf_write_nonblock(*buf, *fd) || (faux_buf_len(*buf) == 0))
+		drain_release(drain, fd, buf);
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+
+	if ((drain->fdout >= 0) || (drain->fderr >= 0))
+		return BOOL_TRUE;
+
+	// All output is written. Continue ACTION sequence.
+	for (iter = faux_list_head(exec->drains); iter;
+		iter = faux_list_next_node(iter)) {
+		if (faux_list_data(iter) == drain) {
+			faux_list_del(exec->drains, iter);
+			break;
+		}
+	}
+	exec_action_sequence(exec, context, KEXEC_DRAIN_PID, 0);
+
+	// Callback can free exec
+	if (exec->event_cb)
+		return exec->event_cb(exec, exec->event_udata);
+
+	return BOOL_TRUE;
+}
+
+
+// Executes sym function with process-wide stdout and stderr redirected to
+// capture files
+static int sync_call_redirected(ksym_fn fn, kcontext_t *context,
+	int capture_out, int capture_err)
+{
+	int exitcode = 0;
+	int saved_stdout = -1;
+	int saved_stderr = -1;
+
+	// Output streams are process-wide so redirection is a part of locked
+	// plugin code execution
+	kplugin_lock();
+
+	// Prepare streams before redirection
+	fflush(stdout);
+	fflush(stderr);
+
+	// Temporarily replace orig output streams by capture files
+	// stdout
+	saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	dup2(capture_out, STDOUT_FILENO);
+	// stderr
+	saved_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+	dup2(capture_err, STDERR_FILENO);
+
+	// Execute sym function right here
+	exitcode = fn(context);
+
+	// Restore orig output streams
+	// stdout
+	fflush(stdout);
+	close(STDOUT_FILENO);
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	// stderr
+	fflush(stderr);
+	close(STDERR_FILENO);
+	dup2(saved_stderr, STDERR_FILENO);
+	close(saved_stderr);
+
+	kplugin_unlock();
+
+	return exitcode;
+}
+
+
+static bool_t exec_action_sync(kexec_t *exec, kcontext_t *context,
 	const kaction_t *action, pid_t *pid, int *retcode)
 {
 	ksym_fn fn = NULL;
 	int exitcode = 0;
-	pid_t child_pid = -1;
-	int pipe_stdout[2] = {};
-	int pipe_stderr[2] = {};
+	int capture_out = -1;
+	int capture_err = -1;
+	faux_buf_t *rest_out = NULL;
+	faux_buf_t *rest_err = NULL;
 	ksym_t *sym = NULL;
 
 	sym = kaction_sym(action);
@@ -472,87 +1122,54 @@ static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
 	// has bufout
 	if (ksym_silent(sym) && kcontext_is_last_pipeline_stage(context)) {
 //fprintf(stderr, "silent %s\n", ksym_name(sym));
+		ksym_lock(sym);
 		exitcode = fn(context);
+		ksym_unlock(sym);
 		if (retcode)
 			*retcode = exitcode;
 		return BOOL_TRUE;
 	}
 //fprintf(stderr, "sync %s\n", ksym_name(sym));
 
-	// Create pipes beetween sym function and grabber
-	if (pipe(pipe_stdout) < 0)
+	// Create files to capture output
+	if ((capture_out = capture_new()) < 0)
 		return BOOL_FALSE;
-	if (pipe(pipe_stderr) < 0) {
-		close(pipe_stdout[0]);
-		close(pipe_stdout[1]);
-		return BOOL_FALSE;
-	}
-
-	// Prepare streams before fork
-	fflush(stdout);
-	fflush(stderr);
-
-	// Fork the grabber
-	child_pid = fork();
-	if (child_pid == -1) {
-		close(pipe_stdout[0]);
-		close(pipe_stdout[1]);
-		close(pipe_stderr[0]);
-		close(pipe_stderr[1]);
+	if ((capture_err = capture_new()) < 0) {
+		close(capture_out);
 		return BOOL_FALSE;
 	}
 
-	// Parent
-	if (child_pid != 0) {
-		int saved_stdout = -1;
-		int saved_stderr = -1;
-
-		// Save pid of grabber
-		if (pid)
-			*pid = child_pid;
-
-		// Temporarily replace orig output streams by pipe
-		// stdout
-		saved_stdout = dup(STDOUT_FILENO);
-		dup2(pipe_stdout[1], STDOUT_FILENO);
-		close(pipe_stdout[0]);
-		close(pipe_stdout[1]);
-		// stderr
-		saved_stderr = dup(STDERR_FILENO);
-		dup2(pipe_stderr[1], STDERR_FILENO);
-		close(pipe_stderr[0]);
-		close(pipe_stderr[1]);
-
-		// Execute sym function right here
+	// Thread-safe sym writes to capture files itself. Process-wide
+	// output streams are not touched so sym is not locked.
+	if (ksym_thread_safe(sym)) {
+		kcontext_set_capture(context, capture_out, capture_err);
 		exitcode = fn(context);
-		if (retcode)
-			*retcode = exitcode;
-
-		// Restore orig output streams
-		// stdout
-		fflush(stdout);
-		close(STDOUT_FILENO);
-		dup2(saved_stdout, STDOUT_FILENO);
-		close(saved_stdout);
-		// stderr
-		fflush(stderr);
-		close(STDERR_FILENO);
-		dup2(saved_stderr, STDERR_FILENO);
-		close(saved_stderr);
-
-		return BOOL_TRUE;
-
-	// Child (Output grabber)
+		kcontext_set_capture(context, -1, -1);
 	} else {
-		int fds[][2] = {
-			{pipe_stdout[0], kcontext_stdout(context)},
-			{pipe_stderr[0], kcontext_stderr(context)},
-			{-1, -1},
-		};
-		grabber(fds); // Grabber will not return
+		exitcode = sync_call_redirected(fn, context,
+			capture_out, capture_err);
 	}
+	if (retcode)
+		*retcode = exitcode;
+
+	// Pass captured output. Exec's stdout pipe can't be read while owner
+	// reads it directly (bulk transfer). So write output to the pipe
+	// after data the owner waits for.
+	rest_out = capture_pass(capture_out,
+		exec->stdout_held ? NULL : kcontext_bufout(context),
+		exec->stdout, kcontext_stdout(context));
+	rest_err = capture_pass(capture_err, kcontext_buferr(context),
+		exec->stderr, kcontext_stderr(context));
+	close(capture_out);
+	close(capture_err);
+	if (!rest_out && !rest_err)
+		return BOOL_TRUE;
 
-	exec = exec; // Happy compiler
+	// The pipe is full. Event loop will write the rest of output.
+	if (!drain_new(exec, context, rest_out, rest_err))
+		return BOOL_FALSE;
+	if (pid)
+		*pid = KEXEC_DRAIN_PID;
 
 	return BOOL_TRUE;
 }
@@ -563,19 +1180,26 @@ static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
 // The parent will save forked process's pid and immediately return
 // control to event loop which will get forked process stdout and
 // wait for process termination.
-static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
+static bool_t exec_action_async(kexec_t *exec, kcontext_t *context,
 	const kaction_t *action, pid_t *pid)
 {
 	ksym_fn fn = NULL;
 	int exitcode = 0;
 	pid_t child_pid = -1;
-	int i = 0;
-	int fdmax = 0;
 	sigset_t sigs;
+	kzygote_t *zygote = NULL;
 
 	fn = ksym_function(kaction_sym(action));
 //fprintf(stderr, "Async %s\n", ksym_name(kaction_sym(action)));
 
+	// Zygote spawns processes for common ACTIONs only. Their termination
+	// is reported to KTPd session's event loop. Fork process here if
+	// zygote can't do it.
+	zygote = ksession_zygote(exec->session);
+	if (zygote && (exec->type == KCONTEXT_TYPE_ACTION) &&
+		kzygote_spawn(zygote, context, exec->pts_fname, pid))
+		return BOOL_TRUE;
+
 	// Oh, it's amazing world of stdio!
 	// Flush buffers before fork() because buffer content will be inherited
 	// by child. Moreover dup2() can replace old stdout file descriptor by
@@ -584,7 +1208,11 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 	fflush(stdout);
 	fflush(stderr);
 
+	// Don't fork while other thread executes plugin code. Child can
+	// inherit inconsistent plugin state or locked libc internals.
+	kplugin_lock();
 	child_pid = fork();
+	kplugin_unlock();
 	if (child_pid == -1)
 		return BOOL_FALSE;
 
@@ -592,6 +1220,7 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 	// Save the child pid and return control. Later event loop will wait
 	// for saved pid.
 	if (child_pid != 0) {
+		kexec_child_add(exec, context, child_pid);
 		if (pid)
 			*pid = child_pid;
 		return BOOL_TRUE;
@@ -606,10 +1235,16 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 	// Reopen streams if the pseudoterminal is used.
 	// It's necessary to set session terminal
 	if (exec->pts_fname != NULL) {
-		int fd = -1;
+		int fd = exec->pts;
 		setsid();
-		fd = open(exec->pts_fname, O_RDWR, 0);
-		if (fd < 0)
+		// Inherited pts becomes controlling terminal of the first
+		// pipeline stage without path lookup. Session leases the
+		// terminal that is not owned by other session (see
+		// ksession_pty_lease()). Other stages are forked at the same
+		// time. They can't get the same terminal so they just use
+		// inherited fd.
+		if ((kcontext_pipeline_stage(context) == 0) &&
+			(ioctl(fd, TIOCSCTTY, 0) < 0))
 			_exit(-1);
 		if (isatty(kcontext_stdin(context)))
 			kcontext_set_stdin(context, fd);
@@ -624,9 +1259,7 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 	dup2(kcontext_stderr(context), STDERR_FILENO);
 
 	// Close all inherited fds except stdin, stdout, stderr
-	fdmax = (int)sysconf(_SC_OPEN_MAX);
-	for (i = (STDERR_FILENO + 1); i < fdmax; i++)
-		close(i);
+	kexec_close_fds(NULL, 0);
 
 	exitcode = fn(context);
 	// We will use _exit() later so stdio streams will remain unflushed.
@@ -642,7 +1275,729 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 }
 
 
-static bool_t exec_action(const kexec_t *exec, kcontext_t *context,
+// === STREAM symbol execution
+// The filter with stream functions is executed right within daemon's
+// event loop without fork(). It reads the output of previous pipeline
+// stage, processes it line by line and writes result to the next stage
+// (or to exec's stdout for the last stage). The context's PID is
+// KEXEC_STREAM_PID while the stream is active.
+
+
+// Stops input polling and restores fd's flags
+static void stream_release_in(kexec_stream_t *stream)
+{
+	if (stream->fdin < 0)
+		return;
+	if (stream->exec->eloop)
+		faux_eloop_del_fd(stream->exec->eloop, stream->fdin);
+	fcntl(stream->fdin, F_SETFL, stream->fdin_flags);
+	stream->fdin = -1;
+}
+
+
+// Stops output polling and restores fd's flags
+static void stream_release_out(kexec_stream_t *stream)
+{
+	if (stream->fdout < 0)
+		return;
+	if (stream->exec->eloop)
+		faux_eloop_del_fd(stream->exec->eloop, stream->fdout);
+	fcntl(stream->fdout, F_SETFL, stream->fdout_flags);
+	stream->fdout = -1;
+}
+
+
+static void kexec_stream_free(kexec_stream_t *stream)
+{
+	if (!stream)
+		return;
+
+	// Aborted filter. Nobody needs its output
+	if (stream->state) {
+		ksym_lock(stream->sym);
+		ksym_stream_fini(stream->sym)(stream->state, NULL);
+		ksym_unlock(stream->sym);
+	}
+	stream_release_in(stream);
+	stream_release_out(stream);
+	faux_buf_free(stream->bufin);
+	faux_buf_free(stream->bufout);
+	faux_free(stream->line);
+
+	faux_free(stream);
+}
+
+
+// Passes the line to the filter. Returns BOOL_FALSE if filter doesn't want
+// more data. Line function uses its own state only so it's not locked.
+static bool_t stream_line(kexec_stream_t *stream, const char *line, size_t len)
+{
+	return ksym_stream_line(stream->sym)(stream->state, line, len,
+		stream->bufout);
+}
+
+
+// Saves incomplete line to process it when the rest will be received
+static void stream_line_append(kexec_stream_t *stream,
+	const char *data, size_t len)
+{
+	if ((stream->line_len + len) > stream->line_size) {
+		stream->line_size = stream->line_len + len;
+		stream->line = realloc(stream->line, stream->line_size);
+		assert(stream->line);
+	}
+	memcpy(stream->line + stream->line_len, data, len);
+	stream->line_len += len;
+}
+
+
+// Splits data chunk to lines. The lines within chunk are passed to
+// filter without copying.
+static bool_t stream_chunk(kexec_stream_t *stream, const char *data, size_t len)
+{
+	while (len > 0) {
+		const char *nl = memchr(data, '\n', len);
+		size_t part = 0;
+
+		if (!nl) {
+			stream_line_append(stream, data, len);
+			break;
+		}
+		part = nl - data + 1;
+		if (stream->line_len > 0) {
+			size_t line_len = 0;
+			stream_line_append(stream, data, part);
+			line_len = stream->line_len;
+			stream->line_len = 0;
+			if (!stream_line(stream, stream->line, line_len))
+				return BOOL_FALSE;
+		} else if (!stream_line(stream, data, part)) {
+			return BOOL_FALSE;
+		}
+		data += part;
+		len -= part;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Reads available input and filters it. Returns BOOL_FALSE when input is
+// over (EOF, error or filter doesn't need more data).
+static bool_t stream_read(kexec_stream_t *stream)
+{
+	ssize_t r = 0;
+
+	do {
+		void *data = NULL;
+		ssize_t len = 0;
+
+		len = faux_buf_dwrite_lock_easy(stream->bufin, &data);
+		if (len <= 0)
+			return BOOL_FALSE;
+		r = read(stream->fdin, data, len);
+		faux_buf_dwrite_unlock_easy(stream->bufin, (r < 0) ? 0 : r);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+				return BOOL_TRUE;
+			return BOOL_FALSE;
+		}
+		// Filter all received chunks
+		while ((len = faux_buf_dread_lock_easy(stream->bufin, &data)) > 0) {
+			bool_t more = stream_chunk(stream, data, len);
+			faux_buf_dread_unlock_easy(stream->bufin, len);
+			if (!more)
+				return BOOL_FALSE;
+		}
+	} while ((r > 0) &&
+		(faux_buf_len(stream->bufout) < KEXEC_STREAM_BUF_LIMIT));
+
+	return (r > 0) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+// Input is over. Finishes filter and closes input to inform the previous
+// stage that nobody reads its output.
+static void stream_eof(kexec_stream_t *stream, bool_t process_rest)
+{
+	kcontext_t *context = stream->context;
+
+	if (stream->eof)
+		return;
+	stream->eof = BOOL_TRUE;
+
+	// The last line without line feed
+	if (process_rest && (stream->line_len > 0))
+		stream_line(stream, stream->line, stream->line_len);
+	ksym_lock(stream->sym);
+	stream->retcode = ksym_stream_fini(stream->sym)(stream->state,
+		stream->bufout);
+	ksym_unlock(stream->sym);
+	stream->state = NULL;
+
+	stream_release_in(stream);
+	close(kcontext_stdin(context));
+	kcontext_set_stdin(context, -1);
+}
+
+
+// Stream stage is done. Continue ACTION sequence like forked process is
+// terminated.
+static bool_t stream_complete(kexec_stream_t *stream)
+{
+	kexec_t *exec = stream->exec;
+	kcontext_t *context = stream->context;
+	int retcode = stream->retcode;
+	faux_list_node_t *iter = NULL;
+
+	stream_release_out(stream);
+	for (iter = faux_list_head(exec->streams); iter;
+		iter = faux_list_next_node(iter)) {
+		if (faux_list_data(iter) == stream) {
+			faux_list_del(exec->streams, iter);
+			break;
+		}
+	}
+
+	exec_action_sequence(exec, context, KEXEC_STREAM_PID,
+		(retcode & 0xff) << 8);
+
+	// Callback can free exec
+	if (exec->event_cb)
+		return exec->event_cb(exec, exec->event_udata);
+
+	return BOOL_TRUE;
+}
+
+
+// Writes filtered data and manages polling
+static bool_t stream_flush(kexec_stream_t *stream)
+{
+	faux_eloop_t *eloop = stream->exec->eloop;
+
+	while (faux_buf_len(stream->bufout) > 0) {
+		void *data = NULL;
+		ssize_t len = 0;
+		ssize_t r = 0;
+
+		len = faux_buf_dread_lock_easy(stream->bufout, &data);
+		if (len <= 0)
+			break;
+		r = write(stream->fdout, data, len);
+		faux_buf_dread_unlock_easy(stream->bufout, (r < 0) ? 0 : r);
+		if (r >= 0)
+			continue;
+		if (EINTR == errno)
+			continue;
+		if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+			break;
+		// Nobody reads output. Drop the rest of data
+		stream_eof(stream, BOOL_FALSE);
+		faux_buf_free(stream->bufout);
+		stream->bufout = faux_buf_new(0);
+	}
+
+	if (faux_buf_len(stream->bufout) > 0)
+		faux_eloop_include_fd_event(eloop, stream->fdout, POLLOUT);
+	else
+		faux_eloop_exclude_fd_event(eloop, stream->fdout, POLLOUT);
+
+	if (!stream->eof) {
+		// Pause input while output buffer is full
+		if (faux_buf_len(stream->bufout) < KEXEC_STREAM_BUF_LIMIT)
+			faux_eloop_include_fd_event(eloop, stream->fdin, POLLIN);
+		else
+			faux_eloop_exclude_fd_event(eloop, stream->fdin, POLLIN);
+		return BOOL_TRUE;
+	}
+
+	if (faux_buf_len(stream->bufout) > 0)
+		return BOOL_TRUE;
+
+	return stream_complete(stream);
+}
+
+
+static bool_t stream_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+
+
+// Moves stream's descriptors to another event loop. The events are the same
+// as stream_flush() sets.
+static void stream_move(kexec_stream_t *stream, faux_eloop_t *eloop)
+{
+	faux_eloop_t *old_eloop = stream->exec->eloop;
+
+	if (old_eloop) {
+		if (stream->fdin >= 0)
+			faux_eloop_del_fd(old_eloop, stream->fdin);
+		if (stream->fdout >= 0)
+			faux_eloop_del_fd(old_eloop, stream->fdout);
+	}
+	if (!eloop)
+		return;
+
+	if ((stream->fdin >= 0) && !stream->eof)
+		faux_eloop_add_fd(eloop, stream->fdin,
+			(faux_buf_len(stream->bufout) < KEXEC_STREAM_BUF_LIMIT) ?
+			POLLIN : 0, stream_ev, stream);
+	if (stream->fdout >= 0)
+		faux_eloop_add_fd(eloop, stream->fdout,
+			(faux_buf_len(stream->bufout) > 0) ? POLLOUT : 0,
+			stream_ev, stream);
+}
+
+
+static bool_t stream_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	kexec_stream_t *stream = (kexec_stream_t *)user_data;
+
+	if (!stream->eof && (info->fd == stream->fdin) &&
+		(info->revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL))) {
+		if (!stream_read(stream))
+			stream_eof(stream, BOOL_TRUE);
+	}
+
+	// Nobody reads output. Drop the rest of data
+	if ((info->fd == stream->fdout) &&
+		(info->revents & (POLLHUP | POLLERR | POLLNVAL))) {
+		stream_eof(stream, BOOL_FALSE);
+		faux_buf_free(stream->bufout);
+		stream->bufout = faux_buf_new(0);
+	}
+
+	// The POLLOUT is processed by stream_flush(). Errors will be got
+	// by write().
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+
+	return stream_flush(stream);
+}
+
+
+// Returns BOOL_FALSE if sym can't be executed as in-daemon stream stage.
+// Then it will be forked.
+static bool_t exec_action_stream(kexec_t *exec, kcontext_t *context,
+	const kaction_t *action, pid_t *pid)
+{
+	ksym_t *sym = NULL;
+	kexec_stream_t *stream = NULL;
+	void *state = NULL;
+	int fdin = -1;
+	int fdout = -1;
+
+	sym = kaction_sym(action);
+	if (!exec->eloop || !ksym_is_stream(sym))
+		return BOOL_FALSE;
+	// Service ACTIONs are executed by local event loops
+	if (exec->type != KCONTEXT_TYPE_ACTION)
+		return BOOL_FALSE;
+	// The first stage gets user's stdin. Filters only
+	if (kcontext_pipeline_stage(context) == 0)
+		return BOOL_FALSE;
+	fdin = kcontext_stdin(context);
+	fdout = kcontext_stdout(context);
+	if ((fdin < 0) || (fdout < 0) || isatty(fdin) || isatty(fdout))
+		return BOOL_FALSE;
+
+	ksym_lock(sym);
+	state = ksym_stream_init(sym)(context);
+	ksym_unlock(sym);
+	if (!state)
+		return BOOL_FALSE;
+
+	stream = faux_zmalloc(sizeof(*stream));
+	assert(stream);
+	stream->exec = exec;
+	stream->context = context;
+	stream->sym = sym;
+	stream->state = state;
+	stream->bufin = faux_buf_new(0);
+	stream->bufout = faux_buf_new(0);
+	stream->eof = BOOL_FALSE;
+	stream->retcode = 0;
+
+	// Pipes are shared with forked processes so restore flags later
+	stream->fdin = fdin;
+	stream->fdin_flags = fcntl(fdin, F_GETFL);
+	fcntl(fdin, F_SETFL, stream->fdin_flags | O_NONBLOCK);
+	stream->fdout = fdout;
+	stream->fdout_flags = fcntl(fdout, F_GETFL);
+	fcntl(fdout, F_SETFL, stream->fdout_flags | O_NONBLOCK);
+
+	faux_list_add(exec->streams, stream);
+	faux_eloop_add_fd(exec->eloop, fdin, POLLIN, stream_ev, stream);
+	faux_eloop_add_fd(exec->eloop, fdout, 0, stream_ev, stream);
+
+	if (pid)
+		*pid = KEXEC_STREAM_PID;
+
+	return BOOL_TRUE;
+}
+
+
+// === JOB symbol execution
+// The job is executed right within daemon's event loop without fork(). It
+// exchanges data with its own helper processes (coprocesses). The sym
+// tells the descriptors to wait for and gets the polling results. Output
+// of job is written to the context's stdout and stderr by event loop. The
+// context's PID is KEXEC_JOB_PID while the job is active. If job has
+// interruptible terminal as stdin then ^C from the terminal aborts the job.
+// Poll and event functions use job's own state only so they're not locked.
+
+
+static bool_t job_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+
+
+// Registers or unregisters job's descriptors within event loop
+static void job_watch(kexec_job_t *job, faux_eloop_t *eloop, bool_t add)
+{
+	size_t i = 0;
+
+	if (!eloop)
+		return;
+	for (i = 0; i < job->fds_num; i++) {
+		if (add)
+			faux_eloop_add_fd(eloop, job->fds[i].fd,
+				job->fds[i].events, job_ev, job);
+		else
+			faux_eloop_del_fd(eloop, job->fds[i].fd);
+	}
+}
+
+
+// Registers or unregisters own descriptors of job within event loop
+static void job_watch_own(kexec_job_t *job, faux_eloop_t *eloop, bool_t add)
+{
+	int fds[] = {job->fdin, job->fdout, job->fderr};
+	short events[] = {POLLIN, 0, 0};
+	size_t i = 0;
+
+	if (!eloop)
+		return;
+	for (i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+		if (fds[i] < 0)
+			continue;
+		if (add)
+			faux_eloop_add_fd(eloop, fds[i], events[i],
+				job_ev, job);
+		else
+			faux_eloop_del_fd(eloop, fds[i]);
+	}
+}
+
+
+static void job_move(kexec_job_t *job, faux_eloop_t *eloop)
+{
+	job_watch(job, job->exec->eloop, BOOL_FALSE);
+	job_watch_own(job, job->exec->eloop, BOOL_FALSE);
+	job_watch(job, eloop, BOOL_TRUE);
+	job_watch_own(job, eloop, BOOL_TRUE);
+	// Output is written on POLLOUT. The events are restored by next
+	// job_update().
+	if (eloop && (job->fdout >= 0) && (faux_buf_len(job->bufout) > 0))
+		faux_eloop_include_fd_event(eloop, job->fdout, POLLOUT);
+	if (eloop && (job->fderr >= 0) && (faux_buf_len(job->buferr) > 0))
+		faux_eloop_include_fd_event(eloop, job->fderr, POLLOUT);
+}
+
+
+// Stops interrupt watching and restores terminal settings
+static void job_release_in(kexec_job_t *job)
+{
+	if (job->fdin < 0)
+		return;
+	if (job->exec->eloop)
+		faux_eloop_del_fd(job->exec->eloop, job->fdin);
+	tcsetattr(job->fdin, TCSANOW, &job->fdin_termios);
+	close(job->fdin);
+	job->fdin = -1;
+}
+
+
+// Stops output and drops the rest of data
+static void job_release_out(kexec_job_t *job, int *fd, faux_buf_t *buf)
+{
+	if (*fd >= 0) {
+		if (job->exec->eloop)
+			faux_eloop_del_fd(job->exec->eloop, *fd);
+		close(*fd);
+		*fd = -1;
+	}
+	faux_buf_empty(buf);
+}
+
+
+// Finishes job. Output buffers are not passed to aborted job.
+static void job_finish(kexec_job_t *job, bool_t abort)
+{
+	if (!job->state)
+		return;
+
+	job_watch(job, job->exec->eloop, BOOL_FALSE);
+	job->fds_num = 0;
+	ksym_lock(job->sym);
+	job->retcode = ksym_job_fini(job->sym)(job->state,
+		abort ? NULL : job->bufout, abort ? NULL : job->buferr);
+	ksym_unlock(job->sym);
+	job->state = NULL;
+	job_release_in(job);
+}
+
+
+static void kexec_job_free(kexec_job_t *job)
+{
+	if (!job)
+		return;
+
+	// Aborted job. Nobody needs its output
+	job_finish(job, BOOL_TRUE);
+	job_release_out(job, &job->fdout, job->bufout);
+	job_release_out(job, &job->fderr, job->buferr);
+	faux_buf_free(job->bufout);
+	faux_buf_free(job->buferr);
+
+	faux_free(job);
+}
+
+
+// Job is done and its output is written. Continue ACTION sequence like
+// forked process is terminated.
+static bool_t job_complete(kexec_job_t *job)
+{
+	kexec_t *exec = job->exec;
+	kcontext_t *context = job->context;
+	int retcode = job->retcode;
+	faux_list_node_t *iter = NULL;
+
+	for (iter = faux_list_head(exec->jobs); iter;
+		iter = faux_list_next_node(iter)) {
+		if (faux_list_data(iter) == job) {
+			faux_list_del(exec->jobs, iter);
+			break;
+		}
+	}
+
+	exec_action_sequence(exec, context, KEXEC_JOB_PID,
+		(retcode & 0xff) << 8);
+
+	// Callback can free exec
+	if (exec->event_cb)
+		return exec->event_cb(exec, exec->event_udata);
+
+	return BOOL_TRUE;
+}
+
+
+// Writes job's output and manages polling
+static bool_t job_update(kexec_job_t *job)
+{
+	faux_eloop_t *eloop = job->exec->eloop;
+	int *fds[] = {&job->fdout, &job->fderr};
+	faux_buf_t *bufs[] = {job->bufout, job->buferr};
+	bool_t pending = BOOL_FALSE;
+	size_t i = 0;
+
+	for (i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+		if (*fds[i] < 0)
+			continue;
+		// Nobody reads output. Drop the rest of data
+		if (!buf_write_nonblock(bufs[i], *fds[i]))
+			job_release_out(job, fds[i], bufs[i]);
+		if (faux_buf_len(bufs[i]) > 0) {
+			faux_eloop_include_fd_event(eloop, *fds[i], POLLOUT);
+			pending = BOOL_TRUE;
+		} else if (*fds[i] >= 0) {
+			faux_eloop_exclude_fd_event(eloop, *fds[i], POLLOUT);
+		}
+	}
+
+	if (job->state) {
+		// Pause job while output buffer is full
+		job_watch(job, eloop, BOOL_FALSE);
+		job->fds_num = 0;
+		if ((faux_buf_len(job->bufout) >= KEXEC_STREAM_BUF_LIMIT) ||
+			(faux_buf_len(job->buferr) >= KEXEC_STREAM_BUF_LIMIT))
+			return BOOL_TRUE;
+		job->fds_num = ksym_job_poll(job->sym)(job->state,
+			job->fds, KEXEC_JOB_FDS_MAX);
+		if (job->fds_num > 0) {
+			job_watch(job, eloop, BOOL_TRUE);
+			return BOOL_TRUE;
+		}
+		// Job is done
+		job_finish(job, BOOL_FALSE);
+		if ((faux_buf_len(job->bufout) > 0) ||
+			(faux_buf_len(job->buferr) > 0))
+			return job_update(job);
+	}
+
+	if (pending)
+		return BOOL_TRUE;
+
+	job_release_out(job, &job->fdout, job->bufout);
+	job_release_out(job, &job->fderr, job->buferr);
+
+	return job_complete(job);
+}
+
+
+// Gets input of terminal. Returns BOOL_TRUE if interrupt is requested.
+static bool_t job_interrupted(kexec_job_t *job)
+{
+	char data[256] = {};
+	ssize_t r = 0;
+
+	r = read(job->fdin, data, sizeof(data));
+	if (r < 0) {
+		if ((EINTR == errno) || (EAGAIN == errno))
+			return BOOL_FALSE;
+		job_release_in(job);
+		return BOOL_FALSE;
+	}
+	if (0 == r) {
+		job_release_in(job);
+		return BOOL_FALSE;
+	}
+
+	// Script can't get user's input so drop other data
+	return memchr(data, KEXEC_JOB_INTERRUPT, r) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+static bool_t job_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	kexec_job_t *job = (kexec_job_t *)user_data;
+	size_t i = 0;
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+
+	if (info->fd == job->fdin) {
+		if (job_interrupted(job))
+			job_finish(job, BOOL_TRUE);
+		return job_update(job);
+	}
+
+	// Nobody reads output. Drop the rest of data. The POLLOUT is
+	// processed by job_update().
+	if ((info->fd == job->fdout) || (info->fd == job->fderr)) {
+		if (info->revents & (POLLHUP | POLLERR | POLLNVAL)) {
+			if (info->fd == job->fdout)
+				job_release_out(job, &job->fdout, job->bufout);
+			else
+				job_release_out(job, &job->fderr, job->buferr);
+		}
+		return job_update(job);
+	}
+
+	if (!job->state)
+		return job_update(job);
+	for (i = 0; i < job->fds_num; i++)
+		job->fds[i].revents = (job->fds[i].fd == info->fd) ?
+			info->revents : 0;
+	ksym_job_event(job->sym)(job->state, job->fds, job->fds_num,
+		job->bufout, job->buferr);
+
+	return job_update(job);
+}
+
+
+// Watch for ^C from interruptible terminal. Terminal is switched to
+// non-canonical mode without signals to get the symbol. Terminal settings
+// are restored when job is done.
+static void job_watch_interrupt(kexec_job_t *job, const kaction_t *action)
+{
+	struct termios t = {};
+	int fd = kcontext_stdin(job->context);
+
+	if ((fd < 0) || !isatty(fd) || !kaction_interrupt(action))
+		return;
+	if ((job->fdin = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0)
+		return;
+	if (tcgetattr(job->fdin, &job->fdin_termios) < 0) {
+		close(job->fdin);
+		job->fdin = -1;
+		return;
+	}
+	t = job->fdin_termios;
+	t.c_lflag &= ~(ICANON | ISIG);
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
+	tcsetattr(job->fdin, TCSANOW, &t);
+}
+
+
+// Returns BOOL_FALSE if sym can't be executed as in-daemon job. Then it
+// will be forked.
+static bool_t exec_action_job(kexec_t *exec, kcontext_t *context,
+	const kaction_t *action, pid_t *pid)
+{
+	ksym_t *sym = NULL;
+	kexec_job_t *job = NULL;
+	void *state = NULL;
+	int fdout = -1;
+	int fderr = -1;
+
+	sym = kaction_sym(action);
+	if (!exec->eloop || !ksym_is_job(sym))
+		return BOOL_FALSE;
+	// Service ACTIONs are executed by local event loops
+	if (exec->type != KCONTEXT_TYPE_ACTION)
+		return BOOL_FALSE;
+
+	if ((fdout = fcntl(kcontext_stdout(context), F_DUPFD_CLOEXEC, 0)) < 0)
+		return BOOL_FALSE;
+	if ((fderr = fcntl(kcontext_stderr(context), F_DUPFD_CLOEXEC, 0)) < 0) {
+		close(fdout);
+		return BOOL_FALSE;
+	}
+
+	ksym_lock(sym);
+	state = ksym_job_init(sym)(context);
+	ksym_unlock(sym);
+	if (!state) {
+		close(fdout);
+		close(fderr);
+		return BOOL_FALSE;
+	}
+
+	job = faux_zmalloc(sizeof(*job));
+	assert(job);
+	job->exec = exec;
+	job->context = context;
+	job->sym = sym;
+	job->state = state;
+	job->fds_num = 0;
+	job->fdin = -1;
+	job->fdout = fdout;
+	job->fderr = fderr;
+	job->bufout = faux_buf_new(0);
+	job->buferr = faux_buf_new(0);
+	job->retcode = 0;
+	job_watch_interrupt(job, action);
+
+	faux_list_add(exec->jobs, job);
+	job_watch_own(job, exec->eloop, BOOL_TRUE);
+	// Job will be polled by event loop first time. Job can be done
+	// immediately but ACTION sequence must not be continued recursively.
+	faux_eloop_include_fd_event(exec->eloop, job->fdout, POLLOUT);
+
+	if (pid)
+		*pid = KEXEC_JOB_PID;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t exec_action(kexec_t *exec, kcontext_t *context,
 	const kaction_t *action, pid_t *pid, int *retcode)
 {
 	bool_t rc = BOOL_FALSE;
@@ -656,6 +2011,10 @@ static bool_t exec_action(const kexec_t *exec, kcontext_t *context,
 
 	if (kaction_is_sync(action))
 		rc = exec_action_sync(exec, context, action, pid, retcode);
+	else if (exec_action_stream(exec, context, action, pid))
+		rc = BOOL_TRUE;
+	else if (exec_action_job(exec, context, action, pid))
+		rc = BOOL_TRUE;
 	else
 		rc = exec_action_async(exec, context, action, pid);
 
@@ -663,12 +2022,12 @@ static bool_t exec_action(const kexec_t *exec, kcontext_t *context,
 }
 
 
-static bool_t exec_action_sequence(const kexec_t *exec, kcontext_t *context,
+static bool_t exec_action_sequence(kexec_t *exec, kcontext_t *context,
 	pid_t pid, int wstatus)
 {
 	faux_list_node_t *iter = NULL;
 	int exitstatus = WEXITSTATUS(wstatus);
-	pid_t new_pid = -1; // PID of newly forked ACTION process
+	pid_t new_pid = -1; // PID of newly forked ACTION process or stream stage
 
 	assert(context);
 	if (!context)
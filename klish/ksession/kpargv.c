@@ -4,12 +4,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <syslog.h>
 
 #include <faux/list.h>
 #include <faux/error.h>
 #include <klish/khelper.h>
 #include <klish/kentry.h>
+#include <klish/karena.h>
+#include <klish/kcompl.h>
 #include <klish/kpargv.h>
 
 
@@ -23,6 +26,8 @@ struct kpargv_s {
 	kpargv_purpose_e purpose; // Exec/Completion/Help
 	char *last_arg;
 	kparg_t *candidate_parg; // Don't free
+	karena_t *arena; // Storage for parse-time pargs. Created on demand
+	kcompl_t *compl; // Completion collector
 };
 
 // Status
@@ -53,6 +58,9 @@ KGET_STR(pargv, last_arg);
 KGET(pargv, kparg_t *, candidate_parg);
 KSET(pargv, kparg_t *, candidate_parg);
 
+// Completion collector
+KGET(pargv, kcompl_t *, compl);
+
 // Pargs
 KGET(pargv, faux_list_t *, pargs);
 KADD_NESTED(pargv, kparg_t *, pargs);
@@ -107,6 +115,8 @@ kpargv_t *kpargv_new()
 	pargv->purpose = KPURPOSE_EXEC;
 	pargv->last_arg = NULL;
 	pargv->candidate_parg = NULL;
+	pargv->arena = NULL;
+	pargv->compl = NULL;
 
 	// Parsed arguments list
 	pargv->pargs = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
@@ -131,11 +141,54 @@ void kpargv_free(kpargv_t *pargv)
 
 	faux_list_free(pargv->pargs);
 	faux_list_free(pargv->completions);
+	karena_free(pargv->arena); // After pargs list
+	kcompl_free(pargv->compl);
 
 	free(pargv);
 }
 
 
+/** @brief Attaches completion collector to pargv.
+ *
+ * Pargv owns the collector. Previous collector is freed.
+ */
+bool_t kpargv_set_compl(kpargv_t *pargv, kcompl_t *compl)
+{
+	assert(pargv);
+	if (!pargv)
+		return BOOL_FALSE;
+
+	if (pargv->compl != compl)
+		kcompl_free(pargv->compl);
+	pargv->compl = compl;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Creates parg within pargv's arena.
+ *
+ * Parser creates a lot of short-living pargs. Most of them are declined
+ * candidates. Arena makes such allocations cheap. All pargs and their values
+ * are freed at once with pargv. The parg can be added to another pargv
+ * that is freed before this one.
+ */
+kparg_t *kpargv_new_parg(kpargv_t *pargv, const kentry_t *entry,
+	const char *value)
+{
+	assert(pargv);
+	if (!pargv)
+		return NULL;
+
+	if (!pargv->arena) {
+		pargv->arena = karena_new(KARENA_DEFAULT_CHUNK_SIZE);
+		assert(pargv->arena);
+	}
+
+	return kparg_new_arena(pargv->arena, entry, value);
+}
+
+
 kparg_t *kpargv_pargs_last(const kpargv_t *pargv)
 {
 	assert(pargv);
@@ -258,6 +311,90 @@ faux_list_t *kpargv_find_multi(const kpargv_t *pargv, const char *entry_name)
 }
 
 
+/** @brief Groups values of pargs by entry.
+ *
+ * Function is linear. Entries are found within hash table. The groups and
+ * values are allocated as a single block that must be freed by faux_free().
+ * Returns number of groups or -1 on error.
+ */
+ssize_t kpargv_groups(const kpargv_t *pargv, kpargv_group_t **groups)
+{
+	size_t pargs_num = 0;
+	size_t groups_num = 0;
+	size_t hash_size = 1;
+	size_t *hash = NULL; // Index of group + 1. 0 - empty slot
+	size_t *pargs_group = NULL; // Group index for each parg
+	kpargv_group_t *res = NULL;
+	const char **values = NULL;
+	kpargv_pargs_node_t *iter = NULL;
+	kparg_t *parg = NULL;
+	size_t i = 0;
+
+	assert(pargv);
+	if (!pargv)
+		return -1;
+	assert(groups);
+	if (!groups)
+		return -1;
+	*groups = NULL;
+
+	pargs_num = faux_list_len(pargv->pargs);
+	if (0 == pargs_num)
+		return 0;
+	while (hash_size < (pargs_num * 2))
+		hash_size <<= 1;
+
+	// Result block: groups, then values. Groups number is not known
+	// yet so reserve space for the worst case.
+	res = faux_zmalloc(pargs_num * sizeof(*res) +
+		pargs_num * sizeof(*values));
+	assert(res);
+	if (!res)
+		return -1;
+	values = (const char **)(res + pargs_num);
+	hash = faux_zmalloc(hash_size * sizeof(*hash) +
+		pargs_num * sizeof(*pargs_group));
+	assert(hash);
+	if (!hash) {
+		faux_free(res);
+		return -1;
+	}
+	pargs_group = hash + hash_size;
+
+	// Find group for each parg and count values
+	iter = kpargv_pargs_iter(pargv);
+	for (i = 0; (parg = kpargv_pargs_each(&iter)); i++) {
+		const kentry_t *entry = kparg_entry(parg);
+		size_t slot = ((uintptr_t)entry >> 4) & (hash_size - 1);
+		while (hash[slot] && (res[hash[slot] - 1].entry != entry))
+			slot = (slot + 1) & (hash_size - 1);
+		if (!hash[slot]) {
+			res[groups_num].entry = entry;
+			hash[slot] = ++groups_num;
+		}
+		pargs_group[i] = hash[slot] - 1;
+		res[pargs_group[i]].num++;
+	}
+
+	// Distribute values
+	for (i = 0; i < groups_num; i++) {
+		res[i].values = values;
+		values += res[i].num;
+		res[i].num = 0;
+	}
+	iter = kpargv_pargs_iter(pargv);
+	for (i = 0; (parg = kpargv_pargs_each(&iter)); i++) {
+		kpargv_group_t *group = &res[pargs_group[i]];
+		group->values[group->num++] = kparg_value(parg);
+	}
+
+	faux_free(hash);
+	*groups = res;
+
+	return groups_num;
+}
+
+
 bool_t kpargv_debug(const kpargv_t *pargv)
 {
 #ifdef PARGV_DEBUG
@@ -267,7 +404,7 @@ bool_t kpargv_debug(const kpargv_t *pargv)
 	if (!pargv)
 		return BOOL_FALSE;
 
-	printf("Level: %lu, Command: %s, Status: %s\n",
+	printf("Level: %zu, Command: %s, Status: %s\n",
 		kpargv_level(pargv),
 		kpargv_command(pargv) ? kentry_name(kpargv_command(pargv)) : "<none>",
 		kpargv_status_str(pargv));
@@ -282,6 +419,14 @@ bool_t kpargv_debug(const kpargv_t *pargv)
 		printf("\n");
 	}
 
+	// Arena statistics
+	if (pargv->arena) {
+		printf("Arena: %zu allocs within %zu chunks, %zu bytes\n",
+			karena_allocs(pargv->arena),
+			karena_chunks(pargv->arena),
+			karena_used(pargv->arena));
+	}
+
 	// Completions
 	if (!kpargv_completions_is_empty(pargv)) {
 		const kentry_t *completion = NULL;
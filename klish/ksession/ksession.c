@@ -1,16 +1,28 @@
 /** @file ksession.c
  */
+#define _GNU_SOURCE
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <limits.h>
+#include <signal.h>
 
 #include <klish/khelper.h>
 #include <klish/kscheme.h>
 #include <klish/kpath.h>
 #include <klish/ksession.h>
+#include <klish/kcompl.h>
+#include <klish/kzygote.h>
+#include <klish/kustore.h>
+
+
+#define PTMX_PATH "/dev/ptmx"
 
 
 struct ksession_s {
@@ -26,6 +38,23 @@ struct ksession_s {
 	bool_t isatty_stdin;
 	bool_t isatty_stdout;
 	bool_t isatty_stderr;
+	kcache_t *cache; // PTYPE validation cache
+	// Validation results of previous completion/help parsing. Consecutive
+	// completion requests usually differ by the last argument only.
+	kcache_t *parse_cache;
+	char *parse_cache_path; // Key of path cache belongs to
+	char *parse_cache_line; // Last completed line
+	bool_t parse_cache_active; // Completion/help parsing is in progress
+	unsigned int completion_timeout; // Completion/help timeout (ms)
+	size_t completion_max; // Max number of completion items
+	faux_list_t *stats; // Completion/help execution statistics
+	kzygote_t *zygote; // Spawns async ACTIONs
+	// Pseudo terminal is created once and is leased by kexecs
+	int ptm; // Master
+	int pts; // Slave
+	char *pts_fname;
+	struct termios pts_termios; // Initial terminal settings
+	kustore_t *ustore; // Plugins' per-session data
 };
 
 
@@ -35,6 +64,61 @@ KGET(session, kscheme_t *, scheme);
 // Path
 KGET(session, kpath_t *, path);
 
+// PTYPE validation cache
+KGET(session, kcache_t *, cache);
+
+// Completion/help parsing cache
+KGET(session, kcache_t *, parse_cache);
+KGET_STR(session, parse_cache_path);
+KSET_STR(session, parse_cache_path);
+KGET_STR(session, parse_cache_line);
+KSET_STR(session, parse_cache_line);
+KGET_BOOL(session, parse_cache_active);
+KSET_BOOL(session, parse_cache_active);
+
+// Completion/help timeout
+KGET(session, unsigned int, completion_timeout);
+KSET(session, unsigned int, completion_timeout);
+
+// Max number of completion items
+KGET(session, size_t, completion_max);
+KSET(session, size_t, completion_max);
+
+// Zygote
+KGET(session, kzygote_t *, zygote);
+KSET(session, kzygote_t *, zygote);
+
+// Completion/help execution statistics
+KNESTED_ITER(session, stats);
+KNESTED_EACH(session, ksession_stat_t *, stats);
+
+
+static void ksession_pty_close(ksession_t *session);
+
+
+static int ksession_stat_compare(const void *first, const void *second)
+{
+	const ksession_stat_t *f = (const ksession_stat_t *)first;
+	const ksession_stat_t *s = (const ksession_stat_t *)second;
+
+	if (f->entry == s->entry)
+		return 0;
+
+	return (f->entry < s->entry) ? -1 : 1;
+}
+
+
+static int ksession_stat_kcompare(const void *key, const void *list_item)
+{
+	const kentry_t *f = (const kentry_t *)key;
+	const ksession_stat_t *s = (const ksession_stat_t *)list_item;
+
+	if (f == s->entry)
+		return 0;
+
+	return (f < s->entry) ? -1 : 1;
+}
+
 // Done
 KGET_BOOL(session, done);
 KSET_BOOL(session, done);
@@ -121,6 +205,24 @@ ksession_t *ksession_new(kscheme_t *scheme, const char *start_entry)
 	session->isatty_stdout = BOOL_FALSE;
 	session->isatty_stderr = BOOL_FALSE;
 	session->spid = getpid(); // For forked processes
+	session->cache = kcache_new(KCACHE_DEFAULT_MAX_LEN);
+	assert(session->cache);
+	session->parse_cache = kcache_new(KCACHE_DEFAULT_MAX_LEN);
+	assert(session->parse_cache);
+	session->parse_cache_path = NULL;
+	session->parse_cache_line = NULL;
+	session->parse_cache_active = BOOL_FALSE;
+	session->completion_timeout = 0; // Unlimited
+	session->completion_max = KCOMPL_DEFAULT_MAX_LEN;
+	session->stats = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
+		ksession_stat_compare, ksession_stat_kcompare, faux_free);
+	assert(session->stats);
+	session->zygote = NULL;
+	session->ptm = -1;
+	session->pts = -1;
+	session->pts_fname = NULL;
+	session->ustore = kustore_new();
+	assert(session->ustore);
 
 	return session;
 }
@@ -131,8 +233,241 @@ void ksession_free(ksession_t *session)
 	if (!session)
 		return;
 
+	// Plugins' data can refer to other session's fields
+	kustore_free(session->ustore);
 	kpath_free(session->path);
 	faux_str_free(session->user);
+	kcache_free(session->cache);
+	kcache_free(session->parse_cache);
+	faux_str_free(session->parse_cache_path);
+	faux_str_free(session->parse_cache_line);
+	faux_list_free(session->stats);
+	kzygote_free(session->zygote);
+	ksession_pty_close(session);
 
 	free(session);
 }
+
+
+/** @brief Drops all cached PTYPE validation results.
+ *
+ * Actions that change something PTYPEs depend on (interface list etc.)
+ * must call it.
+ */
+void ksession_cache_invalidate(ksession_t *session)
+{
+	assert(session);
+	if (!session)
+		return;
+
+	kcache_clear(session->cache);
+	kcache_clear(session->parse_cache);
+}
+
+
+/** @brief Updates execution statistics of completion/help ENTRY.
+ *
+ * Statistics shows completion sources that exceed the time limit.
+ */
+bool_t ksession_stat_update(ksession_t *session, const kentry_t *entry,
+	unsigned int time, bool_t timed_out)
+{
+	ksession_stat_t *stat = NULL;
+
+	assert(session);
+	if (!session)
+		return BOOL_FALSE;
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+
+	stat = (ksession_stat_t *)faux_list_kfind(session->stats, entry);
+	if (!stat) {
+		stat = faux_zmalloc(sizeof(*stat));
+		assert(stat);
+		if (!stat)
+			return BOOL_FALSE;
+		stat->entry = entry;
+		if (!faux_list_add(session->stats, stat)) {
+			faux_free(stat);
+			return BOOL_FALSE;
+		}
+	}
+	stat->runs++;
+	if (timed_out)
+		stat->timeouts++;
+	if (time > stat->max_time)
+		stat->max_time = time;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Sets window size of session's pseudo terminal.
+ *
+ * Size is got from term_width and term_height fields. Pseudo terminal
+ * keeps the size between commands so it's necessary to call function on
+ * terminal size change only.
+ */
+bool_t ksession_pty_set_winsize(ksession_t *session)
+{
+	struct winsize ws = {};
+
+	assert(session);
+	if (!session)
+		return BOOL_FALSE;
+	if (session->pts < 0)
+		return BOOL_FALSE;
+	if ((session->term_width == 0) || (session->term_height == 0))
+		return BOOL_FALSE;
+
+	ws.ws_col = (unsigned short)session->term_width;
+	ws.ws_row = (unsigned short)session->term_height;
+	if (ioctl(session->pts, TIOCSWINSZ, &ws) < 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static void ksession_pty_close(ksession_t *session)
+{
+	if (session->pts != -1)
+		close(session->pts);
+	session->pts = -1;
+	if (session->ptm != -1)
+		close(session->ptm);
+	session->ptm = -1;
+	faux_str_free(session->pts_fname);
+	session->pts_fname = NULL;
+}
+
+
+// Process of previous command can be still alive (it ignores SIGHUP or
+// command is finished before its children). It holds pts as controlling
+// terminal so the new command can't get it and it can read input and write
+// output of the new command. Such session is hung up and the pseudo
+// terminal is replaced by fresh one. Closing of old master hangs up the
+// rest of old pts users. The session and process group are got through
+// master because pts is not a controlling terminal of klishd.
+static bool_t ksession_pty_hangup(ksession_t *session)
+{
+	pid_t sid = -1;
+	pid_t pgrp = -1;
+
+	if ((ioctl(session->ptm, TIOCGSID, &sid) < 0) || (sid <= 0))
+		return BOOL_FALSE; // Terminal is free
+	pgrp = tcgetpgrp(session->ptm);
+	if ((pgrp > 0) && (pgrp != getpgrp()))
+		kill(-pgrp, SIGHUP);
+	if (sid != getsid(0))
+		kill(-sid, SIGHUP);
+	ksession_pty_close(session);
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t ksession_pty_open(ksession_t *session)
+{
+	int fflags = 0;
+	char pts_name[PATH_MAX] = {};
+
+	session->ptm = open(PTMX_PATH, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (session->ptm < 0)
+		return BOOL_FALSE;
+	// Set O_NONBLOCK flag here. Because this flag is ignored while
+	// open() ptmx. I don't know why. fcntl() is working fine.
+	fflags = fcntl(session->ptm, F_GETFL);
+	fcntl(session->ptm, F_SETFL, fflags | O_NONBLOCK);
+	if ((grantpt(session->ptm) < 0) || (unlockpt(session->ptm) < 0) ||
+		(ptsname_r(session->ptm, pts_name, sizeof(pts_name)) != 0)) {
+		ksession_pty_close(session);
+		return BOOL_FALSE;
+	}
+	// Opened pts keeps terminal settings between commands and makes
+	// action (from child) to don't send SIGHUP on terminal handler.
+	session->pts = open(pts_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (session->pts < 0) {
+		ksession_pty_close(session);
+		return BOOL_FALSE;
+	}
+	session->pts_fname = faux_str_dup(pts_name);
+	tcgetattr(session->pts, &session->pts_termios);
+	ksession_pty_set_winsize(session);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Leases session's pseudo terminal to the command.
+ *
+ * Pseudo terminal is created on first request. Later it's reused by all
+ * commands of the session. Terminal settings changed by previous command
+ * are restored and unread data is dropped. If the terminal is still
+ * owned by left process of previous command then the process is hung up
+ * and the new pseudo terminal is created. Returned descriptors are
+ * dup()-ed so caller owns and closes them. The pts_fname belongs to
+ * session.
+ */
+bool_t ksession_pty_lease(ksession_t *session, int *ptm, int *pts,
+	const char **pts_fname)
+{
+	int m = -1;
+	int s = -1;
+
+	assert(session);
+	if (!session)
+		return BOOL_FALSE;
+
+	if (session->ptm >= 0)
+		ksession_pty_hangup(session);
+	if ((session->ptm < 0) && !ksession_pty_open(session))
+		return BOOL_FALSE;
+
+	// Reset pseudo terminal after previous command
+	tcsetattr(session->pts, TCSANOW, &session->pts_termios);
+	tcflush(session->pts, TCIOFLUSH);
+	tcflush(session->ptm, TCIOFLUSH);
+
+	if ((m = fcntl(session->ptm, F_DUPFD_CLOEXEC, 0)) < 0)
+		return BOOL_FALSE;
+	if ((s = fcntl(session->pts, F_DUPFD_CLOEXEC, 0)) < 0) {
+		close(m);
+		return BOOL_FALSE;
+	}
+	if (ptm)
+		*ptm = m;
+	if (pts)
+		*pts = s;
+	if (pts_fname)
+		*pts_fname = session->pts_fname;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t ksession_named_udata_new(ksession_t *session,
+	const char *name, void *data, kudata_data_free_fn free_fn)
+{
+	assert(session);
+	if (!session)
+		return BOOL_FALSE;
+	assert(session->ustore);
+
+	if (!kustore_slot_new(session->ustore, name, data, free_fn))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+void *ksession_named_udata(const ksession_t *session, const char *name)
+{
+	assert(session);
+	if (!session)
+		return NULL;
+	assert(session->ustore);
+
+	return kustore_slot_data(session->ustore, name);
+}
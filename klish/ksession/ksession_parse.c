@@ -4,11 +4,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <syslog.h>
+#include <time.h>
 
 #include <faux/eloop.h>
 #include <faux/buf.h>
@@ -20,12 +22,71 @@
 #include <klish/kpath.h>
 #include <klish/kpargv.h>
 #include <klish/kexec.h>
+#include <klish/kcontext.h>
 #include <klish/ksession.h>
 #include <klish/ksession_parse.h>
 
 
 #define ARGV_ALT_QUOTES "'"
 
+// Bitmap of already entered nested ENTRYs within SEQUENCE. Bitmap for
+// regular schemes fits stack buffer.
+#define SEQ_BITMAP_WORD_BITS (sizeof(unsigned long) * CHAR_BIT)
+#define SEQ_BITMAP_LOCAL_WORDS 4
+#define SEQ_BITMAP_WORDS(bits) \
+	(((bits) + SEQ_BITMAP_WORD_BITS - 1) / SEQ_BITMAP_WORD_BITS)
+#define SEQ_BITMAP_TEST(map, bit) \
+	((map)[(bit) / SEQ_BITMAP_WORD_BITS] & \
+	(1UL << ((bit) % SEQ_BITMAP_WORD_BITS)))
+#define SEQ_BITMAP_SET(map, bit) \
+	((map)[(bit) / SEQ_BITMAP_WORD_BITS] |= \
+	(1UL << ((bit) % SEQ_BITMAP_WORD_BITS)))
+
+
+// Key of already parsed arguments. PTYPE can depend on previous arguments
+// so cached validation result is valid for the same ones only. Value length
+// is a part of key so different argument lists can't give the same key.
+static char *ksession_pargv_key(const kpargv_t *pargv)
+{
+	kpargv_pargs_node_t *iter = NULL;
+	kparg_t *parg = NULL;
+	char *key = faux_str_dup("");
+
+	iter = kpargv_pargs_iter(pargv);
+	while ((parg = kpargv_pargs_each(&iter))) {
+		const char *value = kparg_value(parg);
+		char *tmp = NULL;
+
+		if (!value)
+			value = "";
+		tmp = faux_str_sprintf("%p:%zu:", kparg_entry(parg),
+			strlen(value));
+		faux_str_cat(&key, tmp);
+		faux_str_free(tmp);
+		faux_str_cat(&key, value);
+	}
+
+	return key;
+}
+
+
+// Key of current path. Parse cache is valid for the same path only.
+static char *ksession_path_key(const ksession_t *session)
+{
+	kpath_levels_node_t *iter = NULL;
+	klevel_t *level = NULL;
+	char *key = faux_str_dup("");
+
+	iter = kpath_iter(ksession_path(session));
+	while ((level = kpath_each(&iter))) {
+		char *tmp = faux_str_sprintf("%p;", klevel_entry(level));
+		faux_str_cat(&key, tmp);
+		faux_str_free(tmp);
+	}
+
+	return key;
+}
+
 
 static bool_t ksession_validate_arg(ksession_t *session, kpargv_t *pargv)
 {
@@ -33,6 +94,11 @@ static bool_t ksession_validate_arg(ksession_t *session, kpargv_t *pargv)
 	int retcode = -1;
 	const kentry_t *ptype_entry = NULL;
 	kparg_t *candidate = NULL;
+	kentry_cache_e cache = KENTRY_CACHE_NONE;
+	kcache_t *kcache = NULL;
+	unsigned int ttl = KCACHE_TTL_INFINITE;
+	char *key = NULL;
+	const char *value = NULL;
 
 	assert(session);
 	if (!session)
@@ -48,16 +114,70 @@ static bool_t ksession_validate_arg(ksession_t *session, kpargv_t *pargv)
 	if (!ptype_entry)
 		return BOOL_FALSE;
 
+	// Try to get cached validation result. PTYPE must request caching
+	// explicitly. The "input" results live while the same line is being
+	// completed only.
+	cache = kentry_cache(ptype_entry);
+	if (KENTRY_CACHE_INPUT == cache) {
+		if (ksession_parse_cache_active(session))
+			kcache = ksession_parse_cache(session);
+	} else if (cache != KENTRY_CACHE_NONE) {
+		kcache = ksession_cache(session);
+		if (KENTRY_CACHE_TTL == cache)
+			ttl = kentry_cache_ttl(ptype_entry);
+	}
+	value = kparg_value(candidate);
+	if (kcache && value) {
+		const char *cached_out = NULL;
+		key = ksession_pargv_key(pargv);
+		if (kcache_find(kcache, ptype_entry, value,
+			key, &retcode, &cached_out)) {
+			faux_str_free(key);
+			if (retcode != 0)
+				return BOOL_FALSE;
+			if (!faux_str_is_empty(cached_out))
+				kparg_set_value(candidate, cached_out);
+			return BOOL_TRUE;
+		}
+	}
+
 	if (!ksession_exec_locally(session, ptype_entry, pargv, NULL, NULL,
 		&retcode, &out)) {
+		faux_str_free(key);
 		return BOOL_FALSE;
 	}
 
-	if (retcode != 0)
+	if (kcache && value)
+		kcache_add(kcache, ptype_entry, value, key, ttl,
+			retcode, out);
+	faux_str_free(key);
+
+	if (retcode != 0) {
+		faux_str_free(out);
 		return BOOL_FALSE;
+	}
 
 	if (!faux_str_is_empty(out))
 		kparg_set_value(candidate, out);
+	faux_str_free(out);
+
+	return BOOL_TRUE;
+}
+
+
+// Current argument is entered completely i.e. it's not the last argument
+// to complete. Such argument can match only ENTRYs with the suitable
+// keyword (if ENTRY has a keyword).
+static bool_t ksession_arg_is_complete(const kpargv_t *pargv,
+	faux_argv_node_t *argv_iter)
+{
+	kpargv_purpose_e purpose = kpargv_purpose(pargv);
+
+	if (!argv_iter)
+		return BOOL_FALSE;
+	if (((KPURPOSE_COMPLETION == purpose) || (KPURPOSE_HELP == purpose)) &&
+		faux_argv_is_last(argv_iter) && kpargv_continuable(pargv))
+		return BOOL_FALSE;
 
 	return BOOL_TRUE;
 }
@@ -100,7 +220,7 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 		// Command is an ENTRY with ACTIONs
 		if (kentry_actions_len(entry) <= 0)
 			return KPARSE_ERROR;
-		parg = kparg_new(entry, NULL);
+		parg = kpargv_new_parg(pargv, entry, NULL);
 		kpargv_add_pargs(pargv, parg);
 		kpargv_set_command(pargv, entry);
 		retcode = KPARSE_OK;
@@ -143,7 +263,7 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 
 		// Validate argument
 		current_arg = faux_argv_current(*argv_iter);
-		parg = kparg_new(entry, current_arg);
+		parg = kpargv_new_parg(pargv, entry, current_arg);
 		kpargv_set_candidate_parg(pargv, parg);
 		if (ksession_validate_arg(session, pargv)) {
 			kpargv_accept_candidate_parg(pargv);
@@ -185,12 +305,23 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 	if (KENTRY_MODE_SWITCH == mode) {
 		kentry_entrys_node_t *iter = kentry_entrys_iter(entry);
 		const kentry_t *nested = NULL;
+		kentry_index_iter_t index_iter = {};
+		bool_t use_index = BOOL_FALSE;
+
+		// Keyword index allows to skip nested entries with COMMAND
+		// PTYPEs that can't match current argument. Don't use it
+		// when the last argument is completed because all entries
+		// must be added to completions list.
+		if (ksession_arg_is_complete(pargv, *argv_iter))
+			use_index = kentry_index_iter_init(entry,
+				faux_argv_current(*argv_iter), &index_iter);
 
 //if (kentry_purpose(entry) == KENTRY_PURPOSE_COMMON)
 //fprintf(stderr, "SWITCH: name=%s, arg %s\n", kentry_name(entry),
 //*argv_iter ? faux_argv_current(*argv_iter) : "<empty>");
 
-		while ((nested = kentry_entrys_each(&iter))) {
+		while ((nested = use_index ? kentry_index_each(&index_iter) :
+			kentry_entrys_each(&iter))) {
 			kpargv_status_e res = KPARSE_NONE;
 			// Ignore entries with non-COMMON purpose.
 			if (kentry_purpose(nested) != KENTRY_PURPOSE_COMMON)
@@ -209,25 +340,40 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 //kentry_name(entry), kentry_name(nested), kpargv_status_decode(res));
 			// Save choosen entry name to container's value
 			if ((res == KPARSE_OK) && kentry_container(entry)) {
-				kparg_t *parg = kparg_new(entry, kentry_name(nested));
+				kparg_t *parg = kpargv_new_parg(pargv, entry,
+					kentry_name(nested));
 				kpargv_add_pargs(pargv, parg);
 			}
 			// Try next entries if current status is NOTFOUND or NONE
 			if ((res == KPARSE_OK) || (res == KPARSE_ERROR))
 				break;
 		}
+		// Linear scan returns the status of the last declared nested
+		// entry. Skipped entries are NOTFOUND. So the result is the
+		// same as for linear scan.
+		if (use_index && (rc != KPARSE_OK) && (rc != KPARSE_ERROR) &&
+			!kentry_index_last_visited(&index_iter))
+			rc = KPARSE_NOTFOUND;
 
 	// SEQUENCE mode
 	} else if (KENTRY_MODE_SEQUENCE == mode) {
 		kentry_entrys_node_t *iter = kentry_entrys_iter(entry);
 		kentry_entrys_node_t *saved_iter = iter;
 		const kentry_t *nested = NULL;
-		kpargv_t *cur_level_pargv = kpargv_new();
+		size_t nested_num = kentry_entrys_len(entry);
+		unsigned long entered_local[SEQ_BITMAP_LOCAL_WORDS] = {};
+		unsigned long *entered = entered_local;
+
+		if (SEQ_BITMAP_WORDS(nested_num) > SEQ_BITMAP_LOCAL_WORDS)
+			entered = faux_zmalloc(SEQ_BITMAP_WORDS(nested_num) *
+				sizeof(*entered));
 
 		while ((nested = kentry_entrys_each(&iter))) {
 			kpargv_status_e res = KPARSE_NONE;
 			size_t num = 0;
 			size_t min = kentry_min(nested);
+			size_t pos = kentry_pos(nested);
+			const char *keyword = NULL;
 			bool_t break_loop = BOOL_FALSE;
 			bool_t consumed = BOOL_FALSE;
 
@@ -235,7 +381,15 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 			if (kentry_purpose(nested) != KENTRY_PURPOSE_COMMON)
 				continue;
 			// Filter out double parsing for optional entries.
-			if (kpargv_entry_exists(cur_level_pargv, nested))
+			if ((pos < nested_num) && SEQ_BITMAP_TEST(entered, pos))
+				continue;
+			// Optional keyword can't match current argument. It's the
+			// same result as NOTFOUND from PTYPE so don't execute it.
+			keyword = kentry_keyword(nested);
+			if ((0 == min) && keyword &&
+				ksession_arg_is_complete(pargv, *argv_iter) &&
+				(faux_str_casecmp(keyword,
+				faux_argv_current(*argv_iter)) != 0))
 				continue;
 //if (kentry_purpose(entry) == KENTRY_PURPOSE_COMMON)
 //fprintf(stderr, "SEQ name=%s, arg=%s\n",
@@ -272,13 +426,13 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 			if (consumed) {
 				// Remember if optional parameter was already
 				// entered
-				kparg_t *tmp_parg = kparg_new(nested, NULL);
-				kpargv_add_pargs(cur_level_pargv, tmp_parg);
+				if (pos < nested_num)
+					SEQ_BITMAP_SET(entered, pos);
 				// SEQ container will get all entered nested
 				// entry names as value within resulting pargv
 				if (kentry_container(entry)) {
-					kparg_t *parg = kparg_new(entry,
-						kentry_name(nested));
+					kparg_t *parg = kpargv_new_parg(pargv,
+						entry, kentry_name(nested));
 					kpargv_add_pargs(pargv, parg);
 				}
 				// Mandatory or ordered parameter
@@ -291,7 +445,8 @@ static kpargv_status_e ksession_parse_arg(ksession_t *session,
 					iter = saved_iter;
 			}
 		}
-		kpargv_free(cur_level_pargv);
+		if (entered != entered_local)
+			faux_free(entered);
 	}
 
 	if (rc == KPARSE_NONE)
@@ -536,6 +691,8 @@ kpargv_t *ksession_parse_for_completion(ksession_t *session,
 	faux_list_node_t *iter = NULL;
 	kpargv_t *pargv = NULL;
 	bool_t is_piped = BOOL_FALSE;
+	char *path_key = NULL;
+	const char *prev_line = NULL;
 
 	assert(session);
 	if (!session)
@@ -552,6 +709,22 @@ kpargv_t *ksession_parse_for_completion(ksession_t *session,
 	}
 	is_piped = (faux_list_len(split) > 1);
 
+	// Validation results of previous completion/help request can be used
+	// while path is the same and user continues to type the same line.
+	// Any other input drops them.
+	path_key = ksession_path_key(session);
+	prev_line = ksession_parse_cache_line(session);
+	if (!ksession_parse_cache_path(session) ||
+		(strcmp(ksession_parse_cache_path(session), path_key) != 0) ||
+		!prev_line ||
+		(strncmp(raw_line, prev_line, strlen(prev_line)) != 0)) {
+		kcache_clear(ksession_parse_cache(session));
+		ksession_set_parse_cache_path(session, path_key);
+	}
+	ksession_set_parse_cache_line(session, raw_line);
+	faux_str_free(path_key);
+	ksession_set_parse_cache_active(session, BOOL_TRUE);
+
 	iter = faux_list_head(split);
 	while (iter) {
 		faux_argv_t *argv = (faux_argv_t *)faux_list_data(iter);
@@ -570,6 +743,7 @@ kpargv_t *ksession_parse_for_completion(ksession_t *session,
 		iter = faux_list_next_node(iter);
 	}
 
+	ksession_set_parse_cache_active(session, BOOL_FALSE);
 	faux_list_free(split);
 
 	return pargv;
@@ -593,6 +767,11 @@ kexec_t *ksession_parse_for_exec(ksession_t *session, const char *raw_line,
 	if (!raw_line)
 		return NULL;
 
+	// Execution can change anything PTYPEs depend on. So the results of
+	// previous completion/help requests are not valid anymore.
+	kcache_clear(ksession_parse_cache(session));
+	ksession_set_parse_cache_line(session, NULL);
+
 	// Split raw line (with '|') to components
 	split = ksession_split_pipes(raw_line, error);
 	if (!split || (faux_list_len(split) < 1)) {
@@ -766,33 +945,40 @@ static bool_t get_stdout(kexec_t *exec)
 }
 
 
+// Process of kexec is terminated (pidfd event)
+static bool_t action_event_cb(kexec_t *exec, void *udata)
+{
+	// Check if kexec is done now
+	if (kexec_done(exec)) {
+		// May be buffer still contains data
+		get_stdout(exec);
+		return BOOL_FALSE; // To break a loop
+	}
+
+	udata = udata; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+// Processes are watched by pidfds. SIGCHLD is for systems without pidfd.
 static bool_t action_terminated_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data)
 {
-	int wstatus = 0;
-	pid_t child_pid = -1;
 	kexec_t *exec = (kexec_t *)user_data;
 
 	if (!exec)
 		return BOOL_FALSE;
 
-	// Wait for any child process. Doesn't block.
-	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0)
-		kexec_continue_command_execution(exec, child_pid, wstatus);
-
-	// Check if kexec is done now
-	if (kexec_done(exec)) {
-		// May be buffer still contains data
-		get_stdout(exec);
-		return BOOL_FALSE; // To break a loop
-	}
+	// Wait for own child processes only. Doesn't block.
+	kexec_wait_children(exec);
 
 	// Happy compiler
 	eloop = eloop;
 	type = type;
 	associated_data = associated_data;
 
-	return BOOL_TRUE;
+	return action_event_cb(exec, NULL);
 }
 
 
@@ -810,20 +996,78 @@ static bool_t action_stdout_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
+// Get output of completed kexec as C-string
+static char *ksession_exec_output(kexec_t *exec)
+{
+	faux_buf_t *buf = NULL;
+	char *cstr = NULL;
+	ssize_t len = 0;
+
+	buf = kexec_bufout(exec);
+	if ((len = faux_buf_len(buf)) <= 0)
+		return NULL;
+	cstr = faux_malloc(len + 1);
+	faux_buf_read(buf, cstr, len);
+	cstr[len] = '\0';
+
+	return cstr;
+}
+
+
+// Fast path for entries with silent sync ACTIONs only (PTYPEs like
+// COMMAND, INT, STRING etc.). Functions are called directly within
+// current process so kexec_t, pipes and local event loop are not needed.
+static bool_t ksession_exec_silently(ksession_t *session,
+	const kentry_t *entry, kpargv_t *parent_pargv,
+	const kcontext_t *parent_context, const kexec_t *parent_exec,
+	int *retcode, char **out)
+{
+	kpargv_t *pargv = NULL;
+	faux_buf_t *buf = NULL;
+	bool_t rc = BOOL_FALSE;
+	ssize_t len = 0;
+
+	// The same as ksession_parse_arg() does for predefined command
+	pargv = kpargv_new();
+	assert(pargv);
+	kpargv_set_purpose(pargv, KPURPOSE_EXEC);
+	kpargv_add_pargs(pargv, kparg_new(entry, NULL));
+	kpargv_set_command(pargv, entry);
+
+	if (out)
+		buf = faux_buf_new(0);
+
+	rc = kcontext_exec_silent(session, pargv, parent_pargv,
+		parent_context, parent_exec, buf, retcode);
+	kpargv_free(pargv);
+
+	if (rc && buf && ((len = faux_buf_len(buf)) > 0)) {
+		char *cstr = faux_malloc(len + 1);
+		faux_buf_read(buf, cstr, len);
+		cstr[len] = '\0';
+		*out = cstr;
+	}
+	faux_buf_free(buf);
+
+	return rc;
+}
+
+
 bool_t ksession_exec_locally(ksession_t *session, const kentry_t *entry,
 	kpargv_t *parent_pargv, const kcontext_t *parent_context,
 	const kexec_t *parent_exec, int *retcode, char **out)
 {
 	kexec_t *exec = NULL;
 	faux_eloop_t *eloop = NULL;
-	faux_buf_t *buf = NULL;
-	char *cstr = NULL;
-	ssize_t len = 0;
 
 	assert(entry);
 	if (!entry)
 		return BOOL_FALSE;
 
+	if (kentry_actions_are_silent(entry))
+		return ksession_exec_silently(session, entry, parent_pargv,
+			parent_context, parent_exec, retcode, out);
+
 	// Parsing
 	exec = ksession_parse_for_local_exec(session, entry,
 		parent_pargv, parent_context, parent_exec);
@@ -855,26 +1099,341 @@ bool_t ksession_exec_locally(ksession_t *session, const kentry_t *entry,
 		faux_eloop_add_signal(eloop, SIGCHLD, action_terminated_ev, exec);
 		faux_eloop_add_fd(eloop, kexec_stdout(exec), POLLIN,
 			action_stdout_ev, exec);
+		kexec_set_eloop(exec, eloop, action_event_cb, NULL);
 		faux_eloop_loop(eloop);
+		kexec_set_eloop(exec, NULL, NULL, NULL);
 		faux_eloop_free(eloop);
 		kexec_retcode(exec, retcode);
 	}
 
-	if (!out) {
-		kexec_free(exec);
-		return BOOL_TRUE;
+	if (out)
+		*out = ksession_exec_output(exec);
+
+	kexec_free(exec);
+
+	return BOOL_TRUE;
+}
+
+
+// State of job executed by ksession_exec_locally_jobs()
+typedef struct {
+	kexec_t *exec;
+	unsigned int timeout; // Time limit (ms). 0 - unlimited
+	bool_t running;
+} ksession_job_state_t;
+
+
+// Running jobs of ksession_exec_locally_jobs()
+typedef struct {
+	ksession_t *session;
+	ksession_job_t *jobs;
+	ksession_job_state_t *states;
+	size_t num;
+	size_t running; // Number of not completed kexecs
+	struct timespec start;
+	faux_eloop_t *eloop;
+} ksession_jobs_t;
+
+
+// Milliseconds since jobs start
+static unsigned int ksession_jobs_time(const ksession_jobs_t *jobs)
+{
+	struct timespec now = {};
+	long long ms = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - jobs->start.tv_sec) * 1000LL +
+		(now.tv_nsec - jobs->start.tv_nsec) / 1000000LL;
+
+	return (ms > 0) ? (unsigned int)ms : 0;
+}
+
+
+// Job is completed or killed. Its stdout is not needed anymore.
+static void ksession_job_stop(ksession_jobs_t *jobs, size_t i,
+	faux_eloop_t *eloop, bool_t timed_out)
+{
+	ksession_job_t *job = &jobs->jobs[i];
+	ksession_job_state_t *state = &jobs->states[i];
+
+	state->running = BOOL_FALSE;
+	jobs->running--;
+	job->time = ksession_jobs_time(jobs);
+	job->timed_out = timed_out;
+	if (!timed_out)
+		get_stdout(state->exec);
+	// EOF on pipe will wake up event loop again and again
+	faux_eloop_del_fd(eloop, kexec_stdout(state->exec));
+	ksession_stat_update(jobs->session, job->entry, job->time, timed_out);
+}
+
+
+// Kill processes of the kexec. Zombies will be collected by kexec itself.
+static void ksession_kexec_kill(kexec_t *exec)
+{
+	kexec_contexts_node_t *iter = NULL;
+	kcontext_t *context = NULL;
+
+	iter = kexec_contexts_iter(exec);
+	while ((context = kexec_contexts_each(&iter))) {
+		pid_t pid = kcontext_pid(context);
+		if (!kcontext_done(context) && (pid > 0))
+			kill(pid, SIGKILL);
 	}
-	buf = kexec_bufout(exec);
-	if ((len = faux_buf_len(buf)) <= 0) {
-		kexec_free(exec);
+}
+
+
+// The job exceeds time limit
+static void ksession_job_kill(ksession_jobs_t *jobs, size_t i,
+	faux_eloop_t *eloop)
+{
+	ksession_job_t *job = &jobs->jobs[i];
+	const kentry_t *parent = kentry_parent(job->entry);
+
+	ksession_kexec_kill(jobs->states[i].exec);
+	ksession_job_stop(jobs, i, eloop, BOOL_TRUE);
+	syslog(LOG_WARNING, "Timeout %u ms is exceeded by %s of \"%s\"",
+		jobs->states[i].timeout, kentry_name(job->entry),
+		parent ? kentry_name(parent) : "");
+}
+
+
+// Check for completed kexecs. Returns BOOL_FALSE when all kexecs are done.
+static bool_t ksession_jobs_check(ksession_jobs_t *jobs, faux_eloop_t *eloop)
+{
+	size_t i = 0;
+
+	// Each kexec waits for its own children. Doesn't block.
+	for (i = 0; i < jobs->num; i++) {
+		if (jobs->states[i].running)
+			kexec_wait_children(jobs->states[i].exec);
+	}
+
+	for (i = 0; i < jobs->num; i++) {
+		if (jobs->states[i].running && kexec_done(jobs->states[i].exec))
+			ksession_job_stop(jobs, i, eloop, BOOL_FALSE);
+	}
+
+	return (jobs->running > 0) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+static bool_t jobs_terminated_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ksession_jobs_t *jobs = (ksession_jobs_t *)user_data;
+
+	if (!jobs)
+		return BOOL_FALSE;
+
+	// Happy compiler
+	type = type;
+	associated_data = associated_data;
+
+	return ksession_jobs_check(jobs, eloop);
+}
+
+
+// Process of some job is terminated (pidfd event)
+static bool_t jobs_event_cb(kexec_t *exec, void *udata)
+{
+	ksession_jobs_t *jobs = (ksession_jobs_t *)udata;
+
+	exec = exec; // Happy compiler
+
+	return ksession_jobs_check(jobs, jobs->eloop);
+}
+
+
+static bool_t jobs_deadline_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+
+
+// Schedule event for the nearest deadline of running jobs
+static void ksession_jobs_schedule(ksession_jobs_t *jobs, faux_eloop_t *eloop)
+{
+	unsigned int now = ksession_jobs_time(jobs);
+	unsigned int nearest = 0;
+	bool_t found = BOOL_FALSE;
+	struct timespec interval = {};
+	size_t i = 0;
+
+	for (i = 0; i < jobs->num; i++) {
+		ksession_job_state_t *state = &jobs->states[i];
+		if (!state->running || (0 == state->timeout))
+			continue;
+		if (!found || (state->timeout < nearest))
+			nearest = state->timeout;
+		found = BOOL_TRUE;
+	}
+	if (!found)
+		return;
+
+	nearest = (nearest > now) ? (nearest - now) : 0;
+	interval.tv_sec = nearest / 1000;
+	interval.tv_nsec = (nearest % 1000) * 1000000L;
+	faux_eloop_add_sched_once_delayed(eloop, &interval, 0,
+		jobs_deadline_ev, jobs);
+}
+
+
+static bool_t jobs_deadline_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ksession_jobs_t *jobs = (ksession_jobs_t *)user_data;
+	unsigned int now = 0;
+	size_t i = 0;
+
+	if (!jobs)
+		return BOOL_FALSE;
+
+	// Some jobs can be completed but SIGCHLD is not processed yet
+	if (!ksession_jobs_check(jobs, eloop))
+		return BOOL_FALSE;
+
+	now = ksession_jobs_time(jobs);
+	for (i = 0; i < jobs->num; i++) {
+		ksession_job_state_t *state = &jobs->states[i];
+		if (state->running && (state->timeout > 0) &&
+			(now >= state->timeout))
+			ksession_job_kill(jobs, i, eloop);
+	}
+	if (0 == jobs->running)
+		return BOOL_FALSE;
+	ksession_jobs_schedule(jobs, eloop);
+
+	// Happy compiler
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Executes a number of entries concurrently.
+ *
+ * Completion and help generation executes ACTIONs for all candidates of
+ * the current argument. Each of them can fork a script so execution one
+ * by one makes the latency equal to sum of all scripts. Function starts
+ * all kexecs at once and waits for them within single event loop.
+ *
+ * Each job has time limit. It's an entry's "timeout" or the 'timeout'
+ * argument (0 - unlimited). Processes of the job that exceeds the limit
+ * are killed, job->timed_out is set and job's output is dropped. Others
+ * jobs results are available. Entries with silent sync ACTIONs are
+ * executed in-process immediately and can't be interrupted.
+ *
+ * Job with NULL entry is skipped. Each job has its own candidate parg
+ * that is available within ACTIONs by kcontext_candidate_parg(). The
+ * job->out must be freed by caller.
+ */
+bool_t ksession_exec_locally_jobs(ksession_t *session, kpargv_t *parent_pargv,
+	ksession_job_t *jobs, size_t jobs_num, unsigned int timeout)
+{
+	ksession_jobs_t running = {};
+	faux_eloop_t *eloop = NULL;
+	size_t i = 0;
+
+	assert(jobs);
+	if (!jobs)
+		return BOOL_FALSE;
+	if (0 == jobs_num)
 		return BOOL_TRUE;
+
+	running.session = session;
+	running.jobs = jobs;
+	running.states = faux_zmalloc(jobs_num * sizeof(*running.states));
+	assert(running.states);
+	running.num = jobs_num;
+	clock_gettime(CLOCK_MONOTONIC, &running.start);
+
+	// Event loop is ready before the start of the first kexec
+	eloop = faux_eloop_new(NULL);
+	faux_eloop_add_signal(eloop, SIGINT, stop_loop_ev, session);
+	faux_eloop_add_signal(eloop, SIGTERM, stop_loop_ev, session);
+	faux_eloop_add_signal(eloop, SIGQUIT, stop_loop_ev, session);
+	faux_eloop_add_signal(eloop, SIGCHLD, jobs_terminated_ev, &running);
+	running.eloop = eloop;
+
+	for (i = 0; i < jobs_num; i++) {
+		ksession_job_t *job = &jobs[i];
+		ksession_job_state_t *state = &running.states[i];
+		kexec_t *exec = NULL;
+		kexec_contexts_node_t *iter = NULL;
+		kcontext_t *context = NULL;
+
+		job->res = BOOL_FALSE;
+		job->retcode = -1;
+		job->out = NULL;
+		job->timed_out = BOOL_FALSE;
+		job->time = 0;
+		if (!job->entry)
+			continue;
+
+		// In-process execution. There is nothing to wait for.
+		if (kentry_actions_are_silent(job->entry)) {
+			kparg_t *saved = kpargv_candidate_parg(parent_pargv);
+			unsigned int started = ksession_jobs_time(&running);
+			kpargv_set_candidate_parg(parent_pargv, job->candidate);
+			job->res = ksession_exec_silently(session, job->entry,
+				parent_pargv, NULL, NULL, &job->retcode,
+				&job->out);
+			kpargv_set_candidate_parg(parent_pargv, saved);
+			job->time = ksession_jobs_time(&running) - started;
+			ksession_stat_update(session, job->entry, job->time,
+				BOOL_FALSE);
+			continue;
+		}
+
+		exec = ksession_parse_for_local_exec(session, job->entry,
+			parent_pargv, NULL, NULL);
+		if (!exec)
+			continue;
+		// Jobs share parent pargv so candidate is stored in context
+		iter = kexec_contexts_iter(exec);
+		while ((context = kexec_contexts_each(&iter)))
+			kcontext_set_candidate_parg(context, job->candidate);
+		if (!kexec_exec(exec)) {
+			kexec_free(exec);
+			continue;
+		}
+		state->exec = exec;
+		state->timeout = kentry_timeout(job->entry);
+		if (0 == state->timeout)
+			state->timeout = timeout;
+		state->running = BOOL_TRUE;
+		running.running++;
+		faux_eloop_add_fd(eloop, kexec_stdout(exec), POLLIN,
+			action_stdout_ev, exec);
+		kexec_set_eloop(exec, eloop, jobs_event_cb, &running);
 	}
-	cstr = faux_malloc(len + 1);
-	faux_buf_read(buf, cstr, len);
-	cstr[len] = '\0';
-	*out = cstr;
 
-	kexec_free(exec);
+	// Children can terminate before the loop starts
+	if (ksession_jobs_check(&running, eloop)) {
+		ksession_jobs_schedule(&running, eloop);
+		faux_eloop_loop(eloop);
+	}
+	for (i = 0; i < jobs_num; i++) {
+		if (running.states[i].exec)
+			kexec_set_eloop(running.states[i].exec, NULL, NULL, NULL);
+	}
+	faux_eloop_free(eloop);
+
+	for (i = 0; i < jobs_num; i++) {
+		ksession_job_state_t *state = &running.states[i];
+		if (!state->exec)
+			continue;
+		// Loop is interrupted by signal
+		if (state->running)
+			ksession_kexec_kill(state->exec);
+		else if (!jobs[i].timed_out) {
+			kexec_retcode(state->exec, &jobs[i].retcode);
+			jobs[i].out = ksession_exec_output(state->exec);
+			jobs[i].res = BOOL_TRUE;
+		}
+		kexec_free(state->exec);
+	}
+	faux_free(running.states);
 
 	return BOOL_TRUE;
 }
@@ -0,0 +1,676 @@
+/** @file kzygote.c
+ *
+ * Zygote is a helper process forked by service process just after session
+ * initialization. Then it forks processes for async ACTIONs instead of
+ * service process. Zygote doesn't contain data that service process
+ * accumulates while working (buffers, caches, etc.) so fork() is cheaper.
+ * Additionally service process doesn't get copy-on-write faults after
+ * each fork().
+ *
+ * Zygote is a fork of service process so scheme objects (ENTRYs, ACTIONs)
+ * have the same addresses within both processes. The spawn request
+ * contains pointers to scheme objects and values of parsed arguments.
+ * The stdin, stdout, stderr are passed by SCM_RIGHTS.
+ *
+ * Spawned processes are not children of service process. Zygote waits for
+ * them and sends notifications about terminated processes by separate
+ * socket.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+
+#include <faux/list.h>
+#include <faux/eloop.h>
+#include <klish/khelper.h>
+#include <klish/kpath.h>
+#include <klish/kpargv.h>
+#include <klish/kcontext.h>
+#include <klish/ksession.h>
+#include <klish/kzygote.h>
+#include <klish/kexec.h>
+#include <klish/kplugin.h>
+
+// Max size of spawn request
+#define KZYGOTE_MSG_MAX 65536
+// Length of NULL string within request
+#define KZYGOTE_STR_NULL UINT32_MAX
+// Number of passed file descriptors: stdin, stdout, stderr
+#define KZYGOTE_FDS_NUM 3
+
+
+struct kzygote_s {
+	ksession_t *session; // Don't free. Zygote process uses its own copy
+	pid_t pid; // PID of zygote process
+	int ctl; // Spawn requests and replies
+	int ev; // Notifications about terminated processes
+	bool_t alive;
+	char *msg; // Request buffer
+};
+
+// Notification about terminated process
+typedef struct {
+	pid_t pid;
+	int wstatus;
+} kzygote_ev_t;
+
+
+// PID
+KGET(zygote, pid_t, pid);
+
+// Alive
+KGET_BOOL(zygote, alive);
+
+
+static void kzygote_loop(kzygote_t *zygote);
+
+
+kzygote_t *kzygote_new(ksession_t *session)
+{
+	kzygote_t *zygote = NULL;
+	int ctl[2] = {-1, -1};
+	int ev[2] = {-1, -1};
+	pid_t pid = -1;
+	int fflags = 0;
+
+	assert(session);
+	if (!session)
+		return NULL;
+
+	zygote = faux_zmalloc(sizeof(*zygote));
+	assert(zygote);
+	if (!zygote)
+		return NULL;
+
+	// Initialize
+	zygote->session = session;
+	zygote->pid = -1;
+	zygote->ctl = -1;
+	zygote->ev = -1;
+	zygote->alive = BOOL_FALSE;
+	zygote->msg = faux_malloc(KZYGOTE_MSG_MAX);
+	assert(zygote->msg);
+
+	// Sequential packets save message boundaries
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, ctl) < 0)
+		goto err;
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, ev) < 0)
+		goto err;
+
+	// Flush buffers before fork(). See exec_action_async()
+	fflush(stdout);
+	fflush(stderr);
+
+	kplugin_lock();
+	pid = fork();
+	kplugin_unlock();
+	if (pid < 0)
+		goto err;
+
+	// Zygote
+	if (pid == 0) {
+		close(ctl[0]);
+		close(ev[0]);
+		zygote->ctl = ctl[1];
+		zygote->ev = ev[1];
+		kzygote_loop(zygote); // Never returns
+	}
+
+	// Parent
+	close(ctl[1]);
+	close(ev[1]);
+	zygote->pid = pid;
+	zygote->ctl = ctl[0];
+	zygote->ev = ev[0];
+	zygote->alive = BOOL_TRUE;
+	// Notifications are read by event loop
+	fflags = fcntl(zygote->ev, F_GETFL);
+	fcntl(zygote->ev, F_SETFL, fflags | O_NONBLOCK);
+
+	return zygote;
+
+err:
+	if (ctl[0] >= 0) {
+		close(ctl[0]);
+		close(ctl[1]);
+	}
+	if (ev[0] >= 0) {
+		close(ev[0]);
+		close(ev[1]);
+	}
+	faux_free(zygote->msg);
+	faux_free(zygote);
+
+	return NULL;
+}
+
+
+void kzygote_free(kzygote_t *zygote)
+{
+	if (!zygote)
+		return;
+
+	// Zygote stops on EOF. Spawned processes are not affected
+	if (zygote->ctl >= 0)
+		close(zygote->ctl);
+	if (zygote->ev >= 0)
+		close(zygote->ev);
+	if (zygote->pid > 0)
+		waitpid(zygote->pid, NULL, 0);
+
+	faux_free(zygote->msg);
+	faux_free(zygote);
+}
+
+
+/** @brief Gets file descriptor to wait for notifications.
+ *
+ * The fd is readable when some spawned processes are terminated. Use
+ * kzygote_wait() to get them.
+ */
+int kzygote_fd(const kzygote_t *zygote)
+{
+	assert(zygote);
+	if (!zygote)
+		return -1;
+
+	return zygote->ev;
+}
+
+
+static bool_t msg_put(char *msg, size_t *len, const void *data, size_t size)
+{
+	if ((*len + size) > KZYGOTE_MSG_MAX)
+		return BOOL_FALSE;
+	memcpy(msg + *len, data, size);
+	*len += size;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t msg_put_str(char *msg, size_t *len, const char *str)
+{
+	uint32_t str_len = KZYGOTE_STR_NULL;
+
+	if (str)
+		str_len = strlen(str);
+	if (!msg_put(msg, len, &str_len, sizeof(str_len)))
+		return BOOL_FALSE;
+	if (!str)
+		return BOOL_TRUE;
+
+	return msg_put(msg, len, str, str_len + 1); // With '\0'
+}
+
+
+static bool_t msg_get(const char *msg, size_t len, size_t *offset,
+	void *data, size_t size)
+{
+	if ((*offset + size) > len)
+		return BOOL_FALSE;
+	memcpy(data, msg + *offset, size);
+	*offset += size;
+
+	return BOOL_TRUE;
+}
+
+
+// String points to message buffer. Don't free it
+static bool_t msg_get_str(const char *msg, size_t len, size_t *offset,
+	const char **str)
+{
+	uint32_t str_len = 0;
+
+	if (!msg_get(msg, len, offset, &str_len, sizeof(str_len)))
+		return BOOL_FALSE;
+	if (KZYGOTE_STR_NULL == str_len) {
+		*str = NULL;
+		return BOOL_TRUE;
+	}
+	if ((*offset + str_len + 1) > len)
+		return BOOL_FALSE;
+	if (msg[*offset + str_len] != '\0')
+		return BOOL_FALSE;
+	*str = msg + *offset;
+	*offset += str_len + 1;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Spawns process for async ACTION of context.
+ *
+ * Function sends request to zygote and waits for PID of spawned process.
+ * The PID will be reported by kzygote_wait() later when process is
+ * terminated.
+ *
+ * @return BOOL_FALSE if zygote can't spawn process. Then caller can fork it
+ * by itself.
+ */
+bool_t kzygote_spawn(kzygote_t *zygote, const kcontext_t *context,
+	const char *pts_fname, pid_t *pid)
+{
+	char *msg = NULL;
+	size_t len = 0;
+	const kpargv_t *pargv = NULL;
+	faux_list_node_t *action_iter = NULL;
+	const kentry_t *command = NULL;
+	size_t level = 0;
+	int retcode = 0;
+	size_t pipeline_stage = 0;
+	bool_t is_last_pipeline_stage = BOOL_TRUE;
+	uint32_t num = 0;
+	kpath_levels_node_t *l_iter = NULL;
+	klevel_t *klevel = NULL;
+	kpargv_pargs_node_t *p_iter = NULL;
+	kparg_t *parg = NULL;
+	int fds[KZYGOTE_FDS_NUM] = {};
+	struct msghdr mh = {};
+	struct iovec iov = {};
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} cmsg_buf = {};
+	struct cmsghdr *cmsg = NULL;
+	pid_t child_pid = -1;
+	ssize_t r = 0;
+
+	assert(zygote);
+	if (!zygote)
+		return BOOL_FALSE;
+	assert(context);
+	if (!context)
+		return BOOL_FALSE;
+	if (!zygote->alive)
+		return BOOL_FALSE;
+
+	fds[0] = kcontext_stdin(context);
+	fds[1] = kcontext_stdout(context);
+	fds[2] = kcontext_stderr(context);
+	if ((fds[0] < 0) || (fds[1] < 0) || (fds[2] < 0))
+		return BOOL_FALSE;
+
+	pargv = kcontext_pargv(context);
+	action_iter = kcontext_action_iter(context);
+	command = kpargv_command(pargv);
+	level = kpargv_level(pargv);
+	retcode = kcontext_retcode(context);
+	pipeline_stage = kcontext_pipeline_stage(context);
+	is_last_pipeline_stage = kcontext_is_last_pipeline_stage(context);
+
+	// Serialize context
+	msg = zygote->msg;
+	if (
+		!msg_put(msg, &len, &action_iter, sizeof(action_iter)) ||
+		!msg_put(msg, &len, &command, sizeof(command)) ||
+		!msg_put(msg, &len, &level, sizeof(level)) ||
+		!msg_put(msg, &len, &retcode, sizeof(retcode)) ||
+		!msg_put(msg, &len, &pipeline_stage, sizeof(pipeline_stage)) ||
+		!msg_put(msg, &len, &is_last_pipeline_stage,
+			sizeof(is_last_pipeline_stage)) ||
+		!msg_put_str(msg, &len, kcontext_line(context)) ||
+		!msg_put_str(msg, &len, pts_fname)
+		)
+		return BOOL_FALSE;
+
+	// Current path
+	num = kpath_len(ksession_path(zygote->session));
+	if (!msg_put(msg, &len, &num, sizeof(num)))
+		return BOOL_FALSE;
+	l_iter = kpath_iter(ksession_path(zygote->session));
+	while ((klevel = kpath_each(&l_iter))) {
+		const kentry_t *entry = klevel_entry(klevel);
+		if (!msg_put(msg, &len, &entry, sizeof(entry)))
+			return BOOL_FALSE;
+	}
+
+	// Parsed arguments
+	num = kpargv_pargs_len(pargv);
+	if (!msg_put(msg, &len, &num, sizeof(num)))
+		return BOOL_FALSE;
+	p_iter = kpargv_pargs_iter(pargv);
+	while ((parg = kpargv_pargs_each(&p_iter))) {
+		const kentry_t *entry = kparg_entry(parg);
+		if (
+			!msg_put(msg, &len, &entry, sizeof(entry)) ||
+			!msg_put_str(msg, &len, kparg_value(parg))
+			)
+			return BOOL_FALSE;
+	}
+
+	// Send request with stdin, stdout, stderr
+	iov.iov_base = msg;
+	iov.iov_len = len;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cmsg_buf.buf;
+	mh.msg_controllen = sizeof(cmsg_buf.buf);
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	do {
+		r = sendmsg(zygote->ctl, &mh, MSG_NOSIGNAL);
+	} while ((r < 0) && (EINTR == errno));
+	if (r < 0) {
+		syslog(LOG_ERR, "Can't send request to zygote: %s",
+			strerror(errno));
+		zygote->alive = BOOL_FALSE;
+		return BOOL_FALSE;
+	}
+
+	// Wait for PID of spawned process
+	do {
+		r = recv(zygote->ctl, &child_pid, sizeof(child_pid), 0);
+	} while ((r < 0) && (EINTR == errno));
+	if (r != sizeof(child_pid)) {
+		syslog(LOG_ERR, "Can't get reply from zygote");
+		zygote->alive = BOOL_FALSE;
+		return BOOL_FALSE;
+	}
+	if (child_pid < 0) // Zygote can't fork
+		return BOOL_FALSE;
+
+	if (pid)
+		*pid = child_pid;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets next notification about terminated process.
+ *
+ * Doesn't block.
+ *
+ * @return BOOL_TRUE if notification was got.
+ */
+bool_t kzygote_wait(kzygote_t *zygote, pid_t *pid, int *wstatus)
+{
+	kzygote_ev_t ev = {};
+	ssize_t r = 0;
+
+	assert(zygote);
+	if (!zygote)
+		return BOOL_FALSE;
+	if (zygote->ev < 0)
+		return BOOL_FALSE;
+
+	do {
+		r = recv(zygote->ev, &ev, sizeof(ev), 0);
+	} while ((r < 0) && (EINTR == errno));
+	if (r < 0) {
+		if ((EAGAIN != errno) && (EWOULDBLOCK != errno))
+			zygote->alive = BOOL_FALSE;
+		return BOOL_FALSE;
+	}
+	if (0 == r) { // EOF
+		zygote->alive = BOOL_FALSE;
+		return BOOL_FALSE;
+	}
+	if (r != sizeof(ev))
+		return BOOL_FALSE;
+
+	if (pid)
+		*pid = ev.pid;
+	if (wstatus)
+		*wstatus = ev.wstatus;
+
+	return BOOL_TRUE;
+}
+
+
+// === Zygote process
+
+// Spawned process. Restores context from request and executes sym
+static void kzygote_child(kzygote_t *zygote, size_t len,
+	int fds[KZYGOTE_FDS_NUM])
+{
+	const char *msg = zygote->msg;
+	size_t offset = 0;
+	faux_list_node_t *action_iter = NULL;
+	const kaction_t *action = NULL;
+	const kentry_t *command = NULL;
+	const kentry_t *entry = NULL;
+	size_t level = 0;
+	int retcode = 0;
+	size_t pipeline_stage = 0;
+	bool_t is_last_pipeline_stage = BOOL_TRUE;
+	const char *line = NULL;
+	const char *pts_fname = NULL;
+	const char *value = NULL;
+	uint32_t num = 0;
+	uint32_t i = 0;
+	kpath_t *path = NULL;
+	kpargv_t *pargv = NULL;
+	kcontext_t *context = NULL;
+	ksym_fn fn = NULL;
+	int exitcode = 0;
+	int fd = -1;
+	sigset_t sigs;
+
+	// Unblock signals
+	sigemptyset(&sigs);
+	sigprocmask(SIG_SETMASK, &sigs, NULL);
+
+	if (
+		!msg_get(msg, len, &offset, &action_iter, sizeof(action_iter)) ||
+		!msg_get(msg, len, &offset, &command, sizeof(command)) ||
+		!msg_get(msg, len, &offset, &level, sizeof(level)) ||
+		!msg_get(msg, len, &offset, &retcode, sizeof(retcode)) ||
+		!msg_get(msg, len, &offset, &pipeline_stage,
+			sizeof(pipeline_stage)) ||
+		!msg_get(msg, len, &offset, &is_last_pipeline_stage,
+			sizeof(is_last_pipeline_stage)) ||
+		!msg_get_str(msg, len, &offset, &line) ||
+		!msg_get_str(msg, len, &offset, &pts_fname)
+		)
+		_exit(-1);
+	action = (const kaction_t *)faux_list_data(action_iter);
+	if (!action)
+		_exit(-1);
+
+	// Current path
+	path = ksession_path(zygote->session);
+	while (kpath_len(path) > 0)
+		kpath_pop(path);
+	if (!msg_get(msg, len, &offset, &num, sizeof(num)))
+		_exit(-1);
+	for (i = 0; i < num; i++) {
+		if (!msg_get(msg, len, &offset, &entry, sizeof(entry)))
+			_exit(-1);
+		kpath_push(path, klevel_new(entry));
+	}
+
+	// Parsed arguments
+	pargv = kpargv_new();
+	kpargv_set_status(pargv, KPARSE_OK);
+	kpargv_set_command(pargv, command);
+	kpargv_set_level(pargv, level);
+	if (!msg_get(msg, len, &offset, &num, sizeof(num)))
+		_exit(-1);
+	for (i = 0; i < num; i++) {
+		if (
+			!msg_get(msg, len, &offset, &entry, sizeof(entry)) ||
+			!msg_get_str(msg, len, &offset, &value)
+			)
+			_exit(-1);
+		kpargv_add_pargs(pargv, kparg_new(entry, value));
+	}
+
+	context = kcontext_new(KCONTEXT_TYPE_ACTION);
+	kcontext_set_scheme(context, ksession_scheme(zygote->session));
+	kcontext_set_session(context, zygote->session);
+	kcontext_set_pargv(context, pargv);
+	kcontext_set_action_iter(context, action_iter);
+	kcontext_set_retcode(context, retcode);
+	kcontext_set_pipeline_stage(context, pipeline_stage);
+	kcontext_set_is_last_pipeline_stage(context, is_last_pipeline_stage);
+	kcontext_set_line(context, line);
+
+	// Reopen streams if the pseudoterminal is used.
+	// It's necessary to set session terminal. Session leases the terminal
+	// that is not owned by other session (see ksession_pty_lease()). Only
+	// the first pipeline stage gets controlling terminal. See
+	// exec_action_async().
+	if (pts_fname) {
+		setsid();
+		if (0 == pipeline_stage) {
+			fd = open(pts_fname, O_RDWR, 0);
+			if ((fd < 0) || (ioctl(fd, TIOCSCTTY, 0) < 0))
+				_exit(-1);
+		} else {
+			fd = open(pts_fname, O_RDWR | O_NOCTTY, 0);
+			if (fd < 0)
+				_exit(-1);
+		}
+		for (i = 0; i < KZYGOTE_FDS_NUM; i++) {
+			if (isatty(fds[i]))
+				fds[i] = fd;
+		}
+	}
+
+	dup2(fds[0], STDIN_FILENO);
+	dup2(fds[1], STDOUT_FILENO);
+	dup2(fds[2], STDERR_FILENO);
+	kcontext_set_stdin(context, STDIN_FILENO);
+	kcontext_set_stdout(context, STDOUT_FILENO);
+	kcontext_set_stderr(context, STDERR_FILENO);
+
+	// Close all inherited fds except stdin, stdout, stderr
+	kexec_close_fds(NULL, 0);
+
+	fn = ksym_function(kaction_sym(action));
+	exitcode = fn(context);
+	// See exec_action_async() for stdio details
+	fflush(stdout);
+	fflush(stderr);
+	_exit(exitcode);
+}
+
+
+static bool_t kzygote_request_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	kzygote_t *zygote = (kzygote_t *)user_data;
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	int fds[KZYGOTE_FDS_NUM] = {};
+	size_t fds_num = 0;
+	struct msghdr mh = {};
+	struct iovec iov = {};
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} cmsg_buf = {};
+	struct cmsghdr *cmsg = NULL;
+	pid_t child_pid = -1;
+	ssize_t r = 0;
+	size_t i = 0;
+
+	iov.iov_base = zygote->msg;
+	iov.iov_len = KZYGOTE_MSG_MAX;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cmsg_buf.buf;
+	mh.msg_controllen = sizeof(cmsg_buf.buf);
+	r = recvmsg(info->fd, &mh, MSG_CMSG_CLOEXEC);
+	if (r < 0) {
+		if ((EINTR == errno) || (EAGAIN == errno))
+			return BOOL_TRUE;
+		return BOOL_FALSE;
+	}
+	if (0 == r)
+		return BOOL_FALSE; // Service process is gone
+
+	cmsg = CMSG_FIRSTHDR(&mh);
+	if (cmsg && (SOL_SOCKET == cmsg->cmsg_level) &&
+		(SCM_RIGHTS == cmsg->cmsg_type)) {
+		fds_num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (fds_num > KZYGOTE_FDS_NUM)
+			fds_num = KZYGOTE_FDS_NUM;
+		memcpy(fds, CMSG_DATA(cmsg), fds_num * sizeof(int));
+	}
+
+	if ((KZYGOTE_FDS_NUM == fds_num) && !(mh.msg_flags & MSG_TRUNC)) {
+		fflush(stdout);
+		fflush(stderr);
+		child_pid = fork();
+		if (0 == child_pid)
+			kzygote_child(zygote, r, fds); // Never returns
+	}
+
+	for (i = 0; i < fds_num; i++)
+		close(fds[i]);
+	send(info->fd, &child_pid, sizeof(child_pid), MSG_NOSIGNAL);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t kzygote_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	kzygote_t *zygote = (kzygote_t *)user_data;
+	kzygote_ev_t ev = {};
+	int wstatus = 0;
+	pid_t child_pid = -1;
+
+	// Wait for any child process. Doesn't block.
+	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+		ev.pid = child_pid;
+		ev.wstatus = wstatus;
+		if (send(zygote->ev, &ev, sizeof(ev), MSG_NOSIGNAL) < 0)
+			return BOOL_FALSE; // Service process is gone
+	}
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_TRUE;
+}
+
+
+static void kzygote_loop(kzygote_t *zygote)
+{
+	faux_eloop_t *eloop = NULL;
+	sigset_t sigs;
+	int keep[2] = {};
+
+	// Close all inherited fds except stdin, stdout, stderr and zygote's
+	// sockets. Zygote must not hold client's connection.
+	keep[0] = zygote->ctl;
+	keep[1] = zygote->ev;
+	kexec_close_fds(keep, 2);
+
+	// Unblock signals. Event loop of service process can block them
+	sigemptyset(&sigs);
+	sigprocmask(SIG_SETMASK, &sigs, NULL);
+
+	eloop = faux_eloop_new(NULL);
+	faux_eloop_add_fd(eloop, zygote->ctl, POLLIN, kzygote_request_ev, zygote);
+	faux_eloop_add_signal(eloop, SIGCHLD, kzygote_child_ev, zygote);
+	faux_eloop_loop(eloop);
+
+	// Don't free anything. Zygote must not finalize plugins and session.
+	_exit(0);
+}
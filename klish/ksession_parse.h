@@ -11,6 +11,18 @@
 #include <klish/ksession.h>
 
 
+// Job for concurrent local execution
+typedef struct {
+	const kentry_t *entry; // Entry to execute. NULL to skip the job
+	kparg_t *candidate; // Candidate parg. Don't free
+	bool_t res; // Is job executed
+	int retcode;
+	char *out; // Output. Must be freed by caller
+	bool_t timed_out; // Job is killed by timeout
+	unsigned int time; // Execution time (ms)
+} ksession_job_t;
+
+
 C_DECL_BEGIN
 
 kpargv_t *ksession_parse_line(ksession_t *session, const faux_argv_t *argv,
@@ -26,6 +38,8 @@ kexec_t *ksession_parse_for_local_exec(ksession_t *session, const kentry_t *entr
 bool_t ksession_exec_locally(ksession_t *session, const kentry_t *entry,
 	kpargv_t *parent_pargv, const kcontext_t *parent_context,
 	const kexec_t *parent_exec, int *retcode, char **out);
+bool_t ksession_exec_locally_jobs(ksession_t *session, kpargv_t *parent_pargv,
+	ksession_job_t *jobs, size_t jobs_num, unsigned int timeout);
 
 C_DECL_END
 
@@ -6,6 +6,8 @@
 #ifndef _klish_ksym_h
 #define _klish_ksym_h
 
+#include <poll.h>
+#include <faux/buf.h>
 #include <klish/kcontext_base.h>
 
 typedef struct ksym_s ksym_t;
@@ -13,6 +15,42 @@ typedef struct ksym_s ksym_t;
 // Callback function prototype
 typedef int (*ksym_fn)(kcontext_t *context);
 
+// Compile function prototype. It gets ACTION's script and returns opaque
+// precompiled object. The object is stored within ACTION and is available
+// to sym function by kcontext_compiled(). NULL means nothing to store.
+typedef void *(*ksym_compile_fn)(const char *script);
+typedef void (*ksym_compiled_free_fn)(void *compiled);
+
+// Stream functions. The sym with stream functions can be executed as a
+// filter right within the daemon's event loop without fork(). Init function
+// gets context and returns the filter's state (NULL means "execute sym by
+// common way"). Line function gets input lines one by one and writes the
+// result to out buffer. It returns BOOL_FALSE to stop the filtering. Fini
+// function writes the final output, frees the state and returns the
+// retcode. The out buffer can be NULL if filtering is aborted.
+typedef void *(*ksym_stream_init_fn)(kcontext_t *context);
+typedef bool_t (*ksym_stream_line_fn)(void *state,
+	const char *line, size_t len, faux_buf_t *out);
+typedef int (*ksym_stream_fini_fn)(void *state, faux_buf_t *out);
+
+// Job functions. The sym with job functions is executed right within the
+// daemon's event loop without fork() and without blocking. It's for syms
+// that exchange data with long-lived helper process. Init function gets
+// context and returns the job's state (NULL means "execute sym by common
+// way"). Poll function fills descriptors and events the job waits for and
+// returns their number. Zero means the job is done. Event function gets
+// the polling results and writes the output to out and err buffers. Fini
+// function writes the final output, frees the state and returns the
+// retcode. The out and err buffers are NULL if job is aborted (interrupt
+// or session is closed).
+typedef void *(*ksym_job_init_fn)(kcontext_t *context);
+typedef size_t (*ksym_job_poll_fn)(void *state,
+	struct pollfd *fds, size_t max);
+typedef void (*ksym_job_event_fn)(void *state,
+	const struct pollfd *fds, size_t num, faux_buf_t *out, faux_buf_t *err);
+typedef int (*ksym_job_fini_fn)(void *state,
+	faux_buf_t *out, faux_buf_t *err);
+
 // Aliases for permanent flag
 #define KSYM_USERDEFINED_PERMANENT TRI_UNDEFINED
 #define KSYM_NONPERMANENT TRI_FALSE
@@ -50,6 +88,34 @@ bool_t ksym_set_sync(ksym_t *sym, tri_t sync);
 bool_t ksym_silent(const ksym_t *sym);
 bool_t ksym_set_silent(ksym_t *sym, bool_t silent);
 
+// Thread-safe sym function uses context and session state only and writes
+// output by kcontext_printf() or to kcontext_fdout(). It's executed
+// without kplugin_lock() and without redirection of process-wide stdout.
+bool_t ksym_thread_safe(const ksym_t *sym);
+bool_t ksym_set_thread_safe(ksym_t *sym, bool_t thread_safe);
+void ksym_lock(const ksym_t *sym);
+void ksym_unlock(const ksym_t *sym);
+
+ksym_compile_fn ksym_compile(const ksym_t *sym);
+ksym_compiled_free_fn ksym_compiled_free(const ksym_t *sym);
+bool_t ksym_set_compile(ksym_t *sym, ksym_compile_fn compile,
+	ksym_compiled_free_fn compiled_free);
+
+ksym_stream_init_fn ksym_stream_init(const ksym_t *sym);
+ksym_stream_line_fn ksym_stream_line(const ksym_t *sym);
+ksym_stream_fini_fn ksym_stream_fini(const ksym_t *sym);
+bool_t ksym_set_stream(ksym_t *sym, ksym_stream_init_fn init,
+	ksym_stream_line_fn line, ksym_stream_fini_fn fini);
+bool_t ksym_is_stream(const ksym_t *sym);
+
+ksym_job_init_fn ksym_job_init(const ksym_t *sym);
+ksym_job_poll_fn ksym_job_poll(const ksym_t *sym);
+ksym_job_event_fn ksym_job_event(const ksym_t *sym);
+ksym_job_fini_fn ksym_job_fini(const ksym_t *sym);
+bool_t ksym_set_job(ksym_t *sym, ksym_job_init_fn init,
+	ksym_job_poll_fn poll, ksym_job_event_fn event, ksym_job_fini_fn fini);
+bool_t ksym_is_job(const ksym_t *sym);
+
 C_DECL_END
 
 #endif // _klish_ksym_h
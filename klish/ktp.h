@@ -17,6 +17,7 @@ typedef enum {
 	KTP_STDIN = 'i',
 	KTP_STDOUT = 'o',
 	KTP_STDERR = 'e',
+	KTP_STDOUT_BULK = 'b', // Raw stdout data of specified length follows
 	KTP_CMD = 'c',
 	KTP_CMD_ACK = 'C',
 	KTP_COMPLETION = 'v',
@@ -42,6 +43,7 @@ typedef enum {
 	KTP_PARAM_WINCH = 'W', // <width><space><height>
 	KTP_PARAM_ERROR = 'E',
 	KTP_PARAM_RETCODE = 'R',
+	KTP_PARAM_LEN = 'N', // uint32_t in network byte order
 } ktp_param_e;
 
 
@@ -50,23 +52,27 @@ typedef enum {
 	KTP_STATUS_NONE =		(uint32_t)0x00000000,
 	KTP_STATUS_ERROR =		(uint32_t)0x00000001,
 	KTP_STATUS_INCOMPLETED =	(uint32_t)0x00000002,
+	KTP_STATUS_PARTIAL =		(uint32_t)0x00000004, // Some completions are missing
 	KTP_STATUS_TTY_STDIN =		(uint32_t)0x00000100, // Client's stdin is tty
 	KTP_STATUS_TTY_STDOUT =		(uint32_t)0x00000200, // Client's stdout is tty
 	KTP_STATUS_TTY_STDERR =		(uint32_t)0x00000400, // Client's stderr is tty
 	KTP_STATUS_NEED_STDIN =		(uint32_t)0x00001000, // Server's cmd need stdin
 	KTP_STATUS_INTERACTIVE =	(uint32_t)0x00002000, // Server's stdout is for tty
 	KTP_STATUS_DRY_RUN =		(uint32_t)0x00010000,
+	KTP_STATUS_BULK_STDOUT =	(uint32_t)0x00020000, // Client accepts bulk stdout
 	KTP_STATUS_EXIT =		(uint32_t)0x80000000,
 } ktp_status_e;
 
 #define KTP_STATUS_IS_ERROR(status) (status & KTP_STATUS_ERROR)
 #define KTP_STATUS_IS_INCOMPLETED(status) (status & KTP_STATUS_INCOMPLETED)
+#define KTP_STATUS_IS_PARTIAL(status) (status & KTP_STATUS_PARTIAL)
 #define KTP_STATUS_IS_TTY_STDIN(status) (status & KTP_STATUS_TTY_STDIN)
 #define KTP_STATUS_IS_TTY_STDOUT(status) (status & KTP_STATUS_TTY_STDOUT)
 #define KTP_STATUS_IS_TTY_STDERR(status) (status & KTP_STATUS_TTY_STDERR)
 #define KTP_STATUS_IS_NEED_STDIN(status) (status & KTP_STATUS_NEED_STDIN)
 #define KTP_STATUS_IS_INTERACTIVE(status) (status & KTP_STATUS_INTERACTIVE)
 #define KTP_STATUS_IS_DRY_RUN(status) (status & KTP_STATUS_DRY_RUN)
+#define KTP_STATUS_IS_BULK_STDOUT(status) (status & KTP_STATUS_BULK_STDOUT)
 #define KTP_STATUS_IS_EXIT(status) (status & KTP_STATUS_EXIT)
 
 
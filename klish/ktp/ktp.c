@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -29,7 +30,7 @@ int ktp_connect_unix(const char *sun_path)
 		return -1;
 
 	// Create socket
-	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
 		return -1;
 	if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
 		close(sock);
@@ -61,7 +62,7 @@ int ktp_accept(int listen_sock)
 {
 	int new_conn = -1;
 
-	new_conn = accept(listen_sock, NULL, NULL);
+	new_conn = accept4(listen_sock, NULL, NULL, SOCK_CLOEXEC);
 
 	return new_conn;
 }
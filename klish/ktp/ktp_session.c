@@ -10,6 +10,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <syslog.h>
+#include <arpa/inet.h>
 
 #include <faux/str.h>
 #include <klish/ktp_session.h>
@@ -38,6 +39,7 @@ struct ktp_session_s {
 	bool_t stdout_need_newline; // Does stdout has final line feed. If no then newline is needed
 	bool_t stderr_need_newline; // Does stderr has final line feed. If no then newline is needed
 	int last_stream; // Last active stream: stdout or stderr
+	size_t bulk_left; // Raw stdout data following KTP_STDOUT_BULK
 };
 
 
@@ -76,6 +78,7 @@ ktp_session_t *ktp_session_new(int sock, faux_eloop_t *eloop)
 	ktp->stdout_need_newline = BOOL_FALSE;
 	ktp->stderr_need_newline = BOOL_FALSE;
 	ktp->last_stream = STDOUT_FILENO;
+	ktp->bulk_left = 0;
 
 	// Async object
 	ktp->async = faux_async_new(sock);
@@ -297,20 +300,12 @@ static bool_t server_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
-static bool_t ktp_session_process_stdout(ktp_session_t *ktp, const faux_msg_t *msg)
+static bool_t ktp_session_stdout_data(ktp_session_t *ktp,
+	const char *line, size_t len)
 {
-	char *line = NULL;
-	unsigned int len = 0;
-
-	assert(ktp);
-	assert(msg);
-
 	if (!ktp->cb[KTP_SESSION_CB_STDOUT].fn)
 		return BOOL_TRUE; // Just ignore stdout. It's not a bug
 
-	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LINE, (void **)&line, &len))
-		return BOOL_TRUE; // It's strange but not a bug
-
 	if (len > 0) {
 		if (line[len - 1] == '\n')
 			ktp->stdout_need_newline = BOOL_FALSE;
@@ -324,6 +319,74 @@ static bool_t ktp_session_process_stdout(ktp_session_t *ktp, const faux_msg_t *m
 }
 
 
+static bool_t ktp_session_process_stdout(ktp_session_t *ktp, const faux_msg_t *msg)
+{
+	char *line = NULL;
+	unsigned int len = 0;
+
+	assert(ktp);
+	assert(msg);
+
+	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LINE, (void **)&line, &len))
+		return BOOL_TRUE; // It's strange but not a bug
+
+	return ktp_session_stdout_data(ktp, line, len);
+}
+
+
+// The message announces raw stdout data. The data will be received without
+// KTP parsing.
+static bool_t ktp_session_process_stdout_bulk(ktp_session_t *ktp,
+	const faux_msg_t *msg)
+{
+	uint32_t *len = NULL;
+	unsigned int param_len = 0;
+
+	assert(ktp);
+	assert(msg);
+
+	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LEN,
+		(void **)&len, &param_len))
+		return BOOL_FALSE;
+	if (param_len != sizeof(*len))
+		return BOOL_FALSE;
+	ktp->bulk_left = ntohl(*len);
+	if (ktp->bulk_left > 0)
+		faux_async_set_read_limits(ktp->async, 1, ktp->bulk_left);
+
+	return BOOL_TRUE;
+}
+
+
+// Passes raw bulk data to stdout callback
+static bool_t ktp_session_bulk_in(ktp_session_t *ktp,
+	faux_buf_t *buf, size_t len)
+{
+	while (len > 0) {
+		void *data = NULL;
+		ssize_t chunk = faux_buf_dread_lock_easy(buf, &data);
+		if (chunk <= 0)
+			break;
+		if ((size_t)chunk > len)
+			chunk = len;
+		if (KTP_SESSION_STATE_WAIT_FOR_CMD == ktp->state)
+			ktp_session_stdout_data(ktp, data, chunk);
+		faux_buf_dread_unlock_easy(buf, chunk);
+		len -= chunk;
+		ktp->bulk_left -= chunk;
+	}
+
+	// Plan to receive the rest of data or msg header
+	if (ktp->bulk_left > 0)
+		faux_async_set_read_limits(ktp->async, 1, ktp->bulk_left);
+	else
+		faux_async_set_read_limits(ktp->async,
+			sizeof(faux_hdr_t), sizeof(faux_hdr_t));
+
+	return BOOL_TRUE;
+}
+
+
 static bool_t ktp_session_process_stderr(ktp_session_t *ktp, const faux_msg_t *msg)
 {
 	char *line = NULL;
@@ -584,6 +647,11 @@ static bool_t ktp_session_dispatch(ktp_session_t *ktp, faux_msg_t *msg)
 		}
 		rc = ktp_session_process_stdout(ktp, msg);
 		break;
+	case KTP_STDOUT_BULK:
+		// Raw data must be received anyway to keep KTP stream
+		// consistent
+		rc = ktp_session_process_stdout_bulk(ktp, msg);
+		break;
 	case KTP_STDERR:
 		if (ktp->state != KTP_SESSION_STATE_WAIT_FOR_CMD) {
 			syslog(LOG_WARNING, "Unexpected KTP_STDERR was received\n");
@@ -614,6 +682,10 @@ static bool_t ktp_session_read_cb(faux_async_t *async,
 	assert(buf);
 	assert(ktp);
 
+	// Raw stdout data. Don't parse it
+	if (ktp->bulk_left > 0)
+		return ktp_session_bulk_in(ktp, buf, len);
+
 	// Linearize buffer
 	data = malloc(len);
 	faux_buf_read(buf, data, len);
@@ -747,6 +819,8 @@ bool_t ktp_session_auth(ktp_session_t *ktp, faux_error_t *error)
 		status |= KTP_STATUS_TTY_STDOUT;
 	if (isatty(STDERR_FILENO))
 		status |= KTP_STATUS_TTY_STDERR;
+	// Client session can receive raw stdout data
+	status |= KTP_STATUS_BULK_STDOUT;
 
 	// Send request
 	req = ktp_msg_preform(KTP_AUTH, status);
@@ -13,6 +13,8 @@
 #include <syslog.h>
 #include <poll.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <arpa/inet.h>
 #include <ctype.h>
 
 #include <faux/str.h>
@@ -23,10 +25,13 @@
 #include <faux/sysdb.h>
 #include <klish/ksession.h>
 #include <klish/ksession_parse.h>
+#include <klish/kzygote.h>
 #include <klish/ktp.h>
 #include <klish/ktp_session.h>
 
 #define BUF_LIMIT 65536
+// Minimal length of stdout data to send it by bulk
+#define BULK_MIN 4096
 
 
 typedef enum {
@@ -46,6 +51,11 @@ struct ktpd_session_s {
 	kexec_t *exec;
 	bool_t exit;
 	bool_t stdin_must_be_closed;
+	bool_t zygote; // Start zygote to spawn async ACTIONs
+	bool_t bulk; // Client accepts bulk stdout
+	int bulk_fd; // Source of bulk data
+	size_t bulk_left; // Announced bulk data that is not sent yet
+	bool_t bulk_ack; // ACK is postponed until bulk transfer is over
 };
 
 
@@ -54,6 +64,9 @@ static bool_t ktpd_session_read_cb(faux_async_t *async,
 	faux_buf_t *buf, size_t len, void *user_data);
 static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
+static bool_t zygote_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t exec_event_cb(kexec_t *exec, void *udata);
 bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t ktpd_session_log(ktpd_session_t *ktpd, const kexec_t *exec);
@@ -66,6 +79,8 @@ static bool_t action_stderr_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t get_stream(ktpd_session_t *ktpd, kexec_t *exec, int fd, bool_t is_stderr,
 	bool_t process_all_data);
+static bool_t bulk_out(ktpd_session_t *ktpd);
+static void bulk_flush(ktpd_session_t *ktpd);
 
 
 ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
@@ -102,6 +117,11 @@ ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 	// function must use ksession done flag. This exit flag is internal
 	// feature of KTPD session.
 	ktpd->exit = BOOL_FALSE;
+	ktpd->zygote = BOOL_FALSE;
+	ktpd->bulk = BOOL_FALSE;
+	ktpd->bulk_fd = -1;
+	ktpd->bulk_left = 0;
+	ktpd->bulk_ack = BOOL_FALSE;
 
 	// Async object
 	ktpd->async = faux_async_new(sock);
@@ -126,6 +146,7 @@ void ktpd_session_free(ktpd_session_t *ktpd)
 {
 	kcontext_t *context = NULL;
 	kscheme_t *scheme = NULL;
+	kzygote_t *zygote = NULL;
 
 	if (!ktpd)
 		return;
@@ -140,6 +161,17 @@ void ktpd_session_free(ktpd_session_t *ktpd)
 		kcontext_free(context);
 	}
 
+	// Event loop can serve other sessions so remove own events
+	if (ktpd->exec) {
+		faux_eloop_del_fd(ktpd->eloop, kexec_stdin(ktpd->exec));
+		faux_eloop_del_fd(ktpd->eloop, kexec_stdout(ktpd->exec));
+		faux_eloop_del_fd(ktpd->eloop, kexec_stderr(ktpd->exec));
+	}
+	zygote = ksession_zygote(ktpd->session);
+	if (zygote)
+		faux_eloop_del_fd(ktpd->eloop, kzygote_fd(zygote));
+	faux_eloop_del_fd(ktpd->eloop, ktpd_session_fd(ktpd));
+
 	kexec_free(ktpd->exec);
 	ksession_free(ktpd->session);
 	faux_free(ktpd->hdr);
@@ -263,6 +295,26 @@ static bool_t add_hotkeys_to_msg(ktpd_session_t *ktpd, faux_msg_t *msg)
 }
 
 
+// Async ACTIONs will be spawned by zygote. Service process forks them
+// itself if zygote can't be started.
+static bool_t ktpd_session_start_zygote(ktpd_session_t *ktpd)
+{
+	kzygote_t *zygote = NULL;
+
+	zygote = kzygote_new(ktpd->session);
+	if (!zygote) {
+		syslog(LOG_WARNING, "Can't start zygote process");
+		return BOOL_FALSE;
+	}
+	ksession_set_zygote(ktpd->session, zygote);
+	faux_eloop_add_fd(ktpd->eloop, kzygote_fd(zygote), POLLIN,
+		zygote_ev, ktpd);
+	syslog(LOG_DEBUG, "Zygote process was forked: %d", kzygote_pid(zygote));
+
+	return BOOL_TRUE;
+}
+
+
 // Now it's not really an auth function. Just a hand-shake with client and
 // passing prompt to client.
 static bool_t ktpd_session_process_auth(ktpd_session_t *ktpd, faux_msg_t *msg)
@@ -311,6 +363,8 @@ static bool_t ktpd_session_process_auth(ktpd_session_t *ktpd, faux_msg_t *msg)
 		KTP_STATUS_IS_TTY_STDOUT(client_status));
 	ksession_set_isatty_stderr(ktpd->session,
 		KTP_STATUS_IS_TTY_STDERR(client_status));
+	ktpd->bulk = KTP_STATUS_IS_BULK_STDOUT(client_status) ?
+		BOOL_TRUE : BOOL_FALSE;
 
 	// init session for plugins
 	scheme = ksession_scheme(ktpd->session);
@@ -320,6 +374,11 @@ static bool_t ktpd_session_process_auth(ktpd_session_t *ktpd, faux_msg_t *msg)
 	kscheme_init_session_plugins(scheme, context, NULL);
 	kcontext_free(context);
 
+	// Zygote is started after session plugins initialization to get
+	// their state.
+	if (ktpd->zygote)
+		ktpd_session_start_zygote(ktpd);
+
 	// Prepare ACK message
 	ack = ktp_msg_preform(cmd, status);
 	faux_msg_add_param(ack, KTP_PARAM_RETCODE, &retcode8bit, 1);
@@ -457,6 +516,10 @@ static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
 	// Set dry-run flag
 	kexec_set_dry_run(exec, dry_run);
 
+	// Session's eloop watches for ACTION's processes and executes filters
+	// with stream functions
+	kexec_set_eloop(exec, ktpd->eloop, exec_event_cb, ktpd);
+
 	// Session status can be changed while parsing
 // NOTE: kexec_t is atomic now
 //	if (ksession_done(ktpd->session)) {
@@ -506,8 +569,6 @@ static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
 static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data)
 {
-	int wstatus = 0;
-	pid_t child_pid = -1;
 	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
 	int retcode = -1;
 	uint8_t retcode8bit = 0;
@@ -520,19 +581,23 @@ static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	if (!ktpd)
 		return BOOL_FALSE;
 
-	// Wait for any child process. Doesn't block.
-	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
-		if (ktpd->exec)
-			kexec_continue_command_execution(ktpd->exec, child_pid,
-				wstatus);
-	}
 	if (!ktpd->exec)
 		return BOOL_TRUE;
+	// Processes are watched by pidfds. The SIGCHLD is for the systems
+	// without pidfd support. Only own processes of kexec are waited for.
+	kexec_wait_children(ktpd->exec);
 
 	// Check if kexec is done now
 	if (!kexec_retcode(ktpd->exec, &retcode))
 		return BOOL_TRUE; // Continue
 
+	// Announced bulk data must be sent before ACK. The end of bulk
+	// transfer will check kexec again.
+	if (ktpd->bulk_left > 0) {
+		ktpd->bulk_ack = BOOL_TRUE;
+		return BOOL_TRUE;
+	}
+
 	// Sometimes SIGCHILD signal can appear before all data were really read
 	// from process stdout buffer. So read the least data before closing
 	// file descriptors and send it to client.
@@ -582,6 +647,50 @@ static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
+// Processes spawned by zygote are not children of service process. Zygote
+// sends notifications about their termination.
+static bool_t zygote_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+	kzygote_t *zygote = NULL;
+	pid_t child_pid = -1;
+	int wstatus = 0;
+
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	zygote = ksession_zygote(ktpd->session);
+	while (kzygote_wait(zygote, &child_pid, &wstatus)) {
+		if (ktpd->exec)
+			kexec_continue_command_execution(ktpd->exec, child_pid,
+				wstatus);
+	}
+	if (!kzygote_alive(zygote)) {
+		syslog(LOG_ERR, "Zygote process is gone");
+		faux_eloop_del_fd(eloop, kzygote_fd(zygote));
+	}
+
+	// Check if kexec is done now. The same as for own children.
+	return wait_for_actions_ev(eloop, type, associated_data, ktpd);
+}
+
+
+// ACTION's process is terminated or in-daemon stream stage is done. Check
+// if kexec is done now.
+static bool_t exec_event_cb(kexec_t *exec, void *udata)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)udata;
+
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	exec = exec; // Happy compiler
+
+	return wait_for_actions_ev(ktpd->eloop, FAUX_ELOOP_FD, NULL, ktpd);
+}
+
+
 static bool_t ktpd_session_log(ktpd_session_t *ktpd, const kexec_t *exec)
 {
 	kexec_contexts_node_t *iter = NULL;
@@ -608,24 +717,6 @@ static bool_t ktpd_session_log(ktpd_session_t *ktpd, const kexec_t *exec)
 }
 
 
-static int compl_compare(const void *first, const void *second)
-{
-	const char *f = (const char *)first;
-	const char *s = (const char *)second;
-
-	return strcmp(f, s);
-}
-
-
-static int compl_kcompare(const void *key, const void *list_item)
-{
-	const char *f = (const char *)key;
-	const char *s = (const char *)list_item;
-
-	return strcmp(f, s);
-}
-
-
 static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *msg)
 {
 	char *line = NULL;
@@ -673,21 +764,24 @@ static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *
 	if (!kpargv_completions_is_empty(pargv)) {
 		const kentry_t *candidate = NULL;
 		kpargv_completions_node_t *citer = kpargv_completions_iter(pargv);
-		faux_list_node_t *compl_iter = NULL;
-		faux_list_t *completions = NULL;
-		char *compl_str = NULL;
-
-		completions = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
-			compl_compare, compl_kcompare,
-			(void (*)(void *))faux_str_free);
+		kcompl_t *compl = NULL;
+		kcompl_items_node_t *compl_iter = NULL;
+		kcompl_item_t *item = NULL;
+		size_t jobs_num = kpargv_completions_len(pargv);
+		ksession_job_t *jobs = NULL;
+		size_t i = 0;
+
+		// Completion syms can put items to collector directly
+		compl = kcompl_new(prefix,
+			ksession_completion_max(ktpd->session));
+		kpargv_set_compl(pargv, compl);
+
+		// Completion ACTIONs of all candidates are executed
+		// concurrently
+		jobs = faux_zmalloc(jobs_num * sizeof(*jobs));
+		assert(jobs);
 		while ((candidate = kpargv_completions_each(&citer))) {
 			const kentry_t *completion = NULL;
-			kparg_t *parg = NULL;
-			int rc = -1;
-			char *out = NULL;
-			bool_t res = BOOL_FALSE;
-			char *l = NULL; // One line of completion
-			const char *str = NULL;
 
 			// Get completion entry from candidate entry
 			completion = kentry_nested_by_purpose(candidate,
@@ -698,47 +792,43 @@ static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *
 				const kentry_t *ptype = NULL;
 				ptype = kentry_nested_by_purpose(candidate,
 					KENTRY_PURPOSE_PTYPE);
-				if (!ptype)
-					continue;
-				completion = kentry_nested_by_purpose(ptype,
-					KENTRY_PURPOSE_COMPLETION);
+				if (ptype)
+					completion = kentry_nested_by_purpose(
+						ptype, KENTRY_PURPOSE_COMPLETION);
 			}
-			if (!completion)
-				continue;
-			parg = kparg_new(candidate, prefix);
-			kpargv_set_candidate_parg(pargv, parg);
-			res = ksession_exec_locally(ktpd->session, completion,
-				pargv, NULL, NULL, &rc, &out);
-			kparg_free(parg);
-			if (!res || (rc < 0) || !out) {
-				if (out)
-					faux_str_free(out);
-				continue;
-			}
-
-			// Get all completions one by one
-			str = out;
-			while ((l = faux_str_getline(str, &str))) {
-				// Compare prefix
-				if ((prefix_len > 0) &&
-					(faux_str_cmpn(prefix, l, prefix_len) != 0)) {
-					faux_str_free(l);
-					continue;
-				}
-				compl_str = l + prefix_len;
-				faux_list_add(completions, faux_str_dup(compl_str));
-				faux_str_free(l);
+			if (completion) {
+				jobs[i].entry = completion;
+				jobs[i].candidate = kparg_new(candidate, prefix);
 			}
+			i++;
+		}
+		ksession_exec_locally_jobs(ktpd->session, pargv, jobs, jobs_num,
+			ksession_completion_timeout(ktpd->session));
+
+		// Text output of completion ACTIONs. One completion per line
+		for (i = 0; i < jobs_num; i++) {
+			char *out = jobs[i].out;
+
+			if (jobs[i].timed_out)
+				status |= KTP_STATUS_PARTIAL;
+			if (jobs[i].res && (jobs[i].retcode >= 0) && out)
+				kcompl_add_text(compl,
+					kparg_entry(jobs[i].candidate), out);
 			faux_str_free(out);
+			kparg_free(jobs[i].candidate);
 		}
-
-		// Put completion list to message
-		compl_iter = faux_list_head(completions);
-		while ((compl_str = faux_list_each(&compl_iter))) {
+		faux_free(jobs);
+		if (kcompl_is_full(compl))
+			status |= KTP_STATUS_PARTIAL;
+		faux_msg_set_status(ack, status);
+
+		// Put completion list to message. Prefix is already typed.
+		compl_iter = kcompl_items_iter(compl);
+		while ((item = kcompl_items_each(&compl_iter))) {
+			const char *compl_str = kcompl_item_text(item) + prefix_len;
 			faux_msg_add_param(ack, KTP_PARAM_LINE,
 				compl_str, strlen(compl_str));
 		}
-		faux_list_free(completions);
 	}
 
 	faux_msg_send_async(ack, ktpd->async);
@@ -819,9 +909,22 @@ static bool_t ktpd_session_process_help(ktpd_session_t *ktpd, faux_msg_t *msg)
 		faux_list_node_t *help_iter = NULL;
 		faux_list_t *help_list = NULL;
 		help_t *help_struct = NULL;
-
-		help_list = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
-			help_compare, NULL, help_free);
+		size_t jobs_num = kpargv_completions_len(pargv);
+		ksession_job_t *jobs = NULL;
+		size_t i = 0;
+		kcompl_t *compl = NULL;
+		kcompl_items_node_t *compl_iter = NULL;
+		kcompl_item_t *item = NULL;
+
+		// Help syms can put items to collector directly. Help is
+		// generated for all candidates so prefix is not used.
+		compl = kcompl_new(NULL,
+			ksession_completion_max(ktpd->session));
+		kpargv_set_compl(pargv, compl);
+
+		// Help ACTIONs of all candidates are executed concurrently
+		jobs = faux_zmalloc(jobs_num * sizeof(*jobs));
+		assert(jobs);
 		while ((candidate = kpargv_completions_each(&citer))) {
 			const kentry_t *help = NULL;
 			const kentry_t *ptype = NULL;
@@ -835,19 +938,34 @@ static bool_t ktpd_session_process_help(ktpd_session_t *ktpd, faux_msg_t *msg)
 			if (!help && ptype)
 				help = kentry_nested_by_purpose(ptype,
 					KENTRY_PURPOSE_HELP);
-
-			// Generate help with found ACTION
 			if (help) {
-				char *out = NULL;
-				kparg_t *parg = NULL;
-				int rc = -1;
+				jobs[i].entry = help;
+				jobs[i].candidate = kparg_new(candidate, prefix);
+			}
+			i++;
+		}
+		ksession_exec_locally_jobs(ktpd->session, pargv, jobs, jobs_num,
+			ksession_completion_timeout(ktpd->session));
 
-				parg = kparg_new(candidate, prefix);
-				kpargv_set_candidate_parg(pargv, parg);
-				ksession_exec_locally(ktpd->session,
-					help, pargv, NULL, NULL, &rc, &out);
-				kparg_free(parg);
+		help_list = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
+			help_compare, NULL, help_free);
+		citer = kpargv_completions_iter(pargv);
+		i = 0;
+		while ((candidate = kpargv_completions_each(&citer))) {
+			ksession_job_t *job = &jobs[i++];
+			const kentry_t *ptype = NULL;
 
+			// Get PTYPE of parameter
+			ptype = kentry_nested_by_purpose(candidate,
+				KENTRY_PURPOSE_PTYPE);
+
+			// Help generated with found ACTION
+			if (job->entry) {
+				char *out = job->out;
+
+				kparg_free(job->candidate);
+				if (job->timed_out)
+					status |= KTP_STATUS_PARTIAL;
 				if (out) {
 					const char *str = out;
 					char *prefix_str = NULL;
@@ -903,6 +1021,26 @@ static bool_t ktpd_session_process_help(ktpd_session_t *ktpd, faux_msg_t *msg)
 			}
 		}
 
+		faux_free(jobs);
+
+		// Items from collector. Candidate's help is used if item has
+		// no help.
+		compl_iter = kcompl_items_iter(compl);
+		while ((item = kcompl_items_each(&compl_iter))) {
+			const char *line_str = kcompl_item_help(item);
+			if (!line_str && kcompl_item_entry(item))
+				line_str = kentry_help(kcompl_item_entry(item));
+			if (!line_str)
+				line_str = "";
+			help_struct = help_new(faux_str_dup(kcompl_item_text(item)),
+				faux_str_dup(line_str));
+			if (!faux_list_add(help_list, help_struct))
+				help_free(help_struct);
+		}
+		if (kcompl_is_full(compl))
+			status |= KTP_STATUS_PARTIAL;
+		faux_msg_set_status(ack, status);
+
 		// Put help list to message
 		help_iter = faux_list_head(help_list);
 		while ((help_struct = (help_t *)faux_list_each(&help_iter))) {
@@ -1098,10 +1236,9 @@ static bool_t ktpd_session_process_winch(ktpd_session_t *ktpd, faux_msg_t *msg)
 	ksession_set_term_height(ktpd->session, height);
 	faux_str_free(line);
 
-	if (!ktpd->exec)
-		return BOOL_TRUE;
-	// Set pseudo terminal window size
-	kexec_set_winsize(ktpd->exec);
+	// Set pseudo terminal window size. Session's pseudo terminal
+	// keeps it for all the next commands.
+	ksession_pty_set_winsize(ktpd->session);
 
 	return BOOL_TRUE;
 }
@@ -1152,6 +1289,8 @@ static bool_t ktpd_session_process_stdout_close(ktpd_session_t *ktpd,
 	fd = kexec_stdout(ktpd->exec);
 	if (fd < 0)
 		return BOOL_FALSE;
+	// Client waits for announced bulk data anyway
+	bulk_flush(ktpd);
 	close(fd);
 	// Remove already generated data from out buffer. This data is not
 	// needed now
@@ -1356,6 +1495,21 @@ bool_t ktpd_session_connected(ktpd_session_t *ktpd)
 }
 
 
+/** @brief Session is finished and can be freed.
+ *
+ * Event loop is stopped when session is finished. It's a way to find out
+ * which session has stopped the loop when loop serves several sessions.
+ */
+bool_t ktpd_session_done(const ktpd_session_t *ktpd)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_TRUE;
+
+	return ktpd->exit;
+}
+
+
 int ktpd_session_fd(const ktpd_session_t *ktpd)
 {
 	assert(ktpd);
@@ -1366,6 +1520,206 @@ int ktpd_session_fd(const ktpd_session_t *ktpd)
 }
 
 
+/** @brief Sets time limit for completion/help generation.
+ *
+ * Results of slow completion sources are dropped and client gets partial
+ * results. Value is in milliseconds. 0 - unlimited.
+ */
+bool_t ktpd_session_set_completion_timeout(ktpd_session_t *ktpd,
+	unsigned int timeout)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	return ksession_set_completion_timeout(ktpd->session, timeout);
+}
+
+
+/** @brief Sets max number of completion items.
+ *
+ * Generation of completions is stopped when the limit is reached and
+ * client gets partial results. 0 - unlimited.
+ */
+bool_t ktpd_session_set_completion_max(ktpd_session_t *ktpd, size_t max)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	return ksession_set_completion_max(ktpd->session, max);
+}
+
+
+/** @brief Enables zygote process to spawn async ACTIONs.
+ *
+ * Zygote is forked after client's authentication.
+ */
+bool_t ktpd_session_set_zygote(ktpd_session_t *ktpd, bool_t zygote)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	ktpd->zygote = zygote;
+
+	return BOOL_TRUE;
+}
+
+
+// === Bulk stdout
+// The KTP_STDOUT_BULK message announces the length of raw stdout data that
+// follows the message. The data is moved from action's stdout pipe to the
+// client's socket by splice() without copying to user space. Nothing else
+// can be sent to client until all announced data is sent. So streams are
+// not read and ACK is postponed while bulk transfer is active. The exec
+// doesn't read its stdout pipe meanwhile (see kexec_set_stdout_held()).
+
+// Bulk transfer is over. Restore stdout and stderr receiving.
+static void bulk_done(ktpd_session_t *ktpd)
+{
+	ktpd->bulk_fd = -1;
+	ktpd->bulk_left = 0;
+
+	if (!ktpd->exec)
+		return;
+	kexec_set_stdout_held(ktpd->exec, BOOL_FALSE);
+	if (faux_buf_len(faux_async_obuf(ktpd->async)) >= BUF_LIMIT)
+		return;
+	faux_eloop_include_fd_event(ktpd->eloop,
+		kexec_stdout(ktpd->exec), POLLIN);
+	faux_eloop_include_fd_event(ktpd->eloop,
+		kexec_stderr(ktpd->exec), POLLIN);
+}
+
+
+// Sends announced bulk data while socket is writable. Returns BOOL_FALSE
+// on error.
+static bool_t bulk_out(ktpd_session_t *ktpd)
+{
+	int sock = faux_async_fd(ktpd->async);
+
+	if (0 == ktpd->bulk_left)
+		return BOOL_TRUE;
+
+	// The KTP_STDOUT_BULK header must be sent first
+	if (faux_buf_len(faux_async_obuf(ktpd->async)) > 0) {
+		if (faux_async_out_easy(ktpd->async) < 0)
+			return BOOL_FALSE;
+		if (faux_buf_len(faux_async_obuf(ktpd->async)) > 0) {
+			faux_eloop_include_fd_event(ktpd->eloop, sock, POLLOUT);
+			return BOOL_TRUE;
+		}
+	}
+
+	while (ktpd->bulk_left > 0) {
+		int avail = 0;
+		size_t len = ktpd->bulk_left;
+		ssize_t r = 0;
+		// Announced data was within pipe. So empty pipe means the data
+		// is lost. Keep KTP stream consistent anyway. Then EAGAIN of
+		// splice() means that socket is full only.
+		if ((ioctl(ktpd->bulk_fd, FIONREAD, &avail) < 0) ||
+			(avail <= 0)) {
+			syslog(LOG_ERR, "Announced bulk data is lost");
+			bulk_flush(ktpd);
+			return BOOL_TRUE;
+		}
+		if (len > (size_t)avail)
+			len = avail;
+		r = splice(ktpd->bulk_fd, NULL, sock, NULL,
+			len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			if (EAGAIN == errno) { // Socket is full
+				faux_eloop_include_fd_event(ktpd->eloop,
+					sock, POLLOUT);
+				return BOOL_TRUE;
+			}
+			syslog(LOG_ERR, "Can't splice stdout to client: %s",
+				strerror(errno));
+			return BOOL_FALSE;
+		}
+		if (0 == r) { // Writers are gone
+			bulk_flush(ktpd);
+			return BOOL_TRUE;
+		}
+		ktpd->bulk_left -= r;
+	}
+	bulk_done(ktpd);
+
+	return BOOL_TRUE;
+}
+
+
+// Sends the rest of announced bulk data through the common out buffer.
+// It's for the case when stdout pipe will be closed.
+static void bulk_flush(ktpd_session_t *ktpd)
+{
+	char buf[4096];
+
+	while (ktpd->bulk_left > 0) {
+		size_t len = sizeof(buf);
+		ssize_t r = 0;
+		if (len > ktpd->bulk_left)
+			len = ktpd->bulk_left;
+		r = read(ktpd->bulk_fd, buf, len);
+		if ((r < 0) && (EINTR == errno))
+			continue;
+		// Data is lost. Keep KTP stream consistent anyway
+		if (r <= 0) {
+			memset(buf, 0, len);
+			r = len;
+		}
+		faux_async_write(ktpd->async, buf, r);
+		ktpd->bulk_left -= r;
+	}
+	bulk_done(ktpd);
+}
+
+
+// Starts bulk transfer if there is enough data within stdout pipe.
+// Returns BOOL_TRUE if transfer is started.
+static bool_t bulk_start(ktpd_session_t *ktpd, kexec_t *exec, int fd)
+{
+	struct stat st = {};
+	int avail = 0;
+	uint32_t len = 0;
+	faux_msg_t *ack = NULL;
+
+	if (!ktpd->bulk || (fd < 0))
+		return BOOL_FALSE;
+	// Previous data must be sent first
+	if ((faux_buf_len(kexec_bufout(exec)) > 0) ||
+		(faux_buf_len(faux_async_obuf(ktpd->async)) > 0))
+		return BOOL_FALSE;
+	// Pseudoterminal can't be spliced
+	if ((fstat(fd, &st) < 0) || !S_ISFIFO(st.st_mode))
+		return BOOL_FALSE;
+	if ((ioctl(fd, FIONREAD, &avail) < 0) || (avail < BULK_MIN))
+		return BOOL_FALSE;
+
+	ack = ktp_msg_preform(KTP_STDOUT_BULK, KTP_STATUS_NONE);
+	len = htonl((uint32_t)avail);
+	faux_msg_add_param(ack, KTP_PARAM_LEN, &len, sizeof(len));
+	faux_msg_send_async(ack, ktpd->async);
+	faux_msg_free(ack);
+
+	ktpd->bulk_fd = fd;
+	ktpd->bulk_left = avail;
+	kexec_set_stdout_held(exec, BOOL_TRUE);
+	// Don't read streams until bulk transfer is over
+	faux_eloop_exclude_fd_event(ktpd->eloop, kexec_stdout(exec), POLLIN);
+	faux_eloop_exclude_fd_event(ktpd->eloop, kexec_stderr(exec), POLLIN);
+
+	if (!bulk_out(ktpd))
+		syslog(LOG_ERR, "Can't send bulk data to client");
+
+	return BOOL_TRUE;
+}
+
+
 static bool_t get_stream(ktpd_session_t *ktpd, kexec_t *exec, int fd, bool_t is_stderr,
 	bool_t process_all_data)
 {
@@ -1380,6 +1734,14 @@ static bool_t get_stream(ktpd_session_t *ktpd, kexec_t *exec, int fd, bool_t is_
 	if (!exec)
 		return BOOL_TRUE;
 
+	// Nothing can be sent while bulk transfer is active
+	if (ktpd->bulk_left > 0)
+		return BOOL_TRUE;
+	// Large output goes by bulk. But final reading (before ACK) must be
+	// fast so use common way.
+	if (!is_stderr && !process_all_data && bulk_start(ktpd, exec, fd))
+		return BOOL_TRUE;
+
 	if (is_stderr)
 		faux_buf = kexec_buferr(exec);
 	else
@@ -1482,12 +1844,21 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	assert(async);
 
 	// Write data
-	if (info->revents & POLLOUT) {
+	if ((info->revents & POLLOUT) && (ktpd->bulk_left > 0)) {
+		faux_eloop_exclude_fd_event(eloop, info->fd, POLLOUT);
+		if (!bulk_out(ktpd)) {
+			faux_eloop_del_fd(eloop, info->fd);
+			syslog(LOG_ERR, "Can't send bulk data to client");
+			ktpd->exit = BOOL_TRUE;
+			return BOOL_FALSE; // Stop event loop
+		}
+	} else if (info->revents & POLLOUT) {
 		faux_eloop_exclude_fd_event(eloop, info->fd, POLLOUT);
 		if (faux_async_out_easy(async) < 0) {
 			// Someting went wrong
 			faux_eloop_del_fd(eloop, info->fd);
 			syslog(LOG_ERR, "Can't send data to client");
+			ktpd->exit = BOOL_TRUE;
 			return BOOL_FALSE; // Stop event loop
 		}
 		// Restore stdout and stderr receiving if out buffer is not
@@ -1507,6 +1878,7 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 			// Someting went wrong
 			faux_eloop_del_fd(eloop, info->fd);
 			syslog(LOG_ERR, "Can't get data from client");
+			ktpd->exit = BOOL_TRUE;
 			return BOOL_FALSE; // Stop event loop
 		}
 	}
@@ -1515,6 +1887,7 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	if (info->revents & POLLHUP) {
 		faux_eloop_del_fd(eloop, info->fd);
 		syslog(LOG_DEBUG, "Connection %d is closed by client", info->fd);
+		ktpd->exit = BOOL_TRUE;
 		return BOOL_FALSE; // Stop event loop
 	}
 
@@ -1522,6 +1895,7 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	if (info->revents & POLLERR) {
 		faux_eloop_del_fd(eloop, info->fd);
 		syslog(LOG_DEBUG, "POLLERR received %d", info->fd);
+		ktpd->exit = BOOL_TRUE;
 		return BOOL_FALSE; // Stop event loop
 	}
 
@@ -1529,9 +1903,17 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	if (info->revents & POLLNVAL) {
 		faux_eloop_del_fd(eloop, info->fd);
 		syslog(LOG_DEBUG, "POLLNVAL received %d", info->fd);
+		ktpd->exit = BOOL_TRUE;
 		return BOOL_FALSE; // Stop event loop
 	}
 
+	// Bulk transfer is over so send postponed ACK
+	if (ktpd->bulk_ack && (0 == ktpd->bulk_left)) {
+		ktpd->bulk_ack = BOOL_FALSE;
+		if (!wait_for_actions_ev(eloop, type, NULL, ktpd))
+			return BOOL_FALSE;
+	}
+
 	type = type; // Happy compiler
 
 	// Session can be really finished here. Note KTPD session can't be
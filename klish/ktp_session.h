@@ -117,7 +117,12 @@ ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 	const char *start_entry, faux_eloop_t *eloop);
 void ktpd_session_free(ktpd_session_t *session);
 bool_t ktpd_session_connected(ktpd_session_t *session);
+bool_t ktpd_session_done(const ktpd_session_t *session);
 int ktpd_session_fd(const ktpd_session_t *session);
+bool_t ktpd_session_set_completion_timeout(ktpd_session_t *session,
+	unsigned int timeout);
+bool_t ktpd_session_set_completion_max(ktpd_session_t *session, size_t max);
+bool_t ktpd_session_set_zygote(ktpd_session_t *session, bool_t zygote);
 bool_t ktpd_session_async_in(ktpd_session_t *session);
 bool_t ktpd_session_async_out(ktpd_session_t *session);
 
@@ -34,9 +34,28 @@ bool_t kxml_doc_start(void);
 bool_t kxml_doc_stop(void);
 
 
+/** @brief Description of XML parsing error.
+ *
+ * Line and column are -1 if engine can't get them.
+ */
+typedef struct {
+	int line;
+	int col;
+	char msg[256];
+} kxml_err_t;
+
+
 /** @brief Read an XML document.
+ *
+ * On failure the err (if not NULL) gets error description.
+ */
+kxml_doc_t *kxml_doc_read(const char *filename, kxml_err_t *err);
+
+
+/** @brief Checks if different documents can be read by different threads
+ * simultaneously.
  */
-kxml_doc_t *kxml_doc_read(const char *filename);
+bool_t kxml_doc_is_thread_safe(void);
 
 
 /** @brief Release a previously opened XML document.
@@ -56,13 +75,6 @@ bool_t kxml_doc_is_valid(const kxml_doc_t *doc);
 kxml_node_t *kxml_doc_root(const kxml_doc_t *doc);
 
 
-/** @brief Gets error description, when available.
- */
-int kxml_doc_err_line(kxml_doc_t *doc);
-int kxml_doc_err_col(kxml_doc_t *doc);
-const char *kxml_doc_err_msg(kxml_doc_t *doc);
-
-
 /** @brief Node types.
  */
 typedef enum {
@@ -118,9 +130,12 @@ void kxml_node_attr_free(char *str);
 
 
 /** @brief XML-helper
+ *
+ * The threads is a number of threads to read XML files. The 0 means
+ * number of CPUs. The timing enables logging of load phases durations.
  */
 bool_t kxml_load_scheme(kscheme_t *scheme, const char *xml_path,
-	faux_error_t *error);
+	unsigned int threads, bool_t timing, faux_error_t *error);
 
 
 /** @brief Typical XML parser functions
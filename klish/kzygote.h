@@ -0,0 +1,31 @@
+/** @file kzygote.h
+ *
+ * @brief Klish zygote. Helper process to spawn async ACTIONs.
+ */
+
+#ifndef _klish_kzygote_h
+#define _klish_kzygote_h
+
+#include <sys/types.h>
+#include <faux/faux.h>
+#include <klish/kcontext.h>
+#include <klish/ksession.h>
+
+typedef struct kzygote_s kzygote_t;
+
+
+C_DECL_BEGIN
+
+kzygote_t *kzygote_new(ksession_t *session);
+void kzygote_free(kzygote_t *zygote);
+
+pid_t kzygote_pid(const kzygote_t *zygote);
+int kzygote_fd(const kzygote_t *zygote);
+bool_t kzygote_alive(const kzygote_t *zygote);
+bool_t kzygote_spawn(kzygote_t *zygote, const kcontext_t *context,
+	const char *pts_fname, pid_t *pid);
+bool_t kzygote_wait(kzygote_t *zygote, pid_t *pid, int *wstatus);
+
+C_DECL_END
+
+#endif // _klish_kzygote_h
@@ -6,11 +6,16 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #include <faux/faux.h>
 #include <faux/str.h>
@@ -175,45 +180,63 @@ static bool_t process_node(const kxml_node_t *node, void *parent, faux_error_t *
 }
 
 
-static bool_t kxml_load_file(kscheme_t *scheme, const char *filename,
-	faux_error_t *error)
-{
-	kxml_doc_t *doc = NULL;
-	kxml_node_t *root = NULL;
-	bool_t r = BOOL_FALSE;
+/** @brief XML file to load.
+ */
+typedef struct {
+	char *filename;
+	kxml_doc_t *doc;
+	kxml_err_t err;
+} kxml_file_t;
 
-	if (!scheme)
-		return BOOL_FALSE;
-	if (!filename)
-		return BOOL_FALSE;
 
-#ifdef KXML_DEBUG
-	printf("kxml: Processing XML file \"%s\"\n", filename);
-#endif
+/** @brief List of XML files to load.
+ *
+ * Documents can be read by parallel threads. Threads take files one by one
+ * using "next" index.
+ */
+typedef struct {
+	kxml_file_t *files;
+	size_t num;
+	size_t size;
+	size_t next;
+	pthread_mutex_t mutex;
+} kxml_files_t;
 
-	doc = kxml_doc_read(filename);
-	if (!kxml_doc_is_valid(doc)) {
-/*		int errcaps = kxml_doc_error_caps(doc);
-		printf("Unable to open file '%s'", filename);
-		if ((errcaps & kxml_ERR_LINE) == kxml_ERR_LINE)
-			printf(", at line %d", kxml_doc_err_line(doc));
-		if ((errcaps & kxml_ERR_COL) == kxml_ERR_COL)
-			printf(", at column %d", kxml_doc_err_col(doc));
-		if ((errcaps & kxml_ERR_DESC) == kxml_ERR_DESC)
-			printf(", message is %s", kxml_doc_err_msg(doc));
-		printf("\n");
-*/		kxml_doc_release(doc);
-		return BOOL_FALSE;
+
+static void kxml_files_add(kxml_files_t *files, char *filename)
+{
+	kxml_file_t *file = NULL;
+
+	if (files->num >= files->size) {
+		files->size = files->size ? (files->size * 2) : 64;
+		files->files = realloc(files->files,
+			files->size * sizeof(*files->files));
+		assert(files->files);
 	}
-	root = kxml_doc_root(doc);
-	r = process_node(root, scheme, error);
-	kxml_doc_release(doc);
-	if (!r) {
-		faux_error_sprintf(error, TAG": Illegal file %s", filename);
-		return BOOL_FALSE;
+	file = &files->files[files->num++];
+	memset(file, 0, sizeof(*file));
+	file->filename = filename;
+}
+
+
+static void kxml_files_free(kxml_files_t *files)
+{
+	size_t i = 0;
+
+	for (i = 0; i < files->num; i++) {
+		kxml_doc_release(files->files[i].doc);
+		faux_str_free(files->files[i].filename);
 	}
+	faux_free(files->files);
+}
 
-	return BOOL_TRUE;
+
+static int kxml_file_compare(const void *first, const void *second)
+{
+	const kxml_file_t *f = (const kxml_file_t *)first;
+	const kxml_file_t *s = (const kxml_file_t *)second;
+
+	return strcmp(f->filename, s->filename);
 }
 
 
@@ -223,17 +246,16 @@ static const char *default_path = "/etc/klish;~/.klish";
 static const char *path_separators = ":;";
 
 
-bool_t kxml_load_scheme(kscheme_t *scheme, const char *xml_path,
-	faux_error_t *error)
+/** @brief Gets list of XML files.
+ *
+ * Order of path elements is kept. Files within directory are sorted by
+ * name so loading result doesn't depend on readdir() order.
+ */
+static void kxml_files_scan(kxml_files_t *files, const char *xml_path)
 {
 	char *path = NULL;
 	char *fn = NULL;
 	char *saveptr = NULL;
-	bool_t ret = BOOL_TRUE;
-
-	assert(scheme);
-	if (!scheme)
-		return BOOL_FALSE;
 
 	// Use the default path if xml path is not specified.
 	// Dup is needed because sring will be tokenized but
@@ -253,15 +275,14 @@ bool_t kxml_load_scheme(kscheme_t *scheme, const char *xml_path,
 		DIR *dir = NULL;
 		struct dirent *entry = NULL;
 		char *realpath = NULL;
+		size_t first = files->num;
 
 		// Expand tilde. Tilde must be the first symbol.
 		realpath = faux_expand_tilde(fn);
 
 		// Regular file
 		if (faux_isfile(realpath)) {
-			if (!kxml_load_file(scheme, realpath, error))
-				ret = BOOL_FALSE;
-			faux_str_free(realpath);
+			kxml_files_add(files, realpath);
 			continue;
 		}
 
@@ -276,21 +297,206 @@ bool_t kxml_load_scheme(kscheme_t *scheme, const char *xml_path,
 		}
 		for (entry = readdir(dir); entry; entry = readdir(dir)) {
 			const char *extension = strrchr(entry->d_name, '.');
-			char *filename = NULL;
 
 			// Check the filename
 			if (!extension || strcmp(".xml", extension))
 				continue;
-			filename = faux_str_sprintf("%s/%s", realpath, entry->d_name);
-			if (!kxml_load_file(scheme, filename, error))
-				ret = BOOL_FALSE;
-			faux_str_free(filename);
+			kxml_files_add(files, faux_str_sprintf("%s/%s",
+				realpath, entry->d_name));
 		}
 		closedir(dir);
 		faux_str_free(realpath);
+		qsort(files->files + first, files->num - first,
+			sizeof(*files->files), kxml_file_compare);
 	}
 
 	faux_str_free(path);
+}
+
+
+static void kxml_file_read(kxml_file_t *file)
+{
+#ifdef KXML_DEBUG
+	printf("kxml: Reading XML file \"%s\"\n", file->filename);
+#endif
+
+	file->err.line = -1;
+	file->err.col = -1;
+	snprintf(file->err.msg, sizeof(file->err.msg), "Illegal document");
+	file->doc = kxml_doc_read(file->filename, &file->err);
+}
+
+
+static void *kxml_files_read_thread(void *arg)
+{
+	kxml_files_t *files = (kxml_files_t *)arg;
+
+	while (1) {
+		size_t i = 0;
+
+		pthread_mutex_lock(&files->mutex);
+		i = files->next++;
+		pthread_mutex_unlock(&files->mutex);
+		if (i >= files->num)
+			break;
+		kxml_file_read(&files->files[i]);
+	}
+
+	return NULL;
+}
+
+
+/** @brief Reads all XML documents by parallel threads.
+ *
+ * Current thread reads documents too. So there is no problem if some
+ * threads can't be created.
+ */
+static void kxml_files_read(kxml_files_t *files, unsigned int threads_num)
+{
+	pthread_t *threads = NULL;
+	unsigned int started = 0;
+	unsigned int i = 0;
+
+	files->next = 0;
+	if (threads_num > files->num)
+		threads_num = files->num;
+	if (threads_num > 1) {
+		threads = faux_zmalloc((threads_num - 1) * sizeof(*threads));
+		assert(threads);
+	}
+	for (i = 0; i < (threads_num - 1); i++) {
+		if (pthread_create(&threads[started], NULL,
+			kxml_files_read_thread, files) != 0)
+			break;
+		started++;
+	}
+	kxml_files_read_thread(files);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	faux_free(threads);
+}
+
+
+// Converts document to scheme objects and releases it
+static bool_t kxml_file_process(kscheme_t *scheme, kxml_file_t *file,
+	faux_error_t *error)
+{
+	kxml_node_t *root = NULL;
+	bool_t r = BOOL_FALSE;
+
+	if (!kxml_doc_is_valid(file->doc)) {
+		kxml_doc_release(file->doc);
+		file->doc = NULL;
+		if ((file->err.line >= 0) && (file->err.col >= 0))
+			faux_error_sprintf(error,
+				TAG": Can't parse file %s, line %d, column %d: %s",
+				file->filename, file->err.line, file->err.col,
+				file->err.msg);
+		else if (file->err.line >= 0)
+			faux_error_sprintf(error,
+				TAG": Can't parse file %s, line %d: %s",
+				file->filename, file->err.line, file->err.msg);
+		else
+			faux_error_sprintf(error,
+				TAG": Can't parse file %s: %s",
+				file->filename, file->err.msg);
+		return BOOL_FALSE;
+	}
+
+#ifdef KXML_DEBUG
+	printf("kxml: Processing XML file \"%s\"\n", file->filename);
+#endif
+
+	root = kxml_doc_root(file->doc);
+	r = process_node(root, scheme, error);
+	kxml_doc_release(file->doc);
+	file->doc = NULL;
+	if (!r) {
+		faux_error_sprintf(error, TAG": Illegal file %s", file->filename);
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Milliseconds since start. Start is updated.
+static double kxml_phase_time(struct timespec *start)
+{
+	struct timespec now = {};
+	double ms = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - start->tv_sec) * 1000.0 +
+		(now.tv_nsec - start->tv_nsec) / 1000000.0;
+	*start = now;
+
+	return ms;
+}
+
+
+/** @brief Loads scheme from XML files.
+ *
+ * Reading of XML documents (file reading and parsing to DOM tree) is
+ * independent for each file so documents can be read by parallel threads.
+ * Then documents are converted to scheme objects one by one in the order
+ * of files list. So result is the same as for serial loading. Errors are
+ * reported in the same order too.
+ */
+bool_t kxml_load_scheme(kscheme_t *scheme, const char *xml_path,
+	unsigned int threads, bool_t timing, faux_error_t *error)
+{
+	kxml_files_t files = {};
+	struct timespec start = {};
+	double scan_ms = 0;
+	double read_ms = 0;
+	double process_ms = 0;
+	bool_t ret = BOOL_TRUE;
+	size_t i = 0;
+
+	assert(scheme);
+	if (!scheme)
+		return BOOL_FALSE;
+
+	if (0 == threads) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cpus > 0) ? cpus : 1;
+	}
+	if (!kxml_doc_is_thread_safe())
+		threads = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	kxml_files_scan(&files, xml_path);
+	scan_ms = kxml_phase_time(&start);
+
+	if ((threads > 1) && (files.num > 1)) {
+		pthread_mutex_init(&files.mutex, NULL);
+		kxml_files_read(&files, threads);
+		pthread_mutex_destroy(&files.mutex);
+		read_ms = kxml_phase_time(&start);
+		for (i = 0; i < files.num; i++) {
+			if (!kxml_file_process(scheme, &files.files[i], error))
+				ret = BOOL_FALSE;
+		}
+		process_ms = kxml_phase_time(&start);
+	} else {
+		// Only one document is in memory at a time
+		threads = 1;
+		for (i = 0; i < files.num; i++) {
+			kxml_file_read(&files.files[i]);
+			read_ms += kxml_phase_time(&start);
+			if (!kxml_file_process(scheme, &files.files[i], error))
+				ret = BOOL_FALSE;
+			process_ms += kxml_phase_time(&start);
+		}
+	}
+
+	if (timing)
+		syslog(LOG_INFO, "XML scheme loading: %zu files, %u threads, "
+			"scan %.3f ms, read %.3f ms, process %.3f ms",
+			files.num, threads, scan_ms, read_ms, process_ms);
+
+	kxml_files_free(&files);
 
 	return ret;
 }
@@ -539,6 +745,8 @@ static bool_t process_entry(const kxml_node_t *element, void *parent,
 	ientry.restore = kxml_node_attr(element, "restore");
 	ientry.order = kxml_node_attr(element, "order");
 	ientry.filter = kxml_node_attr(element, "filter");
+	ientry.cache = kxml_node_attr(element, "cache");
+	ientry.timeout = kxml_node_attr(element, "timeout");
 
 	if (!(entry = add_entry_to_hierarchy(element, parent, &ientry, error)))
 		goto err;
@@ -560,6 +768,8 @@ err:
 	kxml_node_attr_free(ientry.restore);
 	kxml_node_attr_free(ientry.order);
 	kxml_node_attr_free(ientry.filter);
+	kxml_node_attr_free(ientry.cache);
+	kxml_node_attr_free(ientry.timeout);
 
 	return res;
 }
@@ -637,6 +847,7 @@ static bool_t process_ptype(const kxml_node_t *element, void *parent,
 	ientry.restore = "false";
 	ientry.order = "true";
 	ientry.filter = "false";
+	ientry.cache = kxml_node_attr(element, "cache");
 
 	if (!(entry = add_entry_to_hierarchy(element, parent, &ientry, error)))
 		goto err;
@@ -651,6 +862,7 @@ err:
 	kxml_node_attr_free(ientry.help);
 	kxml_node_attr_free(ientry.ref);
 	kxml_node_attr_free(ientry.value);
+	kxml_node_attr_free(ientry.cache);
 
 	return res;
 }
@@ -884,6 +1096,8 @@ static bool_t process_command(const kxml_node_t *element, void *parent,
 		else
 			ientry.filter = "false";
 	}
+	// Completion/help timeout
+	ientry.timeout = kxml_node_attr(element, "timeout");
 
 	if (!(entry = add_entry_to_hierarchy(element, parent, &ientry, error)))
 		goto err;
@@ -927,6 +1141,7 @@ err:
 	}
 	if (is_filter)
 		kxml_node_attr_free(ientry.filter);
+	kxml_node_attr_free(ientry.timeout);
 
 	return res;
 }
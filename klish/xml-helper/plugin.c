@@ -6,6 +6,7 @@
 #include <faux/faux.h>
 #include <faux/str.h>
 #include <faux/error.h>
+#include <faux/conv.h>
 #include <klish/kxml.h>
 #include <klish/kscheme.h>
 #include <klish/kdb.h>
@@ -32,6 +33,9 @@ bool_t kxml_plugin_load_scheme(kdb_t *db, kscheme_t *scheme)
 	faux_ini_t *ini = NULL;
 	faux_error_t *error = NULL;
 	const char *xml_path = NULL;
+	const char *tmp = NULL;
+	unsigned int threads = 0; // Number of CPUs
+	bool_t timing = BOOL_FALSE;
 
 	assert(db);
 	if (!db)
@@ -39,9 +43,24 @@ bool_t kxml_plugin_load_scheme(kdb_t *db, kscheme_t *scheme)
 
 	// Get configuration info from kdb object
 	ini = kdb_ini(db);
-	if (ini)
-		xml_path = faux_ini_find(ini, "XMLPath");
 	error = kdb_error(db);
+	if (ini) {
+		xml_path = faux_ini_find(ini, "XMLPath");
+		// Number of threads to read XML files
+		if ((tmp = faux_ini_find(ini, "LoadThreads")) &&
+			!faux_conv_atoui(tmp, &threads, 10)) {
+			faux_error_sprintf(error,
+				"Illegal LoadThreads value: %s", tmp);
+			return BOOL_FALSE;
+		}
+		// Log durations of load phases
+		if ((tmp = faux_ini_find(ini, "LoadTiming")) &&
+			!faux_conv_str2bool(tmp, &timing)) {
+			faux_error_sprintf(error,
+				"Illegal LoadTiming value: %s", tmp);
+			return BOOL_FALSE;
+		}
+	}
 
-	return kxml_load_scheme(scheme, xml_path, error);
+	return kxml_load_scheme(scheme, xml_path, threads, timing, error);
 }
@@ -0,0 +1,351 @@
+/*
+ * Filters: include, exclude, begin, count, head, tail.
+ *
+ * The filters have stream functions so klishd executes them within its
+ * event loop without fork(). The sym function is used when filter can't
+ * be executed by daemon itself (local execution for example). It reads
+ * stdin and writes to stdout using the same stream functions.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <regex.h>
+
+#include <faux/str.h>
+#include <faux/buf.h>
+#include <faux/conv.h>
+#include <klish/kcontext.h>
+#include <klish/kaction.h>
+#include <klish/ksym.h>
+
+#include "private.h"
+
+
+#define FILTER_DEFAULT_NUM 10
+
+
+typedef enum {
+	FILTER_INCLUDE, // Lines matching the pattern
+	FILTER_EXCLUDE, // Lines not matching the pattern
+	FILTER_BEGIN, // Lines starting with the first matching line
+	FILTER_COUNT, // Number of lines
+	FILTER_HEAD, // First N lines
+	FILTER_TAIL, // Last N lines
+} filter_type_e;
+
+
+typedef struct {
+	char *data;
+	size_t len;
+} filter_line_t;
+
+
+typedef struct {
+	filter_type_e type;
+	bool_t use_regex;
+	regex_t regex;
+	char *pattern; // Fixed string
+	size_t pattern_len;
+	char *scratch; // NUL-terminated line for regexec()
+	size_t scratch_size;
+	bool_t begun; // "begin" has found the first matching line
+	size_t num; // Limit for "head" and "tail"
+	size_t count; // Number of processed lines
+	filter_line_t *tail; // Ring buffer for "tail"
+} filter_t;
+
+
+static const struct {
+	const char *name;
+	filter_type_e type;
+	bool_t need_pattern;
+} filter_types[] = {
+	{"include", FILTER_INCLUDE, BOOL_TRUE},
+	{"exclude", FILTER_EXCLUDE, BOOL_TRUE},
+	{"begin", FILTER_BEGIN, BOOL_TRUE},
+	{"count", FILTER_COUNT, BOOL_FALSE},
+	{"head", FILTER_HEAD, BOOL_FALSE},
+	{"tail", FILTER_TAIL, BOOL_FALSE},
+	{NULL, FILTER_INCLUDE, BOOL_FALSE}
+};
+
+
+// Filter argument is the value of the last parameter
+static const char *filter_arg(kcontext_t *context)
+{
+	kpargv_t *pargv = NULL;
+	kparg_t *parg = NULL;
+
+	pargv = kcontext_pargv(context);
+	if (!pargv)
+		return NULL;
+	parg = kpargv_pargs_last(pargv);
+	if (!parg)
+		return NULL;
+	if (kparg_entry(parg) == kpargv_command(pargv))
+		return NULL;
+
+	return kparg_value(parg);
+}
+
+
+static void filter_free(filter_t *filter)
+{
+	if (!filter)
+		return;
+
+	if (filter->use_regex)
+		regfree(&filter->regex);
+	faux_str_free(filter->pattern);
+	faux_free(filter->scratch);
+	if (filter->tail) {
+		size_t i = 0;
+		for (i = 0; i < filter->num; i++)
+			faux_free(filter->tail[i].data);
+		faux_free(filter->tail);
+	}
+
+	faux_free(filter);
+}
+
+
+// Creates filter state. Pattern is compiled once here. ACTION's script
+// "fixed" means fixed string pattern. Else pattern is POSIX extended
+// regular expression.
+void *klish_filter_init(kcontext_t *context)
+{
+	filter_t *filter = NULL;
+	const char *name = NULL;
+	const char *arg = NULL;
+	const char *script = NULL;
+	size_t i = 0;
+
+	assert(context);
+	if (!context)
+		return NULL;
+
+	name = ksym_name(kaction_sym(kcontext_action(context)));
+	for (i = 0; filter_types[i].name; i++) {
+		if (faux_str_casecmp(name, filter_types[i].name) == 0)
+			break;
+	}
+	if (!filter_types[i].name)
+		return NULL;
+	arg = filter_arg(context);
+	if (filter_types[i].need_pattern && faux_str_is_empty(arg))
+		return NULL;
+
+	filter = faux_zmalloc(sizeof(*filter));
+	assert(filter);
+	if (!filter)
+		return NULL;
+	filter->type = filter_types[i].type;
+	filter->use_regex = BOOL_FALSE;
+	filter->begun = BOOL_FALSE;
+	filter->count = 0;
+	filter->num = FILTER_DEFAULT_NUM;
+
+	switch (filter->type) {
+	case FILTER_INCLUDE:
+	case FILTER_EXCLUDE:
+	case FILTER_BEGIN:
+		script = kcontext_script(context);
+		if (faux_str_casecmp(script, "fixed") == 0) {
+			filter->pattern = faux_str_dup(arg);
+			filter->pattern_len = strlen(arg);
+			break;
+		}
+		if (regcomp(&filter->regex, arg,
+			REG_EXTENDED | REG_NOSUB) != 0) {
+			filter_free(filter);
+			return NULL;
+		}
+		filter->use_regex = BOOL_TRUE;
+		break;
+	case FILTER_HEAD:
+	case FILTER_TAIL:
+		if (!faux_str_is_empty(arg)) {
+			unsigned long int num = 0;
+			if (!faux_conv_atoul(arg, &num, 10)) {
+				filter_free(filter);
+				return NULL;
+			}
+			filter->num = num;
+		}
+		if ((FILTER_TAIL == filter->type) && (filter->num > 0)) {
+			filter->tail = faux_zmalloc(
+				filter->num * sizeof(*filter->tail));
+			assert(filter->tail);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return filter;
+}
+
+
+static bool_t filter_match(filter_t *filter, const char *line, size_t len)
+{
+	// Don't match line feed
+	if ((len > 0) && (line[len - 1] == '\n'))
+		len--;
+
+	if (!filter->use_regex)
+		return memmem(line, len, filter->pattern, filter->pattern_len) ?
+			BOOL_TRUE : BOOL_FALSE;
+
+	if ((len + 1) > filter->scratch_size) {
+		filter->scratch_size = len + 1;
+		filter->scratch = realloc(filter->scratch, filter->scratch_size);
+		assert(filter->scratch);
+	}
+	memcpy(filter->scratch, line, len);
+	filter->scratch[len] = '\0';
+
+	return (regexec(&filter->regex, filter->scratch, 0, NULL, 0) == 0) ?
+		BOOL_TRUE : BOOL_FALSE;
+}
+
+
+bool_t klish_filter_line(void *state, const char *line, size_t len,
+	faux_buf_t *out)
+{
+	filter_t *filter = (filter_t *)state;
+	filter_line_t *slot = NULL;
+
+	assert(filter);
+	if (!filter)
+		return BOOL_FALSE;
+
+	switch (filter->type) {
+	case FILTER_INCLUDE:
+		if (filter_match(filter, line, len))
+			faux_buf_write(out, line, len);
+		break;
+	case FILTER_EXCLUDE:
+		if (!filter_match(filter, line, len))
+			faux_buf_write(out, line, len);
+		break;
+	case FILTER_BEGIN:
+		if (!filter->begun && filter_match(filter, line, len))
+			filter->begun = BOOL_TRUE;
+		if (filter->begun)
+			faux_buf_write(out, line, len);
+		break;
+	case FILTER_COUNT:
+		filter->count++;
+		break;
+	case FILTER_HEAD:
+		if (filter->count >= filter->num)
+			return BOOL_FALSE;
+		faux_buf_write(out, line, len);
+		filter->count++;
+		// Don't wait for the next line
+		if (filter->count >= filter->num)
+			return BOOL_FALSE;
+		break;
+	case FILTER_TAIL:
+		if (0 == filter->num)
+			break;
+		slot = &filter->tail[filter->count % filter->num];
+		slot->data = realloc(slot->data, len ? len : 1);
+		assert(slot->data);
+		memcpy(slot->data, line, len);
+		slot->len = len;
+		filter->count++;
+		break;
+	default:
+		break;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+int klish_filter_fini(void *state, faux_buf_t *out)
+{
+	filter_t *filter = (filter_t *)state;
+
+	if (!filter)
+		return -1;
+	if (!out) { // Aborted
+		filter_free(filter);
+		return 0;
+	}
+
+	if (FILTER_COUNT == filter->type) {
+		char *str = faux_str_sprintf("%zu\n", filter->count);
+		faux_buf_write(out, str, strlen(str));
+		faux_str_free(str);
+
+	} else if ((FILTER_TAIL == filter->type) && (filter->num > 0)) {
+		size_t i = 0;
+		size_t start = 0;
+		size_t num = filter->num;
+		if (filter->count < filter->num) {
+			num = filter->count;
+		} else {
+			start = filter->count % filter->num;
+		}
+		for (i = 0; i < num; i++) {
+			filter_line_t *slot =
+				&filter->tail[(start + i) % filter->num];
+			faux_buf_write(out, slot->data, slot->len);
+		}
+	}
+
+	filter_free(filter);
+
+	return 0;
+}
+
+
+static void filter_flush(faux_buf_t *out)
+{
+	void *data = NULL;
+	ssize_t len = 0;
+
+	while ((len = faux_buf_dread_lock_easy(out, &data)) > 0) {
+		fwrite(data, 1, len, stdout);
+		faux_buf_dread_unlock_easy(out, len);
+	}
+}
+
+
+// Sym function for forked execution
+int klish_filter(kcontext_t *context)
+{
+	void *state = NULL;
+	faux_buf_t *out = NULL;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len = 0;
+	int retcode = 0;
+
+	state = klish_filter_init(context);
+	if (!state) {
+		fprintf(stderr, "Error: Illegal filter argument\n");
+		return -1;
+	}
+
+	out = faux_buf_new(0);
+	while ((len = getline(&line, &size, stdin)) > 0) {
+		bool_t more = klish_filter_line(state, line, len, out);
+		filter_flush(out);
+		if (!more)
+			break;
+	}
+	free(line);
+	retcode = klish_filter_fini(state, out);
+	filter_flush(out);
+	faux_buf_free(out);
+	fflush(stdout);
+
+	return retcode;
+}
@@ -34,12 +34,12 @@ int klish_tsym(kcontext_t *context)
 
 	script = kcontext_script(context);
 	if (faux_str_is_empty(script)) {
-		printf("[<empty>]\n");
-		fprintf(stderr, "Empty item\n");
+		kcontext_printf(context, "[<empty>]\n");
+		kcontext_printf_err(context, "Empty item\n");
 		return -1;
 	}
 
-	printf("[%s]\n", script);
+	kcontext_printf(context, "[%s]\n", script);
 
 	return 0;
 }
@@ -54,7 +54,7 @@ int klish_printl(kcontext_t *context)
 	if (faux_str_is_empty(script))
 		script = "";
 
-	printf("%s\n", script);
+	kcontext_printf(context, "%s\n", script);
 
 	return 0;
 }
@@ -69,8 +69,7 @@ int klish_print(kcontext_t *context)
 	if (faux_str_is_empty(script))
 		script = "";
 
-	printf("%s", script);
-	fflush(stdout);
+	kcontext_printf(context, "%s", script);
 
 	return 0;
 }
@@ -86,9 +85,40 @@ int klish_pwd(kcontext_t *context)
 	path = ksession_path(kcontext_session(context));
 	iter = kpath_iter(path);
 	while ((level = kpath_each(&iter))) {
-		printf("/%s", kentry_name(klevel_entry(level)));
+		kcontext_printf(context, "/%s",
+			kentry_name(klevel_entry(level)));
+	}
+	kcontext_printf(context, "\n");
+
+	return 0;
+}
+
+
+// Drop cached PTYPE validation results. Use it within ACTION sequence
+// after the command that changes data PTYPEs depend on.
+int klish_cache_invalidate(kcontext_t *context)
+{
+	ksession_cache_invalidate(kcontext_session(context));
+
+	return 0;
+}
+
+
+// Show execution statistics of completion/help ENTRYs within current
+// session. Columns: owner entry, runs, runs killed by timeout, max time (ms).
+int klish_completion_stats(kcontext_t *context)
+{
+	ksession_stats_node_t *iter = NULL;
+	ksession_stat_t *stat = NULL;
+
+	iter = ksession_stats_iter(kcontext_session(context));
+	while ((stat = ksession_stats_each(&iter))) {
+		const kentry_t *parent = kentry_parent(stat->entry);
+		kcontext_printf(context, "%-20s %-8s %6zu %6zu %6u\n",
+			parent ? kentry_name(parent) : "",
+			kentry_name(stat->entry),
+			stat->runs, stat->timeouts, stat->max_time);
 	}
-	printf("\n");
 
 	return 0;
 }
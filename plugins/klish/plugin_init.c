@@ -20,6 +20,11 @@ const uint8_t kplugin_klish_minor = KPLUGIN_MINOR;
 int kplugin_klish_init(kcontext_t *context)
 {
 	kplugin_t *plugin = NULL;
+	ksym_t *sym = NULL;
+	kplugin_syms_node_t *iter = NULL;
+	const char *filters[] = {"include", "exclude", "begin",
+		"count", "head", "tail", NULL};
+	size_t i = 0;
 
 	assert(context);
 	plugin = kcontext_plugin(context);
@@ -35,6 +40,12 @@ int kplugin_klish_init(kcontext_t *context)
 		KSYM_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
 	kplugin_add_syms(plugin, ksym_new_ext("prompt", klish_prompt,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_SILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("cache_invalidate",
+		klish_cache_invalidate,
+		KSYM_PERMANENT, KSYM_SYNC, KSYM_SILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("completion_stats",
+		klish_completion_stats,
+		KSYM_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
 
 	// Log
 	kplugin_add_syms(plugin, ksym_new_ext("syslog", klish_syslog,
@@ -46,23 +57,45 @@ int kplugin_klish_init(kcontext_t *context)
 	kplugin_add_syms(plugin, ksym_new_ext("nav", klish_nav,
 		KSYM_PERMANENT, KSYM_SYNC, KSYM_SILENT));
 
+	// Filters
+	// Filters are executed by klishd itself without fork() if possible.
+	// Else sym function reads stdin within forked process.
+	for (i = 0; filters[i]; i++) {
+		sym = ksym_new_ext(filters[i], klish_filter,
+			KSYM_PERMANENT, KSYM_UNSYNC, KSYM_NONSILENT);
+		ksym_set_stream(sym, klish_filter_init, klish_filter_line,
+			klish_filter_fini);
+		kplugin_add_syms(plugin, sym);
+	}
+
 	// PTYPEs
 	// These PTYPEs are simple and fast so set SYNC flag
 	kplugin_add_syms(plugin, ksym_new_ext("COMMAND", klish_ptype_COMMAND,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_SILENT));
 	kplugin_add_syms(plugin, ksym_new_ext("completion_COMMAND", klish_completion_COMMAND,
-		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
-	kplugin_add_syms(plugin, ksym_new_ext("help_COMMAND", klish_help_COMMAND,
-		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_NONSILENT));
-	kplugin_add_syms(plugin, ksym_new_ext("COMMAND_CASE", klish_ptype_COMMAND_CASE,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_SILENT));
-	kplugin_add_syms(plugin, ksym_new_ext("INT", klish_ptype_INT,
+	kplugin_add_syms(plugin, ksym_new_ext("help_COMMAND", klish_help_COMMAND,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_SILENT));
-	kplugin_add_syms(plugin, ksym_new_ext("UINT", klish_ptype_UINT,
+	kplugin_add_syms(plugin, ksym_new_ext("COMMAND_CASE", klish_ptype_COMMAND_CASE,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_SILENT));
+	sym = ksym_new_ext("INT", klish_ptype_INT,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_SILENT);
+	ksym_set_compile(sym, klish_ptype_INT_compile, faux_free);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_ext("UINT", klish_ptype_UINT,
+		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_SILENT);
+	ksym_set_compile(sym, klish_ptype_UINT_compile, faux_free);
+	kplugin_add_syms(plugin, sym);
 	kplugin_add_syms(plugin, ksym_new_ext("STRING", klish_ptype_STRING,
 		KSYM_USERDEFINED_PERMANENT, KSYM_SYNC, KSYM_SILENT));
 
+	// Sync syms use context and session state only and write output by
+	// kcontext_printf(). Filters' stream functions use own state. So
+	// threads don't need to serialize them.
+	iter = kplugin_syms_iter(plugin);
+	while ((sym = kplugin_syms_each(&iter)))
+		ksym_set_thread_safe(sym, BOOL_TRUE);
+
 	return 0;
 }
 
@@ -6,6 +6,7 @@
 #define _plugins_klish_h
 
 #include <faux/faux.h>
+#include <faux/buf.h>
 #include <klish/kcontext_base.h>
 
 
@@ -18,6 +19,8 @@ int klish_print(kcontext_t *context);
 int klish_printl(kcontext_t *context);
 int klish_pwd(kcontext_t *context);
 int klish_prompt(kcontext_t *context);
+int klish_cache_invalidate(kcontext_t *context);
+int klish_completion_stats(kcontext_t *context);
 
 // Log
 int klish_syslog(kcontext_t *context);
@@ -25,6 +28,13 @@ int klish_syslog(kcontext_t *context);
 // Navigation
 int klish_nav(kcontext_t *context);
 
+// Filters
+int klish_filter(kcontext_t *context);
+void *klish_filter_init(kcontext_t *context);
+bool_t klish_filter_line(void *state, const char *line, size_t len,
+	faux_buf_t *out);
+int klish_filter_fini(void *state, faux_buf_t *out);
+
 // PTYPEs
 int klish_ptype_COMMAND(kcontext_t *context);
 int klish_completion_COMMAND(kcontext_t *context);
@@ -33,8 +43,10 @@ int klish_help_COMMAND(kcontext_t *context);
 int klish_ptype_COMMAND_CASE(kcontext_t *context);
 
 int klish_ptype_INT(kcontext_t *context);
+void *klish_ptype_INT_compile(const char *script);
 
 int klish_ptype_UINT(kcontext_t *context);
+void *klish_ptype_UINT_compile(const char *script);
 
 int klish_ptype_STRING(kcontext_t *context);
 
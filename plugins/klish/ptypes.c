@@ -61,7 +61,7 @@ int klish_completion_COMMAND(kcontext_t *context)
 	if (!command_name)
 		return 0;
 
-	printf("%s\n", command_name);
+	kcontext_add_completion(context, command_name, NULL);
 
 	return 0;
 }
@@ -97,7 +97,7 @@ int klish_help_COMMAND(kcontext_t *context)
 		help_text = kentry_name(entry);
 	assert(help_text);
 
-	printf("%s\n%s\n", command_name, help_text);
+	kcontext_add_completion(context, command_name, help_text);
 
 	return 0;
 }
@@ -124,6 +124,102 @@ int klish_ptype_COMMAND_CASE(kcontext_t *context)
 }
 
 
+// Range bound of INT or UINT PTYPE
+typedef union {
+	long long int i;
+	unsigned long long int u;
+} klish_range_value_t;
+
+
+// Precompiled range of INT or UINT PTYPE
+typedef struct {
+	bool_t broken; // Range is specified but can't be converted
+	bool_t min_set;
+	klish_range_value_t min;
+	bool_t max_set;
+	klish_range_value_t max;
+} klish_range_t;
+
+
+static bool_t klish_range_conv(const char *str, bool_t is_signed,
+	klish_range_value_t *val)
+{
+	if (is_signed)
+		return faux_conv_atoll(str, &val->i, 0);
+
+	return faux_conv_atoull(str, &val->u, 0);
+}
+
+
+static void klish_range_parse(const char *script, bool_t is_signed,
+	klish_range_t *range)
+{
+	faux_argv_t *argv = NULL;
+	const char *str = NULL;
+
+	faux_bzero(range, sizeof(*range));
+	if (faux_str_is_empty(script))
+		return;
+
+	argv = faux_argv_new();
+	faux_argv_parse(argv, script);
+
+	// Min
+	str = faux_argv_index(argv, 0);
+	if (str) {
+		range->min_set = BOOL_TRUE;
+		if (!klish_range_conv(str, is_signed, &range->min))
+			range->broken = BOOL_TRUE;
+	}
+
+	// Max
+	str = faux_argv_index(argv, 1);
+	if (str) {
+		range->max_set = BOOL_TRUE;
+		if (!klish_range_conv(str, is_signed, &range->max))
+			range->broken = BOOL_TRUE;
+	}
+
+	faux_argv_free(argv);
+}
+
+
+static klish_range_t *klish_range_compile(const char *script, bool_t is_signed)
+{
+	klish_range_t *range = NULL;
+
+	range = faux_zmalloc(sizeof(*range));
+	assert(range);
+	klish_range_parse(script, is_signed, range);
+
+	return range;
+}
+
+
+// Range is usually precompiled while scheme preparing. Else it's parsed to
+// local storage.
+static const klish_range_t *klish_range(kcontext_t *context, bool_t is_signed,
+	klish_range_t *local_range)
+{
+	const klish_range_t *range = NULL;
+
+	range = (const klish_range_t *)kcontext_compiled(context);
+	if (range)
+		return range;
+	klish_range_parse(kcontext_script(context), is_signed, local_range);
+
+	return local_range;
+}
+
+
+/** @brief Compile function for INT PTYPE. Parses range once.
+ */
+void *klish_ptype_INT_compile(const char *script)
+{
+	return klish_range_compile(script, BOOL_TRUE);
+}
+
+
 /** @brief PTYPE: Signed int with optional range
  *
  * Use long long int for conversion from text.
@@ -133,49 +229,36 @@ int klish_ptype_COMMAND_CASE(kcontext_t *context)
  */
 int klish_ptype_INT(kcontext_t *context)
 {
-	const char *script = NULL;
+	const klish_range_t *range = NULL;
+	klish_range_t local_range = {};
 	const char *value_str = NULL;
 	long long int value = 0;
 
-	script = kcontext_script(context);
 	value_str = kcontext_candidate_value(context);
 
 	if (!faux_conv_atoll(value_str, &value, 0))
 		return -1;
 
-	// Range is specified
-	if (!faux_str_is_empty(script)) {
-		faux_argv_t *argv = faux_argv_new();
-		const char *str = NULL;
-		faux_argv_parse(argv, script);
-
-		// Min
-		str = faux_argv_index(argv, 0);
-		if (str) {
-			long long int min = 0;
-			if (!faux_conv_atoll(str, &min, 0) || (value < min)) {
-				faux_argv_free(argv);
-				return -1;
-			}
-		}
-
-		// Max
-		str = faux_argv_index(argv, 1);
-		if (str) {
-			long long int max = 0;
-			if (!faux_conv_atoll(str, &max, 0) || (value > max)) {
-				faux_argv_free(argv);
-				return -1;
-			}
-		}
-
-		faux_argv_free(argv);
-	}
+	range = klish_range(context, BOOL_TRUE, &local_range);
+	if (range->broken)
+		return -1;
+	if (range->min_set && (value < range->min.i))
+		return -1;
+	if (range->max_set && (value > range->max.i))
+		return -1;
 
 	return 0;
 }
 
 
+/** @brief Compile function for UINT PTYPE. Parses range once.
+ */
+void *klish_ptype_UINT_compile(const char *script)
+{
+	return klish_range_compile(script, BOOL_FALSE);
+}
+
+
 /** @brief PTYPE: Unsigned int with optional range
  *
  * Use unsigned long long int for conversion from text.
@@ -185,44 +268,23 @@ int klish_ptype_INT(kcontext_t *context)
  */
 int klish_ptype_UINT(kcontext_t *context)
 {
-	const char *script = NULL;
+	const klish_range_t *range = NULL;
+	klish_range_t local_range = {};
 	const char *value_str = NULL;
 	unsigned long long int value = 0;
 
-	script = kcontext_script(context);
 	value_str = kcontext_candidate_value(context);
 
 	if (!faux_conv_atoull(value_str, &value, 0))
 		return -1;
 
-	// Range is specified
-	if (!faux_str_is_empty(script)) {
-		faux_argv_t *argv = faux_argv_new();
-		const char *str = NULL;
-		faux_argv_parse(argv, script);
-
-		// Min
-		str = faux_argv_index(argv, 0);
-		if (str) {
-			unsigned long long int min = 0;
-			if (!faux_conv_atoull(str, &min, 0) || (value < min)) {
-				faux_argv_free(argv);
-				return -1;
-			}
-		}
-
-		// Max
-		str = faux_argv_index(argv, 1);
-		if (str) {
-			unsigned long long int max = 0;
-			if (!faux_conv_atoull(str, &max, 0) || (value > max)) {
-				faux_argv_free(argv);
-				return -1;
-			}
-		}
-
-		faux_argv_free(argv);
-	}
+	range = klish_range(context, BOOL_FALSE, &local_range);
+	if (range->broken)
+		return -1;
+	if (range->min_set && (value < range->min.u))
+		return -1;
+	if (range->max_set && (value > range->max.u))
+		return -1;
 
 	return 0;
 }
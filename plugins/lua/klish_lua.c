@@ -36,6 +36,9 @@ struct lua_klish_data {
 	int backtrace_sw; // show traceback
 };
 
+// Lua state for signal handler. Lua sym is not thread-safe so it's
+// serialized by kplugin_lock() and threaded klishd doesn't execute two
+// actions at once.
 static lua_State *globalL = NULL;
 
 static int luaB_par(lua_State *L);
@@ -288,7 +291,6 @@ static int _luaB_par(lua_State *L, int parent, int multi)
 	const kpargv_t *pars;
 	kpargv_pargs_node_t *par_i;
 	kparg_t *p = NULL;
-	const kentry_t *last_entry = NULL;
 	struct lua_klish_data *ctx;
 	const char *name = luaL_optstring(L, 1, NULL);
 
@@ -310,29 +312,36 @@ static int _luaB_par(lua_State *L, int parent, int multi)
 	if (kpargv_pargs_len(pars) <= 0)
 		return multi?1:0;
 
-	while ((p = kpargv_pargs_each(&par_i))) {
-		const kentry_t *entry = kparg_entry(p);
-		const char *n = kentry_name(entry);
-		if (!name) {
-			if (last_entry != entry) {
-				if (!kentry_container(entry)) {
-					lua_pushnumber(L, ++k);
-					lua_pushstring(L, n);
-					lua_rawset(L, -3);
-				}
+	// All parameters. Values are grouped by entry.
+	if (!name) {
+		kpargv_group_t *groups = NULL;
+		ssize_t groups_num = kpargv_groups(pars, &groups);
+		ssize_t g = 0;
+		for (g = 0; g < groups_num; g++) {
+			const kentry_t *entry = groups[g].entry;
+			const char *n = kentry_name(entry);
+			if (!kentry_container(entry)) {
+				lua_pushnumber(L, ++k);
 				lua_pushstring(L, n);
-				lua_newtable(L);
 				lua_rawset(L, -3);
-				i = 0;
 			}
 			lua_pushstring(L, n);
-			lua_rawget(L, -2);
-			lua_pushnumber(L, ++ i);
-			lua_pushstring(L, kparg_value(p));
+			lua_newtable(L);
+			for (i = 0; i < groups[g].num; i++) {
+				lua_pushnumber(L, i + 1);
+				lua_pushstring(L, groups[g].values[i]);
+				lua_rawset(L, -3);
+			}
 			lua_rawset(L, -3);
-			lua_pop(L, 1);
-			last_entry = entry;
-		} else if (!strcmp(n, name)) {
+		}
+		faux_free(groups);
+		return 1;
+	}
+
+	while ((p = kpargv_pargs_each(&par_i))) {
+		const kentry_t *entry = kparg_entry(p);
+		const char *n = kentry_name(entry);
+		if (!strcmp(n, name)) {
 			if (!multi) {
 				lua_pushstring(L, kparg_value(p));
 				return 1;
@@ -0,0 +1,230 @@
+/*
+ * Environment for the script interpreter.
+ *
+ * Variables are collected into array without copying strings. Parameters
+ * are grouped by entry in a single pass. Then envp is built as a single
+ * memory block. The klishd's own environ is never changed.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include <faux/str.h>
+#include <klish/kcontext.h>
+#include <klish/ksession.h>
+
+#include "private.h"
+
+
+#define PREFIX "KLISH_"
+
+extern char **environ;
+
+
+const char *kcontext_type_e_str[] = {
+	"none",
+	"plugin_init",
+	"plugin_fini",
+	"action",
+	"service_action"
+	};
+
+
+void script_env_add(script_env_t *env, const char *prefix, const char *name,
+	ssize_t index, const char *value)
+{
+	script_env_var_t *var = NULL;
+
+	if (env->num >= env->size) {
+		env->size = env->size ? (env->size * 2) : 64;
+		env->vars = realloc(env->vars, env->size * sizeof(*env->vars));
+		assert(env->vars);
+	}
+	var = &env->vars[env->num++];
+	var->prefix = prefix;
+	var->name = name;
+	var->index = index;
+	var->value = value;
+}
+
+
+static bool_t populate_env_kpargv(script_env_t *env, const kpargv_t *pargv,
+	const char *prefix, const char *param_prefix)
+{
+	const kentry_t *cmd = NULL;
+	kpargv_group_t *groups = NULL;
+	ssize_t groups_num = 0;
+	ssize_t i = 0;
+
+	if (!pargv)
+		return BOOL_FALSE;
+
+	// Command
+	cmd = kpargv_command(pargv);
+	if (cmd)
+		script_env_add(env, prefix, "COMMAND", -1, kentry_name(cmd));
+
+	// Parameters. First value is available without index too.
+	groups_num = kpargv_groups(pargv, &groups);
+	for (i = 0; i < groups_num; i++) {
+		const char *name = kentry_name(groups[i].entry);
+		ssize_t num = 0;
+		size_t j = 0;
+		for (j = 0; j < groups[i].num; j++) {
+			const char *value = groups[i].values[j];
+			if (!value) // PTYPE can contain parg with NULL value
+				continue;
+			if (0 == num)
+				script_env_add(env, param_prefix, name, -1, value);
+			script_env_add(env, param_prefix, name, num, value);
+			num++;
+		}
+	}
+	faux_free(groups);
+
+	return BOOL_TRUE;
+}
+
+
+// Klish variables only
+bool_t script_env_populate(script_env_t *env, kcontext_t *context)
+{
+	kcontext_type_e type = KCONTEXT_TYPE_NONE;
+	const kentry_t *entry = NULL;
+	const ksession_t *session = NULL;
+	const char *str = NULL;
+	pid_t pid = -1;
+	uid_t uid = -1;
+
+	assert(context);
+	session = kcontext_session(context);
+	assert(session);
+
+	// Type
+	type = kcontext_type(context);
+	if (type >= KCONTEXT_TYPE_MAX)
+		type = KCONTEXT_TYPE_NONE;
+	script_env_add(env, PREFIX, "TYPE", -1, kcontext_type_e_str[type]);
+
+	// Candidate
+	entry = kcontext_candidate_entry(context);
+	if (entry)
+		script_env_add(env, PREFIX, "CANDIDATE", -1, kentry_name(entry));
+
+	// Value
+	str = kcontext_candidate_value(context);
+	if (str)
+		script_env_add(env, PREFIX, "VALUE", -1, str);
+
+	// PID
+	pid = ksession_pid(session);
+	if (pid != -1) {
+		snprintf(env->pid, sizeof(env->pid), "%lld", (long long int)pid);
+		script_env_add(env, PREFIX, "PID", -1, env->pid);
+	}
+
+	// UID
+	uid = ksession_uid(session);
+	if (uid != -1) {
+		snprintf(env->uid, sizeof(env->uid), "%lld", (long long int)uid);
+		script_env_add(env, PREFIX, "UID", -1, env->uid);
+	}
+
+	// User
+	str = ksession_user(session);
+	if (str)
+		script_env_add(env, PREFIX, "USER", -1, str);
+
+	// Parameters
+	populate_env_kpargv(env, kcontext_pargv(context),
+		PREFIX, PREFIX"PARAM_");
+
+	// Parent parameters
+	populate_env_kpargv(env, kcontext_parent_pargv(context),
+		PREFIX"PARENT_", PREFIX"PARENT_PARAM_");
+
+	return BOOL_TRUE;
+}
+
+
+// Inherited environment. Klish variables are always set by ACTION.
+void script_env_inherit(script_env_t *env)
+{
+	char **e = NULL;
+
+	for (e = environ; e && *e; e++) {
+		if (strncmp(*e, PREFIX, strlen(PREFIX)) == 0)
+			continue;
+		script_env_add(env, *e, NULL, -1, NULL);
+	}
+}
+
+
+/** @brief Builds envp.
+ *
+ * Pointers and strings are placed within single memory block. Raw
+ * variables are not copied. The envp is valid until script_env_free().
+ */
+char **script_env_build(script_env_t *env)
+{
+	size_t len = 0;
+	size_t i = 0;
+	char *p = NULL;
+	char index[24] = {};
+
+	faux_free(env->envp);
+
+	len = (env->num + 1) * sizeof(*env->envp);
+	for (i = 0; i < env->num; i++) {
+		script_env_var_t *var = &env->vars[i];
+		if (!var->value)
+			continue;
+		len += strlen(var->prefix) + strlen(var->name) +
+			strlen(var->value) + 2; // '=' and '\0'
+		if (var->index >= 0)
+			len += snprintf(index, sizeof(index), "_%zd",
+				var->index);
+	}
+
+	env->envp = faux_zmalloc(len);
+	assert(env->envp);
+	p = (char *)(env->envp + env->num + 1);
+	for (i = 0; i < env->num; i++) {
+		script_env_var_t *var = &env->vars[i];
+		size_t l = 0;
+		if (!var->value) {
+			env->envp[i] = (char *)var->prefix;
+			continue;
+		}
+		env->envp[i] = p;
+		l = strlen(var->prefix);
+		memcpy(p, var->prefix, l);
+		p += l;
+		l = strlen(var->name);
+		memcpy(p, var->name, l);
+		p += l;
+		if (var->index >= 0)
+			p += sprintf(p, "_%zd", var->index);
+		*p++ = '=';
+		l = strlen(var->value);
+		memcpy(p, var->value, l + 1);
+		p += l + 1;
+	}
+	env->envp[env->num] = NULL;
+
+	return env->envp;
+}
+
+
+void script_env_free(script_env_t *env)
+{
+	faux_free(env->vars);
+	faux_free(env->envp);
+	env->vars = NULL;
+	env->envp = NULL;
+	env->num = 0;
+	env->size = 0;
+}
@@ -7,12 +7,22 @@
 #include <assert.h>
 
 #include <faux/faux.h>
+#include <faux/ini.h>
+#include <faux/conv.h>
 #include <klish/kplugin.h>
 #include <klish/kcontext.h>
 
 #include "private.h"
 
 
+// Plugin's config options
+#define SCRIPT_SHELL "Shell"
+#define SCRIPT_SHELL_TIMEOUT "ShellTimeout"
+
+#define SCRIPT_DEFAULT_SHELL "/bin/sh"
+#define SCRIPT_DEFAULT_SHELL_TIMEOUT 60 // Seconds
+
+
 const uint8_t kplugin_script_major = KPLUGIN_MAJOR;
 const uint8_t kplugin_script_minor = KPLUGIN_MINOR;
 
@@ -20,12 +30,52 @@ const uint8_t kplugin_script_minor = KPLUGIN_MINOR;
 int kplugin_script_init(kcontext_t *context)
 {
 	kplugin_t *plugin = NULL;
+	const char *conf = NULL;
+	const char *shell = SCRIPT_DEFAULT_SHELL;
+	unsigned int timeout = SCRIPT_DEFAULT_SHELL_TIMEOUT;
+	faux_ini_t *ini = NULL;
+	script_shell_conf_t *shell_conf = NULL;
+	ksym_t *sym = NULL;
 
 	assert(context);
 	plugin = kcontext_plugin(context);
 	assert(plugin);
 
-	kplugin_add_syms(plugin, ksym_new("script", script_script));
+	conf = kplugin_conf(plugin);
+	if (conf) {
+		const char *p = NULL;
+		ini = faux_ini_new();
+		faux_ini_parse_str(ini, conf);
+		p = faux_ini_find(ini, SCRIPT_SHELL);
+		if (p)
+			shell = p;
+		p = faux_ini_find(ini, SCRIPT_SHELL_TIMEOUT);
+		if (p && !faux_conv_atoui(p, &timeout, 0)) {
+			fprintf(stderr, "Error: Illegal %s value\n",
+				SCRIPT_SHELL_TIMEOUT);
+			faux_ini_free(ini);
+			return -1;
+		}
+	}
+	// Shell coprocess will be started by the first "shell" ACTION of
+	// the session
+	shell_conf = script_shell_conf_new(shell, timeout);
+	faux_ini_free(ini);
+	kplugin_set_udata(plugin, shell_conf);
+
+	// Script writes to context's output and its interpreter gets own
+	// environment so it's thread-safe
+	sym = ksym_new("script", script_script);
+	ksym_set_thread_safe(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
+	// Shell is executed as a job within session's event loop
+	sym = ksym_new_ext("shell", script_shell,
+		KSYM_USERDEFINED_PERMANENT, KSYM_UNSYNC, KSYM_NONSILENT);
+	ksym_set_job(sym, script_shell_job_init, script_shell_job_poll,
+		script_shell_job_event, script_shell_job_fini);
+	// Shell is session's udata
+	ksym_set_thread_safe(sym, BOOL_TRUE);
+	kplugin_add_syms(plugin, sym);
 
 	return 0;
 }
@@ -33,8 +83,13 @@ int kplugin_script_init(kcontext_t *context)
 
 int kplugin_script_fini(kcontext_t *context)
 {
-//	fprintf(stderr, "Plugin 'script' fini\n");
-	context = context;
+	kplugin_t *plugin = NULL;
+
+	assert(context);
+	plugin = kcontext_plugin(context);
+	assert(plugin);
+
+	script_shell_conf_free((script_shell_conf_t *)kplugin_udata(plugin));
 
 	return 0;
 }
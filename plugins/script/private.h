@@ -5,14 +5,65 @@
 #ifndef _plugins_script_h
 #define _plugins_script_h
 
+#include <poll.h>
+
 #include <faux/faux.h>
+#include <faux/buf.h>
 #include <klish/kcontext_base.h>
 
 
+// Variable of environment for the interpreter. Variable's name is a
+// concatenation of prefix, name and optional "_<index>". Raw variable is a
+// ready "name=value" string. Strings are not copied.
+typedef struct {
+	const char *prefix;
+	const char *name;
+	ssize_t index; // -1 - no index
+	const char *value; // NULL for raw variable
+} script_env_var_t;
+
+// Environment for the interpreter. Variables are collected first and
+// then envp is built as a single memory block.
+typedef struct {
+	script_env_var_t *vars;
+	size_t num;
+	size_t size;
+	char **envp;
+	char pid[24]; // Storage for numeric values
+	char uid[24];
+} script_env_t;
+
+// Persistent shell coprocess. It's a session's udata.
+typedef struct script_shell_s script_shell_t;
+
+// Shell settings from plugin's config. It's a plugin's udata.
+typedef struct {
+	char *shell; // Interpreter
+	unsigned int timeout; // Script timeout (seconds). 0 - unlimited
+} script_shell_conf_t;
+
+
 C_DECL_BEGIN
 
+void script_env_add(script_env_t *env, const char *prefix, const char *name,
+	ssize_t index, const char *value);
+bool_t script_env_populate(script_env_t *env, kcontext_t *context);
+void script_env_inherit(script_env_t *env);
+char **script_env_build(script_env_t *env);
+void script_env_free(script_env_t *env);
+
 int script_script(kcontext_t *context);
 
+script_shell_conf_t *script_shell_conf_new(const char *shell,
+	unsigned int timeout);
+void script_shell_conf_free(script_shell_conf_t *conf);
+int script_shell(kcontext_t *context);
+void *script_shell_job_init(kcontext_t *context);
+size_t script_shell_job_poll(void *state, struct pollfd *fds, size_t max);
+void script_shell_job_event(void *state, const struct pollfd *fds,
+	size_t num, faux_buf_t *out, faux_buf_t *err);
+int script_shell_job_fini(void *state, faux_buf_t *out, faux_buf_t *err);
+
 C_DECL_END
 
 
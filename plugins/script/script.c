@@ -1,7 +1,11 @@
 /*
- *
+ * The script is executed by interpreter directly. Script body is passed
+ * within memfd (or unlinked temporary file) by /proc/self/fd/3 path.
+ * Short shell scripts are passed by "-c" argument. Environment is built
+ * as explicit envp array so klishd's environ is not changed.
  */
 
+#define _GNU_SOURCE
 #include <assert.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -14,168 +18,27 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <syslog.h>
+#include <spawn.h>
+#include <sys/mman.h>
 
 #include <faux/str.h>
-#include <faux/list.h>
+#include <faux/argv.h>
 #include <klish/kcontext.h>
-#include <klish/ksession.h>
 
+#include "private.h"
 
-static char *script_mkfifo(void)
-{
-	char *name = NULL;
-
-	name = faux_str_sprintf("/tmp/klish.fifo.%u.XXXXXX", getpid());
-	mktemp(name);
-	if (mkfifo(name, 0600) < 0) {
-		faux_str_free(name);
-		return NULL;
-	}
-
-	return name;
-}
-
-
-const char *kcontext_type_e_str[] = {
-	"none",
-	"plugin_init",
-	"plugin_fini",
-	"action",
-	"service_action"
-	};
-
-#define PREFIX "KLISH_"
-#define OVERWRITE 1
-
-
-static bool_t populate_env_kpargv(const kpargv_t *pargv, const char *prefix)
-{
-	const kentry_t *cmd = NULL;
-	faux_list_node_t *iter = NULL;
-	faux_list_node_t *cur = NULL;
-
-	if (!pargv)
-		return BOOL_FALSE;
-
-	// Command
-	cmd = kpargv_command(pargv);
-	if (cmd) {
-		char *var = faux_str_sprintf("%sCOMMAND", prefix);
-		setenv(var, kentry_name(cmd), OVERWRITE);
-		faux_str_free(var);
-	}
-
-	// Parameters
-	iter = faux_list_head(kpargv_pargs(pargv));
-	while ((cur = faux_list_each_node(&iter))) {
-		kparg_t *parg = (kparg_t *)faux_list_data(cur);
-		kparg_t *tmp_parg = NULL;
-		const kentry_t *entry = kparg_entry(parg);
-		faux_list_node_t *iter_before = faux_list_prev_node(cur);
-		faux_list_node_t *iter_after = cur;
-		unsigned int num = 0;
-		bool_t already_populated = BOOL_FALSE;
-
-		if (!kparg_value(parg)) // PTYPE can contain parg with NULL value
-			continue;
-
-		// Search for such entry within arguments before current one
-		while ((tmp_parg = (kparg_t *)faux_list_eachr(&iter_before))) {
-			if (kparg_entry(tmp_parg) == entry) {
-				already_populated = BOOL_TRUE;
-				break;
-			}
-		}
-		if (already_populated)
-			continue;
-
-		// Populate all next args with the current entry
-		while ((tmp_parg = (kparg_t *)faux_list_each(&iter_after))) {
-			char *var = NULL;
-			const char *value = kparg_value(tmp_parg);
-			if (kparg_entry(tmp_parg) != entry)
-				continue;
-			if (num == 0) {
-				var = faux_str_sprintf("%sPARAM_%s",
-					prefix, kentry_name(entry));
-				setenv(var, value, OVERWRITE);
-				faux_str_free(var);
-			}
-			var = faux_str_sprintf("%sPARAM_%s_%u",
-				prefix, kentry_name(entry), num);
-			setenv(var, value, OVERWRITE);
-			faux_str_free(var);
-			num++;
-		}
-	}
-
-	return BOOL_TRUE;
-}
-
-
-static bool_t populate_env(kcontext_t *context)
-{
-	kcontext_type_e type = KCONTEXT_TYPE_NONE;
-	const kentry_t *entry = NULL;
-	const ksession_t *session = NULL;
-	const char *str = NULL;
-	pid_t pid = -1;
-	uid_t uid = -1;
-
-	assert(context);
-	session = kcontext_session(context);
-	assert(session);
-
-	// Type
-	type = kcontext_type(context);
-	if (type >= KCONTEXT_TYPE_MAX)
-		type = KCONTEXT_TYPE_NONE;
-	setenv(PREFIX"TYPE", kcontext_type_e_str[type], OVERWRITE);
-
-	// Candidate
-	entry = kcontext_candidate_entry(context);
-	if (entry)
-		setenv(PREFIX"CANDIDATE", kentry_name(entry), OVERWRITE);
-
-	// Value
-	str = kcontext_candidate_value(context);
-	if (str)
-		setenv(PREFIX"VALUE", str, OVERWRITE);
-
-	// PID
-	pid = ksession_pid(session);
-	if (pid != -1) {
-		char *t = faux_str_sprintf("%lld", (long long int)pid);
-		setenv(PREFIX"PID", t, OVERWRITE);
-		faux_str_free(t);
-	}
 
-	// UID
-	uid = ksession_uid(session);
-	if (uid != -1) {
-		char *t = faux_str_sprintf("%lld", (long long int)uid);
-		setenv(PREFIX"UID", t, OVERWRITE);
-		faux_str_free(t);
-	}
-
-	// User
-	str = ksession_user(session);
-	if (str)
-		setenv(PREFIX"USER", str, OVERWRITE);
-
-	// Parameters
-	populate_env_kpargv(kcontext_pargv(context), PREFIX);
-
-	// Parent parameters
-	populate_env_kpargv(kcontext_parent_pargv(context), PREFIX"PARENT_");
-
-	return BOOL_TRUE;
-}
+#define DEFAULT_SHEBANG "/bin/sh"
+// Max length of script to pass by "-c" option
+#define SCRIPT_ARG_MAX 4096
+// Interpreter gets script body by this descriptor
+#define SCRIPT_BODY_FD 3
+#define SCRIPT_BODY_PATH "/proc/self/fd/3"
 
 
 static char *find_out_shebang(const char *script)
 {
-	char *default_shebang = "/bin/sh";
+	char *default_shebang = DEFAULT_SHEBANG;
 	char *shebang = NULL;
 	char *line = NULL;
 
@@ -197,69 +60,149 @@ static char *find_out_shebang(const char *script)
 }
 
 
+// Creates memfd (or unlinked temporary file) with script body. The fd is
+// close-on-exec because other threads can spawn processes too. Only the
+// interpreter gets it as SCRIPT_BODY_FD.
+static int script_body_fd(const char *script)
+{
+	char template[] = "/tmp/klish.script.XXXXXX";
+	size_t len = strlen(script);
+	size_t written = 0;
+	int fd = -1;
+
+#ifdef MFD_CLOEXEC
+	fd = memfd_create("klish-script", MFD_CLOEXEC);
+#endif
+	if (fd < 0) {
+		fd = mkostemp(template, O_CLOEXEC);
+		if (fd < 0)
+			return -1;
+		unlink(template);
+	}
+	// The dup2() to the same fd doesn't clear close-on-exec flag
+	if (SCRIPT_BODY_FD == fd) {
+		int new_fd = fcntl(fd, F_DUPFD_CLOEXEC, SCRIPT_BODY_FD + 1);
+		close(fd);
+		if (new_fd < 0)
+			return -1;
+		fd = new_fd;
+	}
+
+	while (written < len) {
+		ssize_t r = write(fd, script + written, len - written);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			close(fd);
+			return -1;
+		}
+		written += r;
+	}
+	lseek(fd, 0, SEEK_SET);
+
+	return fd;
+}
+
+
 // Execute script
 int script_script(kcontext_t *context)
 {
 	const char *script = NULL;
+	char *shebang = NULL;
+	faux_argv_t *argv = NULL;
+	faux_argv_node_t *iter = NULL;
+	const char *arg = NULL;
+	char **args = NULL;
+	size_t args_num = 0;
+	int body_fd = -1;
+	script_env_t env = {};
+	posix_spawn_file_actions_t actions;
 	pid_t cpid = -1;
+	int wstatus = 0;
+	int err = 0;
 	int res = -1;
-	char *fifo_name = NULL;
-	FILE *wpipe = NULL;
-	char *command = NULL;
-	char *shebang = NULL;
 
 	script = kcontext_script(context);
 	if (faux_str_is_empty(script))
 		return 0;
 
-	// Create FIFO
-	if (!(fifo_name = script_mkfifo())) {
-		fprintf(stderr, "Error: Can't create temporary FIFO.\n"
-			"Error: The ACTION will be not executed.\n");
-		return -1;
-	}
-
-	// Create process to write to FIFO
-	cpid = fork();
-	if (cpid == -1) {
-		fprintf(stderr, "Error: Can't fork the write process.\n"
+	// Interpreter with its arguments
+	shebang = find_out_shebang(script);
+	argv = faux_argv_new();
+	faux_argv_parse(argv, shebang);
+	faux_str_free(shebang);
+	if (faux_argv_len(argv) < 1) {
+		faux_argv_free(argv);
+		kcontext_printf_err(context,
+			"Error: Illegal script interpreter.\n"
 			"Error: The ACTION will be not executed.\n");
-		unlink(fifo_name);
-		faux_str_free(fifo_name);
 		return -1;
 	}
-
-	// Child: write to FIFO
-	if (cpid == 0) {
-		wpipe = fopen(fifo_name, "w");
-		faux_str_free(fifo_name);
-		if (!wpipe)
-			_exit(-1);
-		fwrite(script, strlen(script), 1, wpipe);
-		fflush(wpipe);
-		fclose(wpipe);
-		_exit(0);
+	args = faux_zmalloc((faux_argv_len(argv) + 3) * sizeof(*args));
+	assert(args);
+	iter = faux_argv_iter(argv);
+	while ((arg = faux_argv_each(&iter)))
+		args[args_num++] = (char *)arg;
+
+	// Short script for default shell is passed by argument. Else
+	// interpreter reads script from memfd.
+	if ((faux_argv_len(argv) == 1) &&
+		(strcmp(args[0], DEFAULT_SHEBANG) == 0) &&
+		(strlen(script) < SCRIPT_ARG_MAX)) {
+		args[args_num++] = "-c";
+		args[args_num++] = (char *)script;
+	} else {
+		if ((body_fd = script_body_fd(script)) < 0) {
+			faux_free(args);
+			faux_argv_free(argv);
+			kcontext_printf_err(context,
+				"Error: Can't create script file.\n"
+				"Error: The ACTION will be not executed.\n");
+			return -1;
+		}
+		args[args_num++] = SCRIPT_BODY_PATH;
 	}
+	args[args_num] = NULL;
 
-	// Parent
 	// Populate environment. Put command parameters to env vars.
-	populate_env(context);
-
-	// Prepare command
-	shebang = find_out_shebang(script);
-	command = faux_str_sprintf("%s %s", shebang, fifo_name);
-
-	res = system(command);
-
-	// Wait for the writing process
-	kill(cpid, SIGTERM);
-	while (waitpid(cpid, NULL, 0) != cpid);
+	script_env_populate(&env, context);
+	script_env_inherit(&env);
+
+	// Sync ACTION executed within klishd writes to context's capture
+	// files. Process-wide stdout is not redirected.
+	posix_spawn_file_actions_init(&actions);
+	if (kcontext_fdout(context) != STDOUT_FILENO)
+		posix_spawn_file_actions_adddup2(&actions,
+			kcontext_fdout(context), STDOUT_FILENO);
+	if (kcontext_fderr(context) != STDERR_FILENO)
+		posix_spawn_file_actions_adddup2(&actions,
+			kcontext_fderr(context), STDERR_FILENO);
+	// After stdio because output can be SCRIPT_BODY_FD
+	if (body_fd >= 0)
+		posix_spawn_file_actions_adddup2(&actions,
+			body_fd, SCRIPT_BODY_FD);
+
+	// The posix_spawn() uses vfork-like clone() so it's cheap even if
+	// ACTION is executed within klishd itself (sync ACTION). Interpreter
+	// is searched within PATH like system() did.
+	err = posix_spawnp(&cpid, args[0], &actions, NULL, args,
+		script_env_build(&env));
+	posix_spawn_file_actions_destroy(&actions);
+	if (err != 0) {
+		kcontext_printf_err(context, "Error: Can't execute %s: %s\n",
+			args[0], strerror(err));
+	} else {
+		while ((waitpid(cpid, &wstatus, 0) < 0) && (EINTR == errno));
+		if (WIFEXITED(wstatus))
+			res = WEXITSTATUS(wstatus);
+	}
 
 	// Clean up
-	faux_str_free(command);
-	unlink(fifo_name);
-	faux_str_free(fifo_name);
-	faux_str_free(shebang);
+	script_env_free(&env);
+	if (body_fd >= 0)
+		close(body_fd);
+	faux_free(args);
+	faux_argv_free(argv);
 
-	return WEXITSTATUS(res);
+	return res;
 }
@@ -0,0 +1,659 @@
+/*
+ * Persistent shell coprocess.
+ *
+ * The "shell" sym executes script within long-lived shell process. The
+ * shell is started once per session (on first use) so interpreter startup
+ * is not paid for each ACTION. The shell is a session's udata so sessions
+ * served by the same process don't share it. Each script is sent to the
+ * shell's stdin framed as a subshell with KLISH_* variables exported. The
+ * end of script output is marked by markers on stdout and stderr. Each
+ * script gets new random nonce within marker so script can't forge it.
+ * The stdout marker contains exit status of the script.
+ *
+ * The sym is executed as in-daemon job. The shell's descriptors are polled
+ * by session's event loop so the session is not blocked while script is
+ * running. The script's stdin is /dev/null. If shell is dead, script
+ * exceeds timeout or it's interrupted then shell is killed and it will be
+ * restarted by the next ACTION. If sym is forked (job can't be used) then
+ * the same job functions are executed by own poll loop with temporary
+ * shell.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/timerfd.h>
+#include <sys/random.h>
+
+#include <faux/str.h>
+#include <faux/buf.h>
+#include <faux/file.h>
+#include <klish/kcontext.h>
+
+#include "private.h"
+
+
+#define SHELL_READ_CHUNK 4096
+// Session's udata name
+#define SHELL_UDATA "script.shell"
+// Descriptors job waits for: shell's stdin, stdout, stderr and timer
+#define SHELL_FDS_NUM 4
+// Number of random bytes within end marker
+#define SHELL_NONCE_LEN 16
+
+
+struct script_shell_s {
+	char *shell; // Interpreter
+	unsigned int timeout; // Script timeout (seconds). 0 - unlimited
+	pid_t pid; // Shell process. It's a leader of process group.
+	int in; // Shell's stdin
+	int out; // Shell's stdout
+	int err; // Shell's stderr
+	char nonce[SHELL_NONCE_LEN * 2 + 1]; // Hex nonce of current script
+	bool_t busy; // Script is executing
+};
+
+
+// Output of shell
+typedef struct {
+	int fd; // Shell's output
+	char *marker;
+	size_t marker_len;
+	char *buf; // Data that can be a part of marker
+	size_t len;
+	bool_t done; // Marker is found
+} shell_stream_t;
+
+
+// Script executing within shell
+typedef struct {
+	script_shell_t *sh;
+	char *frame; // Script framed for shell
+	size_t frame_len;
+	size_t written;
+	shell_stream_t out;
+	shell_stream_t err;
+	int timer; // Script timeout. -1 - unlimited
+	int status;
+	const char *error; // Shell is broken and must be restarted
+} shell_job_t;
+
+
+script_shell_conf_t *script_shell_conf_new(const char *shell,
+	unsigned int timeout)
+{
+	script_shell_conf_t *conf = NULL;
+
+	conf = faux_zmalloc(sizeof(*conf));
+	assert(conf);
+	if (!conf)
+		return NULL;
+
+	conf->shell = faux_str_dup(shell);
+	conf->timeout = timeout;
+
+	return conf;
+}
+
+
+void script_shell_conf_free(script_shell_conf_t *conf)
+{
+	if (!conf)
+		return;
+
+	faux_str_free(conf->shell);
+	faux_free(conf);
+}
+
+
+static script_shell_t *script_shell_new(const script_shell_conf_t *conf)
+{
+	script_shell_t *sh = NULL;
+
+	sh = faux_zmalloc(sizeof(*sh));
+	assert(sh);
+	if (!sh)
+		return NULL;
+
+	sh->shell = faux_str_dup(conf->shell);
+	sh->timeout = conf->timeout;
+	sh->pid = -1;
+	sh->in = -1;
+	sh->out = -1;
+	sh->err = -1;
+	sh->nonce[0] = '\0';
+	sh->busy = BOOL_FALSE;
+
+	return sh;
+}
+
+
+static void script_shell_stop(script_shell_t *sh)
+{
+	if (sh->in >= 0)
+		close(sh->in);
+	if (sh->out >= 0)
+		close(sh->out);
+	if (sh->err >= 0)
+		close(sh->err);
+	sh->in = -1;
+	sh->out = -1;
+	sh->err = -1;
+
+	if (sh->pid > 0) {
+		// Kill shell with all scripts' processes
+		kill(-sh->pid, SIGKILL);
+		while ((waitpid(sh->pid, NULL, 0) < 0) && (EINTR == errno));
+	}
+	sh->pid = -1;
+}
+
+
+static void script_shell_free(script_shell_t *sh)
+{
+	if (!sh)
+		return;
+
+	script_shell_stop(sh);
+	faux_str_free(sh->shell);
+	faux_free(sh);
+}
+
+
+static bool_t script_shell_udata_free(void *data)
+{
+	script_shell_free((script_shell_t *)data);
+
+	return BOOL_TRUE;
+}
+
+
+// Session's shell. It's created on first use.
+static script_shell_t *script_shell_get(kcontext_t *context)
+{
+	const script_shell_conf_t *conf = NULL;
+	script_shell_t *sh = NULL;
+
+	sh = (script_shell_t *)kcontext_session_udata(context, SHELL_UDATA);
+	if (sh)
+		return sh;
+	if (!kcontext_session(context))
+		return NULL;
+	conf = (const script_shell_conf_t *)kcontext_udata(context);
+	assert(conf);
+	if (!conf)
+		return NULL;
+	sh = script_shell_new(conf);
+	// Store frees data on error
+	if (!kcontext_session_udata_new(context, SHELL_UDATA, sh,
+		script_shell_udata_free))
+		return NULL;
+
+	return sh;
+}
+
+
+static bool_t script_shell_start(script_shell_t *sh)
+{
+	int in[2] = {-1, -1};
+	int out[2] = {-1, -1};
+	int err[2] = {-1, -1};
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t sigs;
+	char *argv[2] = {};
+	int rc = -1;
+	int i = 0;
+
+	if ((pipe2(in, O_CLOEXEC) < 0) || (pipe2(out, O_CLOEXEC) < 0) ||
+		(pipe2(err, O_CLOEXEC) < 0)) {
+		int *fds[] = {in, out, err};
+		for (i = 0; i < 3; i++) {
+			if (fds[i][0] >= 0)
+				close(fds[i][0]);
+			if (fds[i][1] >= 0)
+				close(fds[i][1]);
+		}
+		return BOOL_FALSE;
+	}
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, in[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, err[1], STDERR_FILENO);
+	// Own process group to kill shell with its children. Event loop of
+	// session process can block signals so unblock them.
+	posix_spawnattr_init(&attr);
+	sigemptyset(&sigs);
+	posix_spawnattr_setsigmask(&attr, &sigs);
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr,
+		POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+	argv[0] = sh->shell;
+	argv[1] = NULL;
+	rc = posix_spawnp(&sh->pid, sh->shell, &actions, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	close(in[0]);
+	close(out[1]);
+	close(err[1]);
+	sh->in = in[1];
+	sh->out = out[0];
+	sh->err = err[0];
+	if (rc != 0) {
+		sh->pid = -1;
+		script_shell_stop(sh);
+		return BOOL_FALSE;
+	}
+	fcntl(sh->in, F_SETFL, fcntl(sh->in, F_GETFL) | O_NONBLOCK);
+	fcntl(sh->out, F_SETFL, fcntl(sh->out, F_GETFL) | O_NONBLOCK);
+	fcntl(sh->err, F_SETFL, fcntl(sh->err, F_GETFL) | O_NONBLOCK);
+
+	return BOOL_TRUE;
+}
+
+
+// Shell is started and it's still alive
+static bool_t script_shell_ready(script_shell_t *sh)
+{
+	if (sh->pid > 0) {
+		if (waitpid(sh->pid, NULL, WNOHANG) == 0)
+			return BOOL_TRUE;
+		sh->pid = -1; // Already waited
+		script_shell_stop(sh);
+	}
+
+	return script_shell_start(sh);
+}
+
+
+static char *shell_quote(const char *str)
+{
+	char *res = NULL;
+	const char *p = NULL;
+
+	res = faux_str_dup("'");
+	for (p = str; *p; p++) {
+		if ('\'' == *p)
+			faux_str_cat(&res, "'\\''");
+		else
+			faux_str_catn(&res, p, 1);
+	}
+	faux_str_cat(&res, "'");
+
+	return res;
+}
+
+
+// Shell can't import variables with such names
+static bool_t shell_is_var_name(const char *name, size_t len)
+{
+	size_t i = 0;
+
+	if (0 == len)
+		return BOOL_FALSE;
+	for (i = 0; i < len; i++) {
+		char c = name[i];
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			(c == '_') || ((i > 0) && (c >= '0' && c <= '9')))
+			continue;
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Generates new nonce for end marker
+static bool_t shell_nonce_new(script_shell_t *sh)
+{
+	unsigned char rnd[SHELL_NONCE_LEN] = {};
+	size_t got = 0;
+	size_t i = 0;
+
+	while (got < sizeof(rnd)) {
+		ssize_t r = getrandom(rnd + got, sizeof(rnd) - got, 0);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			return BOOL_FALSE;
+		}
+		got += r;
+	}
+	for (i = 0; i < sizeof(rnd); i++)
+		snprintf(sh->nonce + i * 2, 3, "%02x", rnd[i]);
+
+	return BOOL_TRUE;
+}
+
+
+static char *shell_frame(script_shell_t *sh, kcontext_t *context,
+	const char *script)
+{
+	script_env_t env = {};
+	char **envp = NULL;
+	char *frame = NULL;
+	char *quoted = NULL;
+
+	frame = faux_str_dup("(\n");
+
+	script_env_populate(&env, context);
+	for (envp = script_env_build(&env); *envp; envp++) {
+		const char *var = *envp;
+		const char *eq = strchr(var, '=');
+		if (!eq || !shell_is_var_name(var, eq - var))
+			continue;
+		quoted = shell_quote(eq + 1);
+		faux_str_cat(&frame, "export ");
+		faux_str_catn(&frame, var, eq - var + 1);
+		faux_str_cat(&frame, quoted);
+		faux_str_cat(&frame, "\n");
+		faux_str_free(quoted);
+	}
+	script_env_free(&env);
+
+	// Script is evaluated so syntax error can't break the framing
+	quoted = shell_quote(script);
+	faux_str_mcat(&frame, "eval ", quoted, "\n", NULL);
+	faux_str_free(quoted);
+
+	faux_str_cat(&frame, ") </dev/null\n");
+	quoted = faux_str_sprintf(
+		"printf '\\001KLISH-%s\\001%%d\\n' \"$?\"\n"
+		"printf '\\001KLISH-%s\\001' >&2\n",
+		sh->nonce, sh->nonce);
+	faux_str_cat(&frame, quoted);
+	faux_str_free(quoted);
+
+	return frame;
+}
+
+
+// Reads shell's output and passes it to destination until marker. Data
+// that can be a beginning of marker is hold. Returns BOOL_FALSE if shell
+// closed output.
+static bool_t shell_stream_read(shell_stream_t *stream, int *status,
+	faux_buf_t *dst)
+{
+	char *marker = NULL;
+	ssize_t r = 0;
+	size_t pass = 0;
+
+	stream->buf = realloc(stream->buf, stream->len + SHELL_READ_CHUNK);
+	assert(stream->buf);
+	r = read(stream->fd, stream->buf + stream->len, SHELL_READ_CHUNK);
+	if (r < 0)
+		return ((EAGAIN == errno) || (EINTR == errno)) ?
+			BOOL_TRUE : BOOL_FALSE;
+	if (0 == r)
+		return BOOL_FALSE;
+	stream->len += r;
+
+	marker = memmem(stream->buf, stream->len,
+		stream->marker, stream->marker_len);
+	if (marker) {
+		pass = marker - stream->buf;
+		if (status) {
+			char *start = marker + stream->marker_len;
+			char *nl = memchr(start, '\n',
+				stream->len - (start - stream->buf));
+			if (nl) {
+				*nl = '\0';
+				*status = atoi(start);
+				stream->done = BOOL_TRUE;
+			}
+		} else {
+			stream->done = BOOL_TRUE;
+		}
+	} else if (stream->len >= stream->marker_len) {
+		pass = stream->len - (stream->marker_len - 1);
+	}
+
+	if (pass > 0) {
+		if (dst)
+			faux_buf_write(dst, stream->buf, pass);
+		stream->len -= pass;
+		memmove(stream->buf, stream->buf + pass, stream->len);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static shell_job_t *shell_job_new(kcontext_t *context, script_shell_t *sh)
+{
+	shell_job_t *job = NULL;
+	const char *script = NULL;
+
+	job = faux_zmalloc(sizeof(*job));
+	assert(job);
+	if (!job)
+		return NULL;
+	job->sh = sh;
+	job->timer = -1;
+	job->status = -1;
+	job->out.fd = -1;
+	job->err.fd = -1;
+	sh->busy = BOOL_TRUE;
+
+	script = kcontext_script(context);
+	if (faux_str_is_empty(script)) {
+		job->out.done = BOOL_TRUE;
+		job->err.done = BOOL_TRUE;
+		job->status = 0;
+		return job;
+	}
+	if (!script_shell_ready(sh)) {
+		job->error = "Can't start shell";
+		return job;
+	}
+	if (!shell_nonce_new(sh)) {
+		job->error = "Can't generate marker";
+		return job;
+	}
+	job->frame = shell_frame(sh, context, script);
+	job->frame_len = strlen(job->frame);
+
+	job->out.fd = sh->out;
+	job->out.marker = faux_str_sprintf("\001KLISH-%s\001", sh->nonce);
+	job->out.marker_len = strlen(job->out.marker);
+	job->err.fd = sh->err;
+	job->err.marker = faux_str_dup(job->out.marker);
+	job->err.marker_len = job->out.marker_len;
+
+	if (sh->timeout > 0) {
+		struct itimerspec its = {};
+		its.it_value.tv_sec = sh->timeout;
+		job->timer = timerfd_create(CLOCK_MONOTONIC,
+			TFD_CLOEXEC | TFD_NONBLOCK);
+		if ((job->timer < 0) ||
+			(timerfd_settime(job->timer, 0, &its, NULL) < 0))
+			job->error = "Can't set script timeout";
+	}
+
+	return job;
+}
+
+
+// Start script within session's shell. Returns NULL if shell is busy
+// (another pipeline stage uses it) or there is no session. Then the sym
+// will be forked.
+void *script_shell_job_init(kcontext_t *context)
+{
+	script_shell_t *sh = NULL;
+
+	sh = script_shell_get(context);
+	if (!sh || sh->busy)
+		return NULL;
+
+	return shell_job_new(context, sh);
+}
+
+
+size_t script_shell_job_poll(void *state, struct pollfd *fds, size_t max)
+{
+	shell_job_t *job = (shell_job_t *)state;
+	size_t num = 0;
+
+	if (job->error || (job->out.done && job->err.done))
+		return 0;
+	if (max < SHELL_FDS_NUM) {
+		job->error = "Too many descriptors";
+		return 0;
+	}
+
+	if (!job->out.done) {
+		fds[num].fd = job->out.fd;
+		fds[num++].events = POLLIN;
+	}
+	if (!job->err.done) {
+		fds[num].fd = job->err.fd;
+		fds[num++].events = POLLIN;
+	}
+	if (job->written < job->frame_len) {
+		fds[num].fd = job->sh->in;
+		fds[num++].events = POLLOUT;
+	}
+	if (job->timer >= 0) {
+		fds[num].fd = job->timer;
+		fds[num++].events = POLLIN;
+	}
+
+	return num;
+}
+
+
+void script_shell_job_event(void *state, const struct pollfd *fds,
+	size_t num, faux_buf_t *out, faux_buf_t *err)
+{
+	shell_job_t *job = (shell_job_t *)state;
+	size_t i = 0;
+
+	for (i = 0; (i < num) && !job->error; i++) {
+		int fd = fds[i].fd;
+		if (0 == fds[i].revents)
+			continue;
+		if (fd == job->timer) {
+			job->error = "Script timeout is exceeded";
+		} else if (fd == job->sh->in) {
+			ssize_t w = write(job->sh->in, job->frame + job->written,
+				job->frame_len - job->written);
+			if (w > 0)
+				job->written += w;
+			else if ((errno != EAGAIN) && (errno != EINTR))
+				job->error = "Can't write to shell";
+		} else if (fd == job->out.fd) {
+			if (!shell_stream_read(&job->out, &job->status, out))
+				job->error = "Shell is terminated";
+		} else if (fd == job->err.fd) {
+			if (!shell_stream_read(&job->err, NULL, err))
+				job->error = "Shell is terminated";
+		}
+	}
+}
+
+
+// Output buffers are NULL if script is interrupted
+int script_shell_job_fini(void *state, faux_buf_t *out, faux_buf_t *err)
+{
+	shell_job_t *job = (shell_job_t *)state;
+	int status = job->status;
+
+	// Rest of output. It can't contain marker.
+	if (job->error || !job->out.done || !job->err.done) {
+		if (out)
+			faux_buf_write(out, job->out.buf, job->out.len);
+		if (err) {
+			faux_buf_write(err, job->err.buf, job->err.len);
+			if (job->error) {
+				char *msg = faux_str_sprintf("Error: %s\n",
+					job->error);
+				faux_buf_write(err, msg, strlen(msg));
+				faux_str_free(msg);
+			}
+		}
+		// Restart shell next time
+		script_shell_stop(job->sh);
+		status = -1;
+	}
+	job->sh->busy = BOOL_FALSE;
+
+	if (job->timer >= 0)
+		close(job->timer);
+	faux_free(job->out.buf);
+	faux_free(job->err.buf);
+	faux_str_free(job->out.marker);
+	faux_str_free(job->err.marker);
+	faux_str_free(job->frame);
+	faux_free(job);
+
+	return status;
+}
+
+
+static void shell_buf_write(faux_buf_t *buf, int fd)
+{
+	void *data = NULL;
+	ssize_t len = 0;
+
+	while ((len = faux_buf_dread_lock_easy(buf, &data)) > 0) {
+		faux_write_block(fd, data, len);
+		faux_buf_dread_unlock_easy(buf, len);
+	}
+}
+
+
+// Execute script within temporary shell. It's used when sym is forked.
+int script_shell(kcontext_t *context)
+{
+	const script_shell_conf_t *conf = NULL;
+	script_shell_t *sh = NULL;
+	shell_job_t *job = NULL;
+	faux_buf_t *out = NULL;
+	faux_buf_t *err = NULL;
+	struct pollfd fds[SHELL_FDS_NUM] = {};
+	size_t num = 0;
+	int status = -1;
+
+	conf = (const script_shell_conf_t *)kcontext_udata(context);
+	assert(conf);
+	if (!conf)
+		return -1;
+	sh = script_shell_new(conf);
+	job = shell_job_new(context, sh);
+	out = faux_buf_new(0);
+	err = faux_buf_new(0);
+
+	while ((num = script_shell_job_poll(job, fds, SHELL_FDS_NUM)) > 0) {
+		if (poll(fds, num, -1) < 0) {
+			if (EINTR == errno)
+				continue;
+			job->error = "Can't poll shell";
+			break;
+		}
+		script_shell_job_event(job, fds, num, out, err);
+		shell_buf_write(out, kcontext_fdout(context));
+		shell_buf_write(err, kcontext_fderr(context));
+	}
+	status = script_shell_job_fini(job, out, err);
+	shell_buf_write(out, kcontext_fdout(context));
+	shell_buf_write(err, kcontext_fderr(context));
+
+	faux_buf_free(out);
+	faux_buf_free(err);
+	script_shell_free(sh);
+
+	return status;
+}